@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho.h"
+#include "grr.h"
+
+struct grrAhoCorasick {
+    int32_t *transitions;
+    uint8_t *terminal;
+    uint32_t num_classes;
+    uint8_t byte_classes[256];
+};
+
+int
+grrAhoCorasickBuild(const grrPattern *patterns, size_t num_patterns, bool fold_case, grrAhoCorasick **automaton)
+{
+    int ret = GRR_APP_RET_OUT_OF_MEMORY;
+    size_t max_states = 1;
+    uint32_t num_classes = 1, num_states = 1, *fail = NULL, *queue = NULL, head = 0, tail = 0;
+    grrAhoCorasick *new_automaton;
+
+    for (size_t k = 0; k < num_patterns; k++) {
+        if (patterns[k].literal.len == 0) {
+            return GRR_APP_RET_NOT_FOUND;
+        }
+        max_states += patterns[k].literal.len;
+    }
+
+    new_automaton = calloc(1, sizeof(*new_automaton));
+    if (!new_automaton) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    // Bytes which don't appear in any literal all share class 0.
+    for (size_t k = 0; k < num_patterns; k++) {
+        for (size_t j = 0; j < patterns[k].literal.len; j++) {
+            uint8_t c = patterns[k].literal.string[j];
+
+            if (new_automaton->byte_classes[c] == 0) {
+                new_automaton->byte_classes[c] = num_classes++;
+            }
+        }
+    }
+    new_automaton->num_classes = num_classes;
+    if (fold_case) {
+        for (unsigned int c = 'a'; c <= 'z'; c++) {
+            new_automaton->byte_classes[c - ('a' - 'A')] = new_automaton->byte_classes[c];
+        }
+    }
+
+    new_automaton->transitions = malloc(max_states * num_classes * sizeof(*new_automaton->transitions));
+    new_automaton->terminal = calloc(max_states, sizeof(*new_automaton->terminal));
+    fail = malloc(max_states * sizeof(*fail));
+    queue = malloc(max_states * sizeof(*queue));
+    if (!new_automaton->transitions || !new_automaton->terminal || !fail || !queue) {
+        goto done;
+    }
+    memset(new_automaton->transitions, 0xff, max_states * num_classes * sizeof(*new_automaton->transitions));
+
+    for (size_t k = 0; k < num_patterns; k++) {
+        uint32_t state = 0;
+
+        for (size_t j = 0; j < patterns[k].literal.len; j++) {
+            int32_t *slot = new_automaton->transitions + (size_t)state * num_classes +
+                            new_automaton->byte_classes[(uint8_t)patterns[k].literal.string[j]];
+
+            if (*slot < 0) {
+                *slot = num_states++;
+            }
+            state = *slot;
+        }
+        new_automaton->terminal[state] = 1;
+    }
+
+    // Fill in the missing transitions breadth-first so that each state's failure state is already complete.
+    for (uint32_t class = 0; class < num_classes; class++) {
+        int32_t *slot = new_automaton->transitions + class;
+
+        if (*slot < 0) {
+            *slot = 0;
+        }
+        else {
+            fail[*slot] = 0;
+            queue[tail++] = *slot;
+        }
+    }
+    while (head < tail) {
+        uint32_t state = queue[head++];
+        int32_t *row = new_automaton->transitions + (size_t)state * num_classes;
+        const int32_t *fail_row = new_automaton->transitions + (size_t)fail[state] * num_classes;
+
+        new_automaton->terminal[state] |= new_automaton->terminal[fail[state]];
+        for (uint32_t class = 0; class < num_classes; class++) {
+            if (row[class] < 0) {
+                row[class] = fail_row[class];
+            }
+            else {
+                fail[row[class]] = fail_row[class];
+                queue[tail++] = row[class];
+            }
+        }
+    }
+
+    *automaton = new_automaton;
+    new_automaton = NULL;
+    ret = GRR_APP_RET_OK;
+
+done:
+
+    free(fail);
+    free(queue);
+    grrAhoCorasickFree(new_automaton);
+
+    return ret;
+}
+
+void
+grrAhoCorasickFree(grrAhoCorasick *automaton)
+{
+    if (automaton) {
+        free(automaton->transitions);
+        free(automaton->terminal);
+        free(automaton);
+    }
+}
+
+const char *
+grrAhoCorasickFind(const grrAhoCorasick *automaton, const char *haystack, size_t len)
+{
+    uint32_t state = 0;
+    const uint32_t num_classes = automaton->num_classes;
+
+    for (size_t k = 0; k < len; k++) {
+        state = automaton->transitions[(size_t)state * num_classes + automaton->byte_classes[(uint8_t)haystack[k]]];
+        if (automaton->terminal[state]) {
+            return haystack + k;
+        }
+    }
+
+    return NULL;
+}
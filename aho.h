@@ -0,0 +1,35 @@
+#ifndef GRR_AHO_H
+#define GRR_AHO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * An Aho-Corasick automaton over the required literals of several patterns.  It finds, in a single pass, the
+ * first place where any of the literals occurs.  Once built, it is read-only and so can be shared by all
+ * threads.
+ */
+typedef struct grrAhoCorasick grrAhoCorasick;
+
+struct grrPattern;
+
+/*
+ * Builds the automaton for a set of patterns.  Returns GRR_APP_RET_NOT_FOUND if any of the patterns has no
+ * required literal since, in that case, every line would have to be examined anyway.  If fold_case is true,
+ * the literals have to be lowercase and uppercase letters are given the same byte classes as their lowercase
+ * counterparts so that the automaton ignores case at no extra cost.
+ */
+int
+grrAhoCorasickBuild(const struct grrPattern *patterns, size_t num_patterns, bool fold_case,
+                    grrAhoCorasick **automaton);
+
+void
+grrAhoCorasickFree(grrAhoCorasick *automaton);
+
+/*
+ * Returns a pointer to the last byte of the first occurrence of any of the literals or NULL if there is none.
+ */
+const char *
+grrAhoCorasickFind(const grrAhoCorasick *automaton, const char *haystack, size_t len);
+
+#endif  // GRR_AHO_H
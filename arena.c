@@ -0,0 +1,174 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "grr.h"
+
+#define GRR_ARENA_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+struct grrArenaBlock {
+    grrArenaBlock *prev;
+    size_t size;
+    size_t used;
+    atomic_uint refs;
+};
+
+// The blocks' data starts right after their headers.
+#define GRR_ARENA_HEADER_SIZE GRR_ARENA_ALIGN(sizeof(grrArenaBlock))
+#define BLOCK_DATA(block)     ((char *)(block) + GRR_ARENA_HEADER_SIZE)
+
+static grrArenaBlock *
+newBlock(grrArena *arena, size_t size);
+
+void
+grrArenaInit(grrArena *arena, grrStats *stats, bool shared)
+{
+    *arena = (grrArena){.stats = stats, .block_size = GRR_ARENA_BLOCK_SIZE, .shared = shared};
+}
+
+void *
+grrArenaAlloc(grrArena *arena, size_t size)
+{
+    grrArenaBlock *block = arena->current;
+    void *ptr;
+
+    size = GRR_ARENA_ALIGN(size);
+    if (!block || block->size - block->used < size) {
+        block = newBlock(arena, size);
+        if (!block) {
+            return NULL;
+        }
+    }
+
+    ptr = BLOCK_DATA(block) + block->used;
+    block->used += size;
+    GRR_STAT_ADD(arena->stats, GRR_STAT_ARENA_ALLOCATIONS, 1);
+
+    return ptr;
+}
+
+char *
+grrArenaStrndup(grrArena *arena, const char *string, size_t len)
+{
+    char *copy;
+
+    copy = grrArenaAlloc(arena, len + 1);
+    if (copy) {
+        memcpy(copy, string, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void *
+grrArenaAllocShared(grrArena *arena, size_t size, grrArenaBlock **block)
+{
+    void *ptr;
+
+    ptr = grrArenaAlloc(arena, size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    *block = arena->current;
+    atomic_fetch_add(&(*block)->refs, 1);
+    return ptr;
+}
+
+void
+grrArenaReleaseBlock(grrArenaBlock *block)
+{
+    if (block && atomic_fetch_sub(&block->refs, 1) == 1) {
+        free(block);
+    }
+}
+
+grrArenaMark
+grrArenaGetMark(const grrArena *arena)
+{
+    return (grrArenaMark){.block = arena->current, .used = arena->current ? arena->current->used : 0};
+}
+
+void
+grrArenaReset(grrArena *arena, grrArenaMark mark)
+{
+    while (arena->current != mark.block) {
+        grrArenaBlock *block = arena->current;
+
+        arena->current = block->prev;
+        // Oversized blocks are unlikely to be needed again.
+        if (block->size <= GRR_ARENA_BLOCK_SIZE) {
+            block->prev = arena->spare;
+            arena->spare = block;
+        }
+        else {
+            free(block);
+        }
+    }
+
+    if (arena->current) {
+        arena->current->used = mark.used;
+    }
+}
+
+void
+grrArenaFree(grrArena *arena)
+{
+    if (arena->shared) {
+        grrArenaReleaseBlock(arena->current);
+        arena->current = NULL;
+    }
+    else {
+        grrArenaReset(arena, (grrArenaMark){0});
+    }
+
+    while (arena->spare) {
+        grrArenaBlock *block = arena->spare;
+
+        arena->spare = block->prev;
+        free(block);
+    }
+}
+
+/*
+ * Makes a new block, which can hold at least size bytes, the current one.  The arena holds a reference to its
+ * current block, which a shared arena drops as it moves on.
+ */
+static grrArenaBlock *
+newBlock(grrArena *arena, size_t size)
+{
+    grrArenaBlock *block;
+
+    if (arena->spare && arena->spare->size >= size) {
+        block = arena->spare;
+        arena->spare = block->prev;
+    }
+    else {
+        size_t block_size = MAX(size, arena->block_size);
+
+        arena->block_size = MIN(2 * arena->block_size, GRR_ARENA_BLOCK_SIZE);
+
+        block = malloc(GRR_ARENA_HEADER_SIZE + block_size);
+        if (!block) {
+            return NULL;
+        }
+        block->size = block_size;
+        GRR_STAT_ADD(arena->stats, GRR_STAT_ARENA_BLOCKS, 1);
+        GRR_STAT_ADD(arena->stats, GRR_STAT_ARENA_BYTES, block_size);
+    }
+
+    block->used = 0;
+    atomic_init(&block->refs, 1);
+    if (arena->shared) {
+        grrArenaReleaseBlock(arena->current);
+        block->prev = NULL;
+    }
+    else {
+        block->prev = arena->current;
+    }
+    arena->current = block;
+
+    return block;
+}
@@ -0,0 +1,85 @@
+#ifndef GRR_ARENA_H
+#define GRR_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "stats.h"
+
+/*
+ * The size of the blocks which arenas allocate from.  Larger requests get a block of their own.  An arena can
+ * start out with smaller blocks (see block_size below), in which case each block is twice as large as the one
+ * before it until they reach this size.
+ */
+#define GRR_ARENA_BLOCK_SIZE     (64 * 1024)
+#define GRR_ARENA_MIN_BLOCK_SIZE (2 * 1024)
+
+typedef struct grrArenaBlock grrArenaBlock;
+
+/*
+ * A region allocator.  Memory is handed out by bumping a pointer through a chain of blocks and is never freed
+ * piece by piece.  Instead, the arena is reset to a mark taken earlier, which releases everything allocated
+ * since then, or freed as a whole.  Marks nest so that a traversal can take one on the way into each directory
+ * and reset to it on the way out.  Blocks released by a reset are kept for reuse so that, once an arena has
+ * grown to the traversal's deepest point, it stops calling malloc altogether.
+ *
+ * A shared arena is never reset.  Instead, each of its allocations holds a reference to its block, which can
+ * be dropped from any thread with grrArenaReleaseBlock, and a block is freed once the arena has moved on from
+ * it and all of its allocations have been released.  This lets a worker bump-allocate records which are
+ * consumed, and released, by another thread.
+ *
+ * Otherwise, an arena is only used by a single thread.  If stats isn't NULL, the arena counts its allocations
+ * in it.  block_size is the size of the next block to be allocated.  It starts out as GRR_ARENA_BLOCK_SIZE but
+ * can be lowered for arenas which usually stay small.
+ */
+typedef struct grrArena {
+    grrArenaBlock *current;
+    grrArenaBlock *spare;
+    grrStats *stats;
+    size_t block_size;
+    bool shared;
+} grrArena;
+
+typedef struct grrArenaMark {
+    grrArenaBlock *block;
+    size_t used;
+} grrArenaMark;
+
+void
+grrArenaInit(grrArena *arena, grrStats *stats, bool shared);
+
+/*
+ * Returns a 16-byte-aligned allocation or NULL if a new block couldn't be allocated.
+ */
+void *
+grrArenaAlloc(grrArena *arena, size_t size);
+
+char *
+grrArenaStrndup(grrArena *arena, const char *string, size_t len);
+
+/*
+ * Allocates from a shared arena and sets *block to the allocation's block, whose reference has to be released
+ * once the allocation is no longer needed.
+ */
+void *
+grrArenaAllocShared(grrArena *arena, size_t size, grrArenaBlock **block);
+
+/*
+ * Drops a reference taken by grrArenaAllocShared.  The block may be NULL.
+ */
+void
+grrArenaReleaseBlock(grrArenaBlock *block);
+
+grrArenaMark
+grrArenaGetMark(const grrArena *arena);
+
+void
+grrArenaReset(grrArena *arena, grrArenaMark mark);
+
+/*
+ * Frees every block.  A shared arena's blocks live on until their allocations have been released.
+ */
+void
+grrArenaFree(grrArena *arena);
+
+#endif  // GRR_ARENA_H
@@ -0,0 +1,700 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "grr.h"
+
+#define GRR_CACHE_MAGIC          "GRRCACH1"
+#define GRR_RESULT_CACHE_MAGIC   "GRRRSLT1"
+#define GRR_PROGRAM_CACHE_PREFIX "program-"
+#define GRR_RESULT_CACHE_PREFIX  "results-"
+#define GRR_SOCKET_PREFIX        "server-"
+#define ALIGN8(n)                (((n) + 7) & ~(uint64_t)7)
+
+/*
+ * A cache file consists of this header, the key, and then the serialized program (aligned on an 8-byte
+ * boundary).  The key is Grr's version followed by every regex, each of which is terminated by a null byte, so
+ * that a file whose name collides with that of another set of regexes is never mistaken for it.  A
+ * program_len of 0 means that the regexes can't be run as a DFA.
+ */
+typedef struct grrCacheHeader {
+    char magic[8];
+    uint64_t key_len;
+    uint64_t program_offset;
+    uint64_t program_len;
+} grrCacheHeader;
+
+/*
+ * A result cache file consists of this header, the key (padded to an 8-byte boundary), an array of entries
+ * sorted by path, the results, the results' text, and finally the null-terminated paths (relative to the
+ * starting directory).  Its key is Grr's version, the absolute starting directory, the options which affect
+ * the results' text, and the regexes.
+ */
+typedef struct grrResultCacheHeader {
+    char magic[8];
+    uint64_t key_len;
+    uint64_t num_files;
+} grrResultCacheHeader;
+
+typedef struct grrResultCacheEntry {
+    uint64_t path_offset;
+    uint64_t results_offset;
+    uint64_t num_results;
+    uint64_t text_offset;
+    uint64_t text_len;
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+} grrResultCacheEntry;
+
+typedef struct grrCachedResult {
+    uint64_t file_line_no;
+    uint64_t offset;
+    uint64_t len;
+} grrCachedResult;
+
+/*
+ * A file searched (or whose results were reused) during the current invocation.
+ */
+typedef struct grrCachedFile {
+    char *path;
+    grrCachedResult *results;
+    char *text;
+    grrResultCacheEntry entry;
+} grrCachedFile;
+
+struct grrResultCache {
+    char *key;
+    size_t key_len;
+    size_t root_len;
+    const char *map;
+    size_t map_len;
+    const grrResultCacheEntry *entries;
+    size_t num_entries;
+    grrCachedFile *files;
+    size_t num_files;
+    size_t files_capacity;
+    pthread_mutex_t lock;
+};
+
+static char *
+makeKey(const char *prefix, size_t prefix_len, const char *const *regexes, size_t num_regexes, size_t *len);
+
+static int
+cachePath(const char *name_prefix, const char *key, size_t key_len, char *path, size_t size, bool create);
+
+static int
+mapResultCache(grrResultCache *cache);
+
+static const grrResultCacheEntry *
+findResultEntry(const grrResultCache *cache, const char *path);
+
+static bool
+entryIsCurrent(const grrResultCacheEntry *entry, const struct stat *file_stat);
+
+static int
+compareCachedFiles(const void *item1, const void *item2);
+
+int
+grrCacheLoadProgram(const char *const *regexes, size_t num_regexes, grrProgram **program)
+{
+    int fd, ret = GRR_APP_RET_NOT_FOUND;
+    size_t key_len, map_len = 0;
+    char *key, *map = MAP_FAILED;
+    char path[PATH_MAX];
+    const grrCacheHeader *header;
+    struct stat file_stat;
+
+    key = makeKey(NULL, 0, regexes, num_regexes, &key_len);
+    if (!key) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    if (cachePath(GRR_PROGRAM_CACHE_PREFIX, key, key_len, path, sizeof(path), false) != GRR_APP_RET_OK) {
+        goto done;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        goto done;
+    }
+    if (fstat(fd, &file_stat) == 0 && (size_t)file_stat.st_size >= sizeof(*header)) {
+        map_len = file_stat.st_size;
+        map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        goto done;
+    }
+
+    header = (const grrCacheHeader *)map;
+    if (memcmp(header->magic, GRR_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->key_len != key_len ||
+        key_len > map_len - sizeof(*header) || memcmp(header + 1, key, key_len) != 0 ||
+        header->program_offset > map_len || header->program_len != map_len - header->program_offset) {
+        goto unmap;
+    }
+
+    if (header->program_len == 0) {
+        *program = NULL;
+        ret = GRR_APP_RET_OK;
+        goto unmap;
+    }
+
+    // On success, the program owns the mapping.
+    ret = grrProgramMap(map, map_len, header->program_offset, program);
+    if (ret == GRR_APP_RET_OK) {
+        goto done;
+    }
+    if (ret == GRR_APP_RET_BAD_DATA) {
+        ret = GRR_APP_RET_NOT_FOUND;
+    }
+
+unmap:
+
+    munmap(map, map_len);
+
+done:
+
+    free(key);
+    return ret;
+}
+
+int
+grrCacheStoreProgram(const char *const *regexes, size_t num_regexes, const grrProgram *program)
+{
+    int fd, ret;
+    size_t key_len;
+    char *key;
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    void *serialized = NULL;
+    grrCacheHeader header = {0};
+    grrOutput output;
+
+    key = makeKey(NULL, 0, regexes, num_regexes, &key_len);
+    if (!key) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    ret = cachePath(GRR_PROGRAM_CACHE_PREFIX, key, key_len, path, sizeof(path), true);
+    if (ret != GRR_APP_RET_OK) {
+        goto done;
+    }
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path)) {
+        ret = GRR_APP_RET_OVERFLOW;
+        goto done;
+    }
+
+    memcpy(header.magic, GRR_CACHE_MAGIC, sizeof(header.magic));
+    header.key_len = key_len;
+    header.program_offset = ALIGN8(sizeof(header) + key_len);
+    if (program) {
+        header.program_len = grrProgramSize(program);
+        serialized = calloc(1, header.program_len);
+        if (!serialized) {
+            ret = GRR_APP_RET_OUT_OF_MEMORY;
+            goto done;
+        }
+        grrProgramSerialize(program, serialized);
+    }
+
+    // Other invocations might be reading the file so it's replaced rather than overwritten.
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto done;
+    }
+
+    ret = grrOutputInit(&output, fd);
+    if (ret == GRR_APP_RET_OK) {
+        static const char padding[8] = {0};
+
+        grrOutputWrite(&output, (const char *)&header, sizeof(header));
+        grrOutputWrite(&output, key, key_len);
+        grrOutputWrite(&output, padding, header.program_offset - sizeof(header) - key_len);
+        if (serialized) {
+            grrOutputWrite(&output, serialized, header.program_len);
+        }
+        ret = grrOutputClose(&output);
+    }
+    close(fd);
+
+    if (ret == GRR_APP_RET_OK && rename(tmp_path, path) != 0) {
+        ret = GRR_APP_RET_FILE_ACCESS;
+    }
+    if (ret != GRR_APP_RET_OK) {
+        unlink(tmp_path);
+    }
+
+done:
+
+    free(serialized);
+    free(key);
+    return ret;
+}
+
+int
+grrResultCacheOpen(const grrOptions *options, grrResultCache **cache)
+{
+    char prefix[PATH_MAX + 64];
+    int prefix_len;
+    const char **regexes;
+    grrResultCache *new_cache;
+
+    // The options are recorded as a short string ahead of the starting directory.
+    prefix_len = snprintf(prefix, 64, "%c%c%c%c%c%c%c%c%li,%li,", options->names_only ? 'n' : '-',
+                          options->colorless ? 'c' : '-', options->binary_as_text ? 'a' : '-',
+                          options->fold_case ? 'I' : '-',
+                          options->full_line ? 'x' : '-', options->all_matches ? 'm' : '-',
+                          options->only_matching ? 'o' : '-', options->count_matches ? 'C' : '-',
+                          options->before_context, options->after_context);
+    if (!realpath(options->starting_directory, prefix + prefix_len)) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+    prefix_len = strlen(prefix) + 1;
+
+    regexes = malloc(options->num_patterns * sizeof(*regexes));
+    new_cache = calloc(1, sizeof(*new_cache));
+    if (!regexes || !new_cache) {
+        free(regexes);
+        free(new_cache);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        // The results are tagged with the regexes as they were given, which -I can fold together.
+        regexes[k] = options->patterns[k].regex;
+    }
+
+    new_cache->key = makeKey(prefix, prefix_len, regexes, options->num_patterns, &new_cache->key_len);
+    free(regexes);
+    if (!new_cache->key) {
+        free(new_cache);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    new_cache->root_len = strlen(options->starting_directory);
+    pthread_mutex_init(&new_cache->lock, NULL);
+
+    // Without a usable cache file, every file is simply searched.
+    if (mapResultCache(new_cache) != GRR_APP_RET_OK) {
+        new_cache->map = NULL;
+        new_cache->num_entries = 0;
+    }
+
+    *cache = new_cache;
+    return GRR_APP_RET_OK;
+}
+
+bool
+grrResultCacheLookup(const grrResultCache *cache, const char *path, const struct stat *file_stat,
+                     grrResultSet *results)
+{
+    const grrResultCacheEntry *entry;
+    const grrCachedResult *cached;
+    size_t results_size;
+
+    entry = findResultEntry(cache, path + cache->root_len);
+    if (!entry || !entryIsCurrent(entry, file_stat)) {
+        return false;
+    }
+
+    cached = (const grrCachedResult *)(cache->map + entry->results_offset);
+    results_size = entry->num_results * sizeof(*results->results);
+    if (results->results_capacity < entry->num_results) {
+        grrResult *new_results;
+
+        new_results = realloc(results->results, results_size);
+        if (!new_results) {
+            return false;
+        }
+        results->results = new_results;
+        results->results_capacity = entry->num_results;
+    }
+    if (results->text_capacity < entry->text_len + 1) {
+        char *new_text;
+
+        new_text = realloc(results->text, entry->text_len + 1);
+        if (!new_text) {
+            return false;
+        }
+        results->text = new_text;
+        results->text_capacity = entry->text_len + 1;
+    }
+
+    for (size_t k = 0; k < entry->num_results; k++) {
+        results->results[k] = (grrResult){
+            .file_line_no = cached[k].file_line_no,
+            .offset = cached[k].offset,
+            .len = cached[k].len,
+        };
+    }
+    results->num_results = entry->num_results;
+    memcpy(results->text, cache->map + entry->text_offset, entry->text_len);
+    results->text[entry->text_len] = '\0';
+    results->text_len = entry->text_len;
+
+    return true;
+}
+
+int
+grrResultCacheRecord(grrResultCache *cache, const char *path, const struct stat *file_stat,
+                     const grrResultSet *results)
+{
+    int ret = GRR_APP_RET_OUT_OF_MEMORY;
+    grrCachedFile file = {0};
+
+    file.path = strdup(path + cache->root_len);
+    file.results = malloc(MAX(results->num_results, 1) * sizeof(*file.results));
+    file.text = malloc(MAX(results->text_len, 1));
+    if (!file.path || !file.results || !file.text) {
+        goto error;
+    }
+
+    for (size_t k = 0; k < results->num_results; k++) {
+        file.results[k] = (grrCachedResult){
+            .file_line_no = results->results[k].file_line_no,
+            .offset = results->results[k].offset,
+            .len = results->results[k].len,
+        };
+    }
+    if (results->text_len > 0) {
+        memcpy(file.text, results->text, results->text_len);
+    }
+    file.entry = (grrResultCacheEntry){
+        .num_results = results->num_results,
+        .text_len = results->text_len,
+        .inode = file_stat->st_ino,
+        .size = file_stat->st_size,
+        .mtime_sec = file_stat->st_mtim.tv_sec,
+        .mtime_nsec = file_stat->st_mtim.tv_nsec,
+        .ctime_sec = file_stat->st_ctim.tv_sec,
+        .ctime_nsec = file_stat->st_ctim.tv_nsec,
+    };
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->num_files == cache->files_capacity) {
+        size_t new_capacity = cache->files_capacity ? 2 * cache->files_capacity : 64;
+        grrCachedFile *new_files;
+
+        new_files = realloc(cache->files, new_capacity * sizeof(*new_files));
+        if (!new_files) {
+            pthread_mutex_unlock(&cache->lock);
+            goto error;
+        }
+        cache->files = new_files;
+        cache->files_capacity = new_capacity;
+    }
+    cache->files[cache->num_files++] = file;
+    pthread_mutex_unlock(&cache->lock);
+
+    return GRR_APP_RET_OK;
+
+error:
+
+    free(file.path);
+    free(file.results);
+    free(file.text);
+    return ret;
+}
+
+int
+grrResultCacheClose(grrResultCache *cache)
+{
+    int fd, ret;
+    uint64_t results_offset, text_offset, path_offset;
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    grrResultCacheHeader header = {.num_files = cache->num_files};
+    grrOutput output;
+    static const char padding[8] = {0};
+
+    ret = cachePath(GRR_RESULT_CACHE_PREFIX, cache->key, cache->key_len, path, sizeof(path), true);
+    if (ret != GRR_APP_RET_OK) {
+        goto done;
+    }
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path)) {
+        ret = GRR_APP_RET_OVERFLOW;
+        goto done;
+    }
+
+    qsort(cache->files, cache->num_files, sizeof(*cache->files), compareCachedFiles);
+
+    results_offset = ALIGN8(sizeof(header) + cache->key_len) + cache->num_files * sizeof(grrResultCacheEntry);
+    text_offset = results_offset;
+    for (size_t k = 0; k < cache->num_files; k++) {
+        text_offset += cache->files[k].entry.num_results * sizeof(grrCachedResult);
+    }
+    path_offset = text_offset;
+    for (size_t k = 0; k < cache->num_files; k++) {
+        path_offset += cache->files[k].entry.text_len;
+    }
+
+    // Concurrent invocations could be reading the old file so it's replaced rather than overwritten.
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto done;
+    }
+    ret = grrOutputInit(&output, fd);
+    if (ret != GRR_APP_RET_OK) {
+        close(fd);
+        unlink(tmp_path);
+        goto done;
+    }
+
+    memcpy(header.magic, GRR_RESULT_CACHE_MAGIC, sizeof(header.magic));
+    header.key_len = cache->key_len;
+    grrOutputWrite(&output, (const char *)&header, sizeof(header));
+    grrOutputWrite(&output, cache->key, cache->key_len);
+    grrOutputWrite(&output, padding, ALIGN8(cache->key_len) - cache->key_len);
+
+    for (size_t k = 0; k < cache->num_files; k++) {
+        grrResultCacheEntry *entry = &cache->files[k].entry;
+
+        entry->results_offset = results_offset;
+        entry->text_offset = text_offset;
+        entry->path_offset = path_offset;
+        grrOutputWrite(&output, (const char *)entry, sizeof(*entry));
+
+        results_offset += entry->num_results * sizeof(grrCachedResult);
+        text_offset += entry->text_len;
+        path_offset += strlen(cache->files[k].path) + 1;
+    }
+    for (size_t k = 0; k < cache->num_files; k++) {
+        grrOutputWrite(&output, (const char *)cache->files[k].results,
+                       cache->files[k].entry.num_results * sizeof(grrCachedResult));
+    }
+    for (size_t k = 0; k < cache->num_files; k++) {
+        grrOutputWrite(&output, cache->files[k].text, cache->files[k].entry.text_len);
+    }
+    for (size_t k = 0; k < cache->num_files; k++) {
+        grrOutputString(&output, cache->files[k].path);
+        grrOutputWrite(&output, "", 1);
+    }
+    // The file always ends with a null byte, even without any entries, so that every path is terminated.
+    grrOutputWrite(&output, "", 1);
+
+    ret = grrOutputClose(&output);
+    close(fd);
+    if (ret == GRR_APP_RET_OK && rename(tmp_path, path) != 0) {
+        ret = GRR_APP_RET_FILE_ACCESS;
+    }
+    if (ret != GRR_APP_RET_OK) {
+        unlink(tmp_path);
+    }
+
+done:
+
+    for (size_t k = 0; k < cache->num_files; k++) {
+        free(cache->files[k].path);
+        free(cache->files[k].results);
+        free(cache->files[k].text);
+    }
+    free(cache->files);
+    if (cache->map) {
+        munmap((void *)cache->map, cache->map_len);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->key);
+    free(cache);
+
+    return ret;
+}
+
+int
+grrCacheSocketPath(const char *directory, char *path, size_t size, bool create)
+{
+    return cachePath(GRR_SOCKET_PREFIX, directory, strlen(directory), path, size, create);
+}
+
+/*
+ * The key starts with Grr's version and the prefix (if any).  Every regex follows, each terminated by a null
+ * byte.
+ */
+static char *
+makeKey(const char *prefix, size_t prefix_len, const char *const *regexes, size_t num_regexes, size_t *len)
+{
+    size_t key_len = sizeof(GRR_VERSION) + prefix_len;
+    char *key, *cursor;
+
+    for (size_t k = 0; k < num_regexes; k++) {
+        key_len += strlen(regexes[k]) + 1;
+    }
+
+    key = malloc(key_len);
+    if (!key) {
+        return NULL;
+    }
+
+    memcpy(key, GRR_VERSION, sizeof(GRR_VERSION));
+    cursor = key + sizeof(GRR_VERSION);
+    if (prefix_len > 0) {
+        memcpy(cursor, prefix, prefix_len);
+        cursor += prefix_len;
+    }
+    for (size_t k = 0; k < num_regexes; k++) {
+        size_t regex_len = strlen(regexes[k]) + 1;
+
+        memcpy(cursor, regexes[k], regex_len);
+        cursor += regex_len;
+    }
+
+    *len = key_len;
+    return key;
+}
+
+/*
+ * The file is named after the FNV-1a hash of the key.  If create is true, the cache directory is created if it
+ * doesn't exist yet.
+ */
+static int
+cachePath(const char *name_prefix, const char *key, size_t key_len, char *path, size_t size, bool create)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const char *home;
+
+    home = getenv("HOME");
+    if (!home) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    if (snprintf(path, size, "%s/%s", home, GRR_CACHE) >= (int)size) {
+        return GRR_APP_RET_OVERFLOW;
+    }
+    if (create && mkdir(path, S_IRWXU) != 0 && errno != EEXIST) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    for (size_t k = 0; k < key_len; k++) {
+        hash = (hash ^ (unsigned char)key[k]) * 1099511628211ull;
+    }
+    if (snprintf(path, size, "%s/%s/%s%016llx", home, GRR_CACHE, name_prefix, (unsigned long long)hash) >=
+        (int)size) {
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+static int
+mapResultCache(grrResultCache *cache)
+{
+    int fd;
+    char path[PATH_MAX];
+    char *map;
+    const grrResultCacheHeader *header;
+    uint64_t entries_offset;
+    struct stat file_stat;
+
+    if (cachePath(GRR_RESULT_CACHE_PREFIX, cache->key, cache->key_len, path, sizeof(path), false) !=
+        GRR_APP_RET_OK) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(*header) + 1) {
+        close(fd);
+        return GRR_APP_RET_BAD_DATA;
+    }
+    map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+    cache->map = map;
+    cache->map_len = file_stat.st_size;
+
+    header = (const grrResultCacheHeader *)map;
+    entries_offset = ALIGN8(sizeof(*header) + cache->key_len);
+    if (memcmp(header->magic, GRR_RESULT_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->key_len != cache->key_len || entries_offset > cache->map_len ||
+        memcmp(header + 1, cache->key, cache->key_len) != 0 ||
+        header->num_files > (cache->map_len - entries_offset) / sizeof(grrResultCacheEntry) ||
+        map[cache->map_len - 1] != '\0') {
+        goto error;
+    }
+    cache->entries = (const grrResultCacheEntry *)(map + entries_offset);
+    cache->num_entries = header->num_files;
+
+    for (size_t k = 0; k < cache->num_entries; k++) {
+        const grrResultCacheEntry *entry = cache->entries + k;
+        const grrCachedResult *results;
+
+        if (entry->path_offset >= cache->map_len || entry->results_offset > cache->map_len ||
+            entry->results_offset % sizeof(uint64_t) != 0 ||
+            entry->num_results > (cache->map_len - entry->results_offset) / sizeof(grrCachedResult) ||
+            entry->text_offset > cache->map_len || entry->text_len > cache->map_len - entry->text_offset) {
+            goto error;
+        }
+
+        results = (const grrCachedResult *)(map + entry->results_offset);
+        for (size_t j = 0; j < entry->num_results; j++) {
+            if (results[j].offset > entry->text_len || results[j].len > entry->text_len - results[j].offset) {
+                goto error;
+            }
+        }
+    }
+
+    return GRR_APP_RET_OK;
+
+error:
+
+    munmap(map, cache->map_len);
+    cache->map = NULL;
+    return GRR_APP_RET_BAD_DATA;
+}
+
+static const grrResultCacheEntry *
+findResultEntry(const grrResultCache *cache, const char *path)
+{
+    size_t low = 0, high = cache->num_entries;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int comparison;
+
+        comparison = strcmp(path, cache->map + cache->entries[middle].path_offset);
+        if (comparison == 0) {
+            return cache->entries + middle;
+        }
+        if (comparison < 0) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+entryIsCurrent(const grrResultCacheEntry *entry, const struct stat *file_stat)
+{
+    return entry->inode == (uint64_t)file_stat->st_ino && entry->size == (int64_t)file_stat->st_size &&
+           entry->mtime_sec == (int64_t)file_stat->st_mtim.tv_sec &&
+           entry->mtime_nsec == (int64_t)file_stat->st_mtim.tv_nsec &&
+           entry->ctime_sec == (int64_t)file_stat->st_ctim.tv_sec &&
+           entry->ctime_nsec == (int64_t)file_stat->st_ctim.tv_nsec;
+}
+
+static int
+compareCachedFiles(const void *item1, const void *item2)
+{
+    const grrCachedFile *file1 = item1, *file2 = item2;
+
+    return strcmp(file1->path, file2->path);
+}
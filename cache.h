@@ -0,0 +1,72 @@
+#ifndef GRR_CACHE_H
+#define GRR_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "dfa.h"
+
+/*
+ * The name of the directory, within the HOME directory, in which compiled programs and search results are
+ * cached.  Each file in it holds either the program for one set of regexes or the results of one query.  The
+ * directory can be deleted at any time.
+ */
+#define GRR_CACHE ".grr_cache"
+
+/*
+ * Looks up the program compiled from a set of regexes.  The file is memory-mapped rather than read.  If the
+ * regexes were found to be unsuitable for the DFA when they were stored, *program is set to NULL.  Returns
+ * GRR_APP_RET_NOT_FOUND if there is no usable entry.
+ */
+int
+grrCacheLoadProgram(const char *const *regexes, size_t num_regexes, grrProgram **program);
+
+/*
+ * Stores the program compiled from a set of regexes.  The program can be NULL to record that the regexes can't
+ * be run as a DFA.
+ */
+int
+grrCacheStoreProgram(const char *const *regexes, size_t num_regexes, const grrProgram *program);
+
+/*
+ * A cache of the results found in each file by a particular query (i.e., the regexes, the starting directory,
+ * and the options which affect how results are formatted).  A file whose inode, size, and modification and
+ * change times are the same as when its results were cached isn't read again.  The new cache file, which holds
+ * only the files visited by the current invocation, is written when the cache is closed.  grrResultCacheRecord
+ * may be called from several threads at once.
+ */
+typedef struct grrResultCache grrResultCache;
+
+struct grrOptions;
+struct grrResultSet;
+
+int
+grrResultCacheOpen(const struct grrOptions *options, grrResultCache **cache);
+
+/*
+ * Fills in the results for a file if they're cached and still current.  The path has to begin with the
+ * starting directory.
+ */
+bool
+grrResultCacheLookup(const grrResultCache *cache, const char *path, const struct stat *file_stat,
+                     struct grrResultSet *results);
+
+int
+grrResultCacheRecord(grrResultCache *cache, const char *path, const struct stat *file_stat,
+                     const struct grrResultSet *results);
+
+/*
+ * Writes out the new cache file and frees the cache.
+ */
+int
+grrResultCacheClose(grrResultCache *cache);
+
+/*
+ * Determines the path of the Unix socket on which the server for a directory (which has to be an absolute path)
+ * listens.
+ */
+int
+grrCacheSocketPath(const char *directory, char *path, size_t size, bool create);
+
+#endif  // GRR_CACHE_H
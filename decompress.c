@@ -0,0 +1,532 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef GRR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GRR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef GRR_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#include "decompress.h"
+#include "grr.h"
+
+/*
+ * The blocks form a ring.  The thread fills the block at (head + count) and the reader drains the one at head.
+ * Neither touches the other's block so the lock only protects head, count, and the flags.
+ */
+struct grrDecompressor {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char *blocks[GRR_DECOMPRESS_BLOCKS];
+    size_t lens[GRR_DECOMPRESS_BLOCKS];
+    unsigned int head;
+    unsigned int count;
+    size_t offset;
+    const char *input;
+    size_t input_len;
+    char *input_copy;
+    char *read_buffer;
+    int fd;
+    int compression;
+    int status;
+    bool finished;
+    bool cancelled;
+};
+
+static void *
+decompressThread(void *arg);
+
+static int
+nextInput(grrDecompressor *decompressor, const char **data, size_t *len);
+
+static char *
+acquireBlock(grrDecompressor *decompressor);
+
+static void
+publishBlock(grrDecompressor *decompressor, size_t len);
+
+#ifdef GRR_HAVE_ZLIB
+static int
+inflateFile(grrDecompressor *decompressor);
+#endif
+
+#ifdef GRR_HAVE_ZSTD
+static int
+unzstdFile(grrDecompressor *decompressor);
+#endif
+
+#ifdef GRR_HAVE_LZMA
+static int
+unxzFile(grrDecompressor *decompressor);
+#endif
+
+int
+grrDetectCompression(const char *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+#ifdef GRR_HAVE_ZLIB
+    if (len >= 3 && bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 0x08) {
+        return GRR_COMPRESSION_GZIP;
+    }
+#endif
+#ifdef GRR_HAVE_ZSTD
+    if (len >= 4 && memcmp(bytes, "\x28\xb5\x2f\xfd", 4) == 0) {
+        return GRR_COMPRESSION_ZSTD;
+    }
+#endif
+#ifdef GRR_HAVE_LZMA
+    if (len >= 6 && memcmp(bytes, "\xfd" "7zXZ\x00", 6) == 0) {
+        return GRR_COMPRESSION_XZ;
+    }
+#endif
+
+    (void)bytes;
+    (void)len;
+    return GRR_COMPRESSION_NONE;
+}
+
+int
+grrDecompressorStart(int compression, const char *input, size_t input_len, bool borrow_input, int fd,
+                     grrDecompressor **decompressor)
+{
+    grrDecompressor *new_decompressor;
+
+    new_decompressor = calloc(1, sizeof(*new_decompressor));
+    if (!new_decompressor) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    new_decompressor->compression = compression;
+    new_decompressor->fd = fd;
+
+    for (unsigned int k = 0; k < GRR_DECOMPRESS_BLOCKS; k++) {
+        new_decompressor->blocks[k] = malloc(GRR_DECOMPRESS_BLOCK_SIZE);
+        if (!new_decompressor->blocks[k]) {
+            goto error;
+        }
+    }
+
+    if (borrow_input) {
+        new_decompressor->input = input;
+    }
+    else if (input_len > 0) {
+        new_decompressor->input_copy = malloc(input_len);
+        if (!new_decompressor->input_copy) {
+            goto error;
+        }
+        memcpy(new_decompressor->input_copy, input, input_len);
+        new_decompressor->input = new_decompressor->input_copy;
+    }
+    new_decompressor->input_len = input_len;
+
+    if (fd != -1) {
+        new_decompressor->read_buffer = malloc(GRR_READ_BLOCK_SIZE);
+        if (!new_decompressor->read_buffer) {
+            goto error;
+        }
+    }
+
+    pthread_mutex_init(&new_decompressor->lock, NULL);
+    pthread_cond_init(&new_decompressor->cond, NULL);
+    if (pthread_create(&new_decompressor->thread, NULL, decompressThread, new_decompressor) != 0) {
+        pthread_cond_destroy(&new_decompressor->cond);
+        pthread_mutex_destroy(&new_decompressor->lock);
+        goto error;
+    }
+
+    *decompressor = new_decompressor;
+    return GRR_APP_RET_OK;
+
+error:
+
+    for (unsigned int k = 0; k < GRR_DECOMPRESS_BLOCKS; k++) {
+        free(new_decompressor->blocks[k]);
+    }
+    free(new_decompressor->input_copy);
+    free(new_decompressor->read_buffer);
+    free(new_decompressor);
+    return GRR_APP_RET_OUT_OF_MEMORY;
+}
+
+int
+grrDecompressorRead(grrDecompressor *decompressor, char *buffer, size_t size, size_t *num_read)
+{
+    int ret;
+    size_t len;
+    const char *block;
+
+    pthread_mutex_lock(&decompressor->lock);
+    while (decompressor->count == 0 && !decompressor->finished) {
+        pthread_cond_wait(&decompressor->cond, &decompressor->lock);
+    }
+    if (decompressor->count == 0) {
+        ret = decompressor->status;
+        pthread_mutex_unlock(&decompressor->lock);
+        *num_read = 0;
+        return ret;
+    }
+    block = decompressor->blocks[decompressor->head];
+    len = MIN(size, decompressor->lens[decompressor->head] - decompressor->offset);
+    pthread_mutex_unlock(&decompressor->lock);
+
+    // The thread never writes to a published block so it can be copied without holding the lock.
+    memcpy(buffer, block + decompressor->offset, len);
+    decompressor->offset += len;
+
+    pthread_mutex_lock(&decompressor->lock);
+    if (decompressor->offset == decompressor->lens[decompressor->head]) {
+        decompressor->head = (decompressor->head + 1) % GRR_DECOMPRESS_BLOCKS;
+        decompressor->count--;
+        decompressor->offset = 0;
+        pthread_cond_broadcast(&decompressor->cond);
+    }
+    pthread_mutex_unlock(&decompressor->lock);
+
+    *num_read = len;
+    return GRR_APP_RET_OK;
+}
+
+void
+grrDecompressorFree(grrDecompressor *decompressor)
+{
+    if (!decompressor) {
+        return;
+    }
+
+    pthread_mutex_lock(&decompressor->lock);
+    decompressor->cancelled = true;
+    pthread_cond_broadcast(&decompressor->cond);
+    pthread_mutex_unlock(&decompressor->lock);
+    pthread_join(decompressor->thread, NULL);
+
+    pthread_cond_destroy(&decompressor->cond);
+    pthread_mutex_destroy(&decompressor->lock);
+    for (unsigned int k = 0; k < GRR_DECOMPRESS_BLOCKS; k++) {
+        free(decompressor->blocks[k]);
+    }
+    free(decompressor->input_copy);
+    free(decompressor->read_buffer);
+    free(decompressor);
+}
+
+static void *
+decompressThread(void *arg)
+{
+    int ret;
+    grrDecompressor *decompressor = arg;
+
+    switch (decompressor->compression) {
+#ifdef GRR_HAVE_ZLIB
+    case GRR_COMPRESSION_GZIP: ret = inflateFile(decompressor); break;
+#endif
+
+#ifdef GRR_HAVE_ZSTD
+    case GRR_COMPRESSION_ZSTD: ret = unzstdFile(decompressor); break;
+#endif
+
+#ifdef GRR_HAVE_LZMA
+    case GRR_COMPRESSION_XZ: ret = unxzFile(decompressor); break;
+#endif
+
+    default: ret = GRR_APP_RET_BAD_DATA; break;
+    }
+
+    pthread_mutex_lock(&decompressor->lock);
+    decompressor->status = ret;
+    decompressor->finished = true;
+    pthread_cond_broadcast(&decompressor->cond);
+    pthread_mutex_unlock(&decompressor->lock);
+
+    return NULL;
+}
+
+/*
+ * Hands out the initial input and then whatever is read from the file descriptor.  Sets *len to 0 at the end
+ * of the compressed data.
+ */
+static int
+nextInput(grrDecompressor *decompressor, const char **data, size_t *len)
+{
+    ssize_t num_read;
+
+    if (decompressor->input_len > 0) {
+        *data = decompressor->input;
+        *len = decompressor->input_len;
+        decompressor->input_len = 0;
+        return GRR_APP_RET_OK;
+    }
+
+    if (decompressor->fd == -1) {
+        *data = NULL;
+        *len = 0;
+        return GRR_APP_RET_OK;
+    }
+
+    do {
+        num_read = read(decompressor->fd, decompressor->read_buffer, GRR_READ_BLOCK_SIZE);
+    } while (num_read == -1 && errno == EINTR);
+    if (num_read == -1) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    *data = decompressor->read_buffer;
+    *len = num_read;
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Waits for a free block.  Returns NULL if the reader has gone away.
+ */
+static char *
+acquireBlock(grrDecompressor *decompressor)
+{
+    char *block = NULL;
+
+    pthread_mutex_lock(&decompressor->lock);
+    while (decompressor->count == GRR_DECOMPRESS_BLOCKS && !decompressor->cancelled) {
+        pthread_cond_wait(&decompressor->cond, &decompressor->lock);
+    }
+    if (!decompressor->cancelled) {
+        block = decompressor->blocks[(decompressor->head + decompressor->count) % GRR_DECOMPRESS_BLOCKS];
+    }
+    pthread_mutex_unlock(&decompressor->lock);
+
+    return block;
+}
+
+static void
+publishBlock(grrDecompressor *decompressor, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&decompressor->lock);
+    decompressor->lens[(decompressor->head + decompressor->count) % GRR_DECOMPRESS_BLOCKS] = len;
+    decompressor->count++;
+    pthread_cond_broadcast(&decompressor->cond);
+    pthread_mutex_unlock(&decompressor->lock);
+}
+
+#ifdef GRR_HAVE_ZLIB
+/*
+ * Handles files made up of several concatenated gzip members.  Anything after the last member which isn't
+ * another member is ignored, just as gzip does.
+ */
+static int
+inflateFile(grrDecompressor *decompressor)
+{
+    int ret = GRR_APP_RET_OK;
+    bool in_member = false;
+    unsigned int members = 0;
+    char *block;
+    z_stream stream = {0};
+
+    // 32 is added to the window bits so that zlib parses the gzip header.
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    block = acquireBlock(decompressor);
+    if (!block) {
+        goto done;
+    }
+    stream.next_out = (Bytef *)block;
+    stream.avail_out = GRR_DECOMPRESS_BLOCK_SIZE;
+
+    for (;;) {
+        int z_ret;
+
+        if (stream.avail_out == 0) {
+            publishBlock(decompressor, GRR_DECOMPRESS_BLOCK_SIZE);
+            block = acquireBlock(decompressor);
+            if (!block) {
+                goto done;
+            }
+            stream.next_out = (Bytef *)block;
+            stream.avail_out = GRR_DECOMPRESS_BLOCK_SIZE;
+        }
+
+        if (stream.avail_in == 0) {
+            const char *data;
+            size_t len;
+
+            ret = nextInput(decompressor, &data, &len);
+            if (ret != GRR_APP_RET_OK) {
+                break;
+            }
+            if (len == 0) {
+                if (in_member) {
+                    ret = GRR_APP_RET_BAD_DATA;
+                }
+                break;
+            }
+            stream.next_in = (Bytef *)data;
+            stream.avail_in = len;
+        }
+
+        in_member = true;
+        z_ret = inflate(&stream, Z_NO_FLUSH);
+        if (z_ret == Z_STREAM_END) {
+            members++;
+            in_member = false;
+            inflateReset(&stream);
+        }
+        else if (z_ret == Z_DATA_ERROR && members > 0 && stream.total_out == 0) {
+            in_member = false;
+            break;
+        }
+        else if (z_ret != Z_OK && z_ret != Z_BUF_ERROR) {
+            ret = (z_ret == Z_MEM_ERROR) ? GRR_APP_RET_OUT_OF_MEMORY : GRR_APP_RET_BAD_DATA;
+            break;
+        }
+    }
+
+    publishBlock(decompressor, GRR_DECOMPRESS_BLOCK_SIZE - stream.avail_out);
+
+done:
+
+    inflateEnd(&stream);
+    return ret;
+}
+#endif  // GRR_HAVE_ZLIB
+
+#ifdef GRR_HAVE_ZSTD
+static int
+unzstdFile(grrDecompressor *decompressor)
+{
+    int ret = GRR_APP_RET_OK;
+    size_t z_ret = 0;
+    ZSTD_DStream *stream;
+    ZSTD_inBuffer in = {0};
+    ZSTD_outBuffer out = {.size = GRR_DECOMPRESS_BLOCK_SIZE};
+
+    stream = ZSTD_createDStream();
+    if (!stream) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    ZSTD_initDStream(stream);
+
+    out.dst = acquireBlock(decompressor);
+    if (!out.dst) {
+        goto done;
+    }
+
+    for (;;) {
+        if (out.pos == out.size) {
+            publishBlock(decompressor, out.pos);
+            out.dst = acquireBlock(decompressor);
+            if (!out.dst) {
+                goto done;
+            }
+            out.pos = 0;
+        }
+
+        if (in.pos == in.size) {
+            const char *data;
+            size_t len;
+
+            ret = nextInput(decompressor, &data, &len);
+            if (ret != GRR_APP_RET_OK) {
+                break;
+            }
+            // A return value of 0 from the last call means that the final frame was complete.
+            if (len == 0) {
+                if (z_ret != 0) {
+                    ret = GRR_APP_RET_BAD_DATA;
+                }
+                break;
+            }
+            in = (ZSTD_inBuffer){.src = data, .size = len};
+        }
+
+        z_ret = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(z_ret)) {
+            ret = GRR_APP_RET_BAD_DATA;
+            break;
+        }
+    }
+
+    publishBlock(decompressor, out.pos);
+
+done:
+
+    ZSTD_freeDStream(stream);
+    return ret;
+}
+#endif  // GRR_HAVE_ZSTD
+
+#ifdef GRR_HAVE_LZMA
+static int
+unxzFile(grrDecompressor *decompressor)
+{
+    int ret = GRR_APP_RET_OK;
+    char *block;
+    lzma_action action = LZMA_RUN;
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    block = acquireBlock(decompressor);
+    if (!block) {
+        goto done;
+    }
+    stream.next_out = (uint8_t *)block;
+    stream.avail_out = GRR_DECOMPRESS_BLOCK_SIZE;
+
+    for (;;) {
+        lzma_ret lzma_ret;
+
+        if (stream.avail_out == 0) {
+            publishBlock(decompressor, GRR_DECOMPRESS_BLOCK_SIZE);
+            block = acquireBlock(decompressor);
+            if (!block) {
+                goto done;
+            }
+            stream.next_out = (uint8_t *)block;
+            stream.avail_out = GRR_DECOMPRESS_BLOCK_SIZE;
+        }
+
+        if (stream.avail_in == 0 && action == LZMA_RUN) {
+            const char *data;
+            size_t len;
+
+            ret = nextInput(decompressor, &data, &len);
+            if (ret != GRR_APP_RET_OK) {
+                break;
+            }
+            if (len == 0) {
+                action = LZMA_FINISH;
+            }
+            stream.next_in = (const uint8_t *)data;
+            stream.avail_in = len;
+        }
+
+        lzma_ret = lzma_code(&stream, action);
+        if (lzma_ret == LZMA_STREAM_END) {
+            break;
+        }
+        if (lzma_ret != LZMA_OK) {
+            ret = (lzma_ret == LZMA_MEM_ERROR) ? GRR_APP_RET_OUT_OF_MEMORY : GRR_APP_RET_BAD_DATA;
+            break;
+        }
+    }
+
+    publishBlock(decompressor, GRR_DECOMPRESS_BLOCK_SIZE - stream.avail_out);
+
+done:
+
+    lzma_end(&stream);
+    return ret;
+}
+#endif  // GRR_HAVE_LZMA
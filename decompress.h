@@ -0,0 +1,56 @@
+#ifndef GRR_DECOMPRESS_H
+#define GRR_DECOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The size of each block of decompressed data and the number of blocks which the decompressing thread may get
+ * ahead of the search.
+ */
+#define GRR_DECOMPRESS_BLOCK_SIZE (256 * 1024)
+#define GRR_DECOMPRESS_BLOCKS     4
+
+enum grrCompression {
+    GRR_COMPRESSION_NONE = 0,
+    GRR_COMPRESSION_GZIP,
+    GRR_COMPRESSION_ZSTD,
+    GRR_COMPRESSION_XZ,
+};
+
+/*
+ * Decompresses a file on its own thread so that decompression overlaps with the search.  The thread fills a
+ * small ring of blocks and waits whenever the reader falls behind.
+ */
+typedef struct grrDecompressor grrDecompressor;
+
+/*
+ * Identifies the compression format from a file's first bytes.  Returns GRR_COMPRESSION_NONE if the format is
+ * unknown or if Grr was built without support for it.
+ */
+int
+grrDetectCompression(const char *data, size_t len);
+
+/*
+ * Starts decompressing a file.  The compressed data consists of the given input followed by whatever can
+ * still be read from fd (if it isn't -1).  The input is copied unless borrow_input is set, in which case it
+ * has to remain valid until the decompressor is freed.  The file descriptor isn't closed by the decompressor.
+ */
+int
+grrDecompressorStart(int compression, const char *input, size_t input_len, bool borrow_input, int fd,
+                     grrDecompressor **decompressor);
+
+/*
+ * Copies up to size bytes of decompressed data into buffer, waiting for the thread if none is ready.  Sets
+ * *num_read to 0 at the end of the data.  Returns GRR_APP_RET_BAD_DATA if the data is corrupt.
+ */
+int
+grrDecompressorRead(grrDecompressor *decompressor, char *buffer, size_t size, size_t *num_read);
+
+/*
+ * Stops the thread (if it's still running) and frees the decompressor.
+ */
+void
+grrDecompressorFree(grrDecompressor *decompressor);
+
+#endif  // GRR_DECOMPRESS_H
@@ -0,0 +1,1194 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "dfa.h"
+#include "grr.h"
+
+#define GRR_PROGRAM_MAX_INSTRUCTIONS 65536
+#define GRR_PARSER_MAX_DEPTH 1000
+#define GRR_NO_NODE UINT32_MAX
+
+// Values in the transition table which aren't state IDs.
+#define GRR_DFA_UNKNOWN   (-1)
+#define GRR_DFA_ESCALATE  (-2)
+#define GRR_DFA_GIVE_UP   (-3)
+
+#define GRR_DFA_FLAG_ACCEPTING        0x01
+#define GRR_DFA_FLAG_DEAD             0x02
+#define GRR_DFA_FLAG_ACCEPTING_AT_END 0x04
+
+// Every program starts with its two match instructions.
+#define GRR_MATCH_INSTRUCTION     0
+#define GRR_MATCH_END_INSTRUCTION 1
+
+// If the cache gets flushed this many times without having been reused much in between, give up.
+#define GRR_DFA_MAX_THRASHES 4
+
+enum grrInstructionType {
+    GRR_INST_MATCH = 0,
+    GRR_INST_MATCH_END,
+    GRR_INST_SET,
+    GRR_INST_SPLIT,
+    GRR_INST_EMPTY,
+};
+
+typedef struct grrInstruction {
+    uint32_t type;
+    uint32_t set;
+    uint32_t next;
+    uint32_t alt;
+} grrInstruction;
+
+typedef struct grrByteSet {
+    uint64_t bits[4];
+} grrByteSet;
+
+struct grrProgram {
+    grrInstruction *instructions;
+    grrByteSet *sets;
+    void *map;
+    size_t map_len;
+    uint32_t num_instructions;
+    uint32_t num_sets;
+    uint32_t start;
+    uint32_t num_classes;
+    uint8_t byte_classes[256];
+    uint8_t class_representatives[256];
+    uint8_t escalating_classes[256];
+};
+
+/*
+ * A serialized program consists of this header followed by the instructions and then the sets.
+ */
+typedef struct grrProgramHeader {
+    uint32_t num_instructions;
+    uint32_t num_sets;
+    uint32_t start;
+    uint32_t num_classes;
+    uint8_t byte_classes[256];
+    uint8_t class_representatives[256];
+    uint8_t escalating_classes[256];
+} grrProgramHeader;
+
+enum grrNodeType {
+    GRR_NODE_EMPTY,
+    GRR_NODE_SET,
+    GRR_NODE_CONCAT,
+    GRR_NODE_ALTERNATE,
+    GRR_NODE_STAR,
+    GRR_NODE_PLUS,
+    GRR_NODE_QUESTION,
+};
+
+typedef struct grrNode {
+    uint32_t type;
+    uint32_t left;
+    uint32_t right;
+    uint32_t set;
+} grrNode;
+
+typedef struct grrParser {
+    const char *cursor;
+    const char *end;
+    grrNode *nodes;
+    size_t num_nodes;
+    size_t nodes_capacity;
+    grrProgram *program;
+    size_t sets_capacity;
+    size_t instructions_capacity;
+    uint32_t any_set;
+    unsigned int depth;
+    int error;
+} grrParser;
+
+struct grrDfa {
+    const grrProgram *program;
+    int32_t *transitions;
+    uint8_t *flags;
+    uint32_t *set_offsets;
+    uint32_t *set_lengths;
+    uint32_t *set_pool;
+    uint32_t *hash_table;
+    uint32_t *marks;
+    uint32_t *stack;
+    uint32_t *scratch;
+    uint32_t *scratch_copy;
+    size_t pool_len;
+    size_t pool_capacity;
+    size_t hash_capacity;
+    size_t bytes_since_flush;
+    uint32_t num_states;
+    uint32_t max_states;
+    uint32_t generation;
+    int32_t start_state;
+    uint32_t flushes;
+    unsigned int thrashes;
+};
+
+static uint32_t
+compileRegex(grrParser *parser, const char *regex);
+
+static uint32_t
+parseAlternation(grrParser *parser);
+
+static uint32_t
+parseConcatenation(grrParser *parser);
+
+static uint32_t
+parseRepetition(grrParser *parser);
+
+static uint32_t
+parseAtom(grrParser *parser);
+
+static uint32_t
+parseClass(grrParser *parser);
+
+static uint32_t
+newNode(grrParser *parser, uint32_t type, uint32_t left, uint32_t right);
+
+static uint32_t
+newSetNode(grrParser *parser, const grrByteSet *set);
+
+static uint32_t
+addSet(grrParser *parser, const grrByteSet *set);
+
+static uint32_t
+compileNode(grrParser *parser, uint32_t node, uint32_t next);
+
+static uint32_t
+emitInstruction(grrParser *parser, uint32_t type, uint32_t set, uint32_t next, uint32_t alt);
+
+static void
+computeByteClasses(grrProgram *program);
+
+static int32_t
+computeTransition(grrDfa *dfa, int32_t from, uint32_t class);
+
+static int32_t
+computeStartState(grrDfa *dfa);
+
+static bool
+validateProgram(const grrProgram *program);
+
+static bool
+onlyCarriageReturns(const char *cursor, const char *end);
+
+static void
+addClosure(grrDfa *dfa, uint32_t instruction, uint32_t *set, uint32_t *len);
+
+static int32_t
+findOrAddState(grrDfa *dfa, uint32_t *set, uint32_t len);
+
+static void
+flushCache(grrDfa *dfa);
+
+static inline bool
+setContains(const grrByteSet *set, uint8_t c)
+{
+    return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline void
+setAdd(grrByteSet *set, uint8_t c)
+{
+    set->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+static inline bool
+maybeNonPrintable(uint8_t c)
+{
+    return (c < 0x20 && c != '\t') || c >= 0x7f;
+}
+
+int
+grrCompileProgram(const char *const *regexes, size_t num_regexes, grrProgram **program)
+{
+    uint32_t start = GRR_NO_NODE;
+    grrParser parser = {.any_set = GRR_NO_NODE};
+
+    if (num_regexes == 0) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    parser.program = calloc(1, sizeof(*parser.program));
+    if (!parser.program) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    emitInstruction(&parser, GRR_INST_MATCH, 0, 0, 0);
+    emitInstruction(&parser, GRR_INST_MATCH_END, 0, 0, 0);
+
+    // The regexes are alternatives of each other so that the DFA accepts a line if any of them could match it.
+    for (size_t k = 0; k < num_regexes && parser.error == GRR_APP_RET_OK; k++) {
+        uint32_t entry;
+
+        entry = compileRegex(&parser, regexes[k]);
+        start = (start == GRR_NO_NODE) ? entry : emitInstruction(&parser, GRR_INST_SPLIT, 0, entry, start);
+    }
+    if (parser.error != GRR_APP_RET_OK) {
+        goto error;
+    }
+    parser.program->start = start;
+
+    computeByteClasses(parser.program);
+
+    free(parser.nodes);
+    *program = parser.program;
+    return GRR_APP_RET_OK;
+
+error:
+
+    free(parser.nodes);
+    grrFreeProgram(parser.program);
+    return parser.error;
+}
+
+void
+grrFreeProgram(grrProgram *program)
+{
+    if (program) {
+        if (program->map) {
+            munmap(program->map, program->map_len);
+        }
+        else {
+            free(program->instructions);
+            free(program->sets);
+        }
+        free(program);
+    }
+}
+
+size_t
+grrProgramSize(const grrProgram *program)
+{
+    return sizeof(grrProgramHeader) + program->num_instructions * sizeof(grrInstruction) +
+           program->num_sets * sizeof(grrByteSet);
+}
+
+void
+grrProgramSerialize(const grrProgram *program, void *buffer)
+{
+    grrProgramHeader *header = buffer;
+    grrInstruction *instructions = (grrInstruction *)(header + 1);
+
+    *header = (grrProgramHeader){
+        .num_instructions = program->num_instructions,
+        .num_sets = program->num_sets,
+        .start = program->start,
+        .num_classes = program->num_classes,
+    };
+    memcpy(header->byte_classes, program->byte_classes, sizeof(header->byte_classes));
+    memcpy(header->class_representatives, program->class_representatives,
+           sizeof(header->class_representatives));
+    memcpy(header->escalating_classes, program->escalating_classes, sizeof(header->escalating_classes));
+
+    memcpy(instructions, program->instructions, program->num_instructions * sizeof(*instructions));
+    memcpy(instructions + program->num_instructions, program->sets, program->num_sets * sizeof(grrByteSet));
+}
+
+int
+grrProgramMap(void *map, size_t map_len, size_t offset, grrProgram **program)
+{
+    const grrProgramHeader *header = (const grrProgramHeader *)((char *)map + offset);
+    size_t available;
+    grrProgram *new_program;
+
+    if (offset % sizeof(uint64_t) != 0 || offset > map_len || map_len - offset < sizeof(*header)) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+    available = map_len - offset - sizeof(*header);
+    if (header->num_instructions > GRR_PROGRAM_MAX_INSTRUCTIONS ||
+        header->num_sets > GRR_PROGRAM_MAX_INSTRUCTIONS ||
+        available != header->num_instructions * sizeof(grrInstruction) + header->num_sets * sizeof(grrByteSet)) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+
+    new_program = calloc(1, sizeof(*new_program));
+    if (!new_program) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    new_program->num_instructions = header->num_instructions;
+    new_program->num_sets = header->num_sets;
+    new_program->start = header->start;
+    new_program->num_classes = header->num_classes;
+    memcpy(new_program->byte_classes, header->byte_classes, sizeof(new_program->byte_classes));
+    memcpy(new_program->class_representatives, header->class_representatives,
+           sizeof(new_program->class_representatives));
+    memcpy(new_program->escalating_classes, header->escalating_classes,
+           sizeof(new_program->escalating_classes));
+    new_program->instructions = (grrInstruction *)(header + 1);
+    new_program->sets = (grrByteSet *)(new_program->instructions + header->num_instructions);
+
+    if (!validateProgram(new_program)) {
+        free(new_program);
+        return GRR_APP_RET_BAD_DATA;
+    }
+
+    new_program->map = map;
+    new_program->map_len = map_len;
+    *program = new_program;
+    return GRR_APP_RET_OK;
+}
+
+int
+grrDfaCreate(const grrProgram *program, grrDfa **dfa)
+{
+    grrDfa *new_dfa;
+    size_t row_size;
+
+    new_dfa = calloc(1, sizeof(*new_dfa));
+    if (!new_dfa) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    new_dfa->program = program;
+
+    row_size = program->num_classes * sizeof(*new_dfa->transitions) + sizeof(*new_dfa->flags) +
+               2 * sizeof(*new_dfa->set_offsets) + 2 * sizeof(*new_dfa->hash_table);
+    new_dfa->max_states = GRR_DFA_CACHE_SIZE / row_size;
+    if (new_dfa->max_states < 16) {
+        new_dfa->max_states = 16;
+    }
+    new_dfa->hash_capacity = 1;
+    while (new_dfa->hash_capacity < 2 * (size_t)new_dfa->max_states) {
+        new_dfa->hash_capacity *= 2;
+    }
+    new_dfa->pool_capacity = 16 * (size_t)new_dfa->max_states;
+    if (new_dfa->pool_capacity < 4 * (size_t)program->num_instructions) {
+        new_dfa->pool_capacity = 4 * (size_t)program->num_instructions;
+    }
+
+    new_dfa->transitions =
+        malloc((size_t)new_dfa->max_states * program->num_classes * sizeof(*new_dfa->transitions));
+    new_dfa->flags = malloc(new_dfa->max_states * sizeof(*new_dfa->flags));
+    new_dfa->set_offsets = malloc(new_dfa->max_states * sizeof(*new_dfa->set_offsets));
+    new_dfa->set_lengths = malloc(new_dfa->max_states * sizeof(*new_dfa->set_lengths));
+    new_dfa->set_pool = malloc(new_dfa->pool_capacity * sizeof(*new_dfa->set_pool));
+    new_dfa->hash_table = calloc(new_dfa->hash_capacity, sizeof(*new_dfa->hash_table));
+    new_dfa->marks = calloc(program->num_instructions, sizeof(*new_dfa->marks));
+    new_dfa->stack = malloc((2 * program->num_instructions + 1) * sizeof(*new_dfa->stack));
+    new_dfa->scratch = malloc(program->num_instructions * sizeof(*new_dfa->scratch));
+    new_dfa->scratch_copy = malloc(program->num_instructions * sizeof(*new_dfa->scratch_copy));
+    if (!new_dfa->transitions || !new_dfa->flags || !new_dfa->set_offsets || !new_dfa->set_lengths ||
+        !new_dfa->set_pool || !new_dfa->hash_table || !new_dfa->marks || !new_dfa->stack ||
+        !new_dfa->scratch || !new_dfa->scratch_copy) {
+        grrDfaFree(new_dfa);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    new_dfa->start_state = computeStartState(new_dfa);
+    if (new_dfa->start_state < 0) {
+        grrDfaFree(new_dfa);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    *dfa = new_dfa;
+    return GRR_APP_RET_OK;
+}
+
+void
+grrDfaFree(grrDfa *dfa)
+{
+    if (dfa) {
+        free(dfa->transitions);
+        free(dfa->flags);
+        free(dfa->set_offsets);
+        free(dfa->set_lengths);
+        free(dfa->set_pool);
+        free(dfa->hash_table);
+        free(dfa->marks);
+        free(dfa->stack);
+        free(dfa->scratch);
+        free(dfa->scratch_copy);
+        free(dfa);
+    }
+}
+
+int
+grrDfaMatch(grrDfa *dfa, const char *line, size_t len)
+{
+    const grrProgram *program = dfa->program;
+    const uint8_t *byte_classes = program->byte_classes;
+    const uint32_t num_classes = program->num_classes;
+    int32_t state = dfa->start_state;
+    uint8_t flags;
+
+    dfa->bytes_since_flush += len;
+
+    flags = dfa->flags[state];
+    if (flags & GRR_DFA_FLAG_ACCEPTING) {
+        return GRR_APP_RET_OK;
+    }
+
+    for (size_t k = 0; k < len; k++) {
+        uint32_t class = byte_classes[(uint8_t)line[k]];
+        int32_t next;
+
+        next = dfa->transitions[(size_t)state * num_classes + class];
+        if (next < 0) {
+            if (next == GRR_DFA_ESCALATE) {
+                return GRR_APP_RET_OK;
+            }
+
+            next = computeTransition(dfa, state, class);
+            if (next < 0) {
+                return (next == GRR_DFA_GIVE_UP) ? GRR_APP_RET_OVERFLOW : GRR_APP_RET_OK;
+            }
+        }
+
+        state = next;
+        flags = dfa->flags[state];
+        if (flags & (GRR_DFA_FLAG_ACCEPTING | GRR_DFA_FLAG_DEAD)) {
+            return (flags & GRR_DFA_FLAG_DEAD) ? GRR_APP_RET_NOT_FOUND : GRR_APP_RET_OK;
+        }
+    }
+
+    return (flags & (GRR_DFA_FLAG_ACCEPTING | GRR_DFA_FLAG_ACCEPTING_AT_END)) ? GRR_APP_RET_OK :
+                                                                                 GRR_APP_RET_NOT_FOUND;
+}
+
+int
+grrDfaScan(grrDfa *dfa, const char *data, size_t len, size_t *line_start)
+{
+    const grrProgram *program = dfa->program;
+    const uint8_t *byte_classes = program->byte_classes;
+    const uint32_t num_classes = program->num_classes;
+    const char *cursor = data, *end = data + len, *line, *counted = data;
+    int ret = GRR_APP_RET_NOT_FOUND;
+
+    while (cursor < end) {
+        int32_t state = dfa->start_state;
+        uint8_t flags = dfa->flags[state];
+
+        line = cursor;
+        if (flags & GRR_DFA_FLAG_ACCEPTING) {
+            goto found;
+        }
+
+        for (; cursor < end && *cursor != '\n'; cursor++) {
+            uint32_t class = byte_classes[(uint8_t)*cursor];
+            int32_t next;
+
+            next = dfa->transitions[(size_t)state * num_classes + class];
+            if (next < 0) {
+                if (next != GRR_DFA_ESCALATE) {
+                    dfa->bytes_since_flush += cursor - counted;
+                    counted = cursor;
+                    next = computeTransition(dfa, state, class);
+                    if (next == GRR_DFA_GIVE_UP) {
+                        ret = GRR_APP_RET_OVERFLOW;
+                        goto done;
+                    }
+                }
+                if (next < 0) {
+                    if (*cursor == '\r' && onlyCarriageReturns(cursor, end)) {
+                        cursor = memchr(cursor, '\n', end - cursor);
+                        if (!cursor) {
+                            cursor = end;
+                        }
+                        break;
+                    }
+                    goto found;
+                }
+            }
+
+            state = next;
+            flags = dfa->flags[state];
+            if (flags & GRR_DFA_FLAG_ACCEPTING) {
+                goto found;
+            }
+            if (flags & GRR_DFA_FLAG_DEAD) {
+                cursor = memchr(cursor, '\n', end - cursor);
+                if (!cursor) {
+                    cursor = end;
+                }
+                break;
+            }
+        }
+
+        if (flags & GRR_DFA_FLAG_ACCEPTING_AT_END) {
+            goto found;
+        }
+        if (cursor == end) {
+            break;
+        }
+        cursor++;
+    }
+
+    goto done;
+
+found:
+
+    *line_start = line - data;
+    ret = GRR_APP_RET_OK;
+
+done:
+
+    dfa->bytes_since_flush += cursor - counted;
+    return ret;
+}
+
+static uint32_t
+compileRegex(grrParser *parser, const char *regex)
+{
+    bool anchored_start = false, anchored_end = false;
+    size_t len;
+    uint32_t root, entry;
+
+    len = strlen(regex);
+
+    // Anchors are only understood at the very beginning and end of the regex.  Without a top-level
+    // alternation, it doesn't matter how the engine groups them.
+    if (len > 0 && regex[0] == '^') {
+        anchored_start = true;
+        regex++;
+        len--;
+    }
+    if (len > 0 && regex[len - 1] == '$') {
+        size_t num_backslashes = 0;
+
+        while (num_backslashes + 1 < len && regex[len - 2 - num_backslashes] == '\\') {
+            num_backslashes++;
+        }
+        if (num_backslashes % 2 == 0) {
+            anchored_end = true;
+            len--;
+        }
+    }
+
+    if (len == 0) {
+        parser->error = GRR_APP_RET_NOT_FOUND;
+        return GRR_NO_NODE;
+    }
+
+    parser->cursor = regex;
+    parser->end = regex + len;
+    parser->depth = 0;
+
+    root = parseAlternation(parser);
+    if (parser->error != GRR_APP_RET_OK) {
+        return GRR_NO_NODE;
+    }
+    if (parser->cursor != parser->end ||
+        ((anchored_start || anchored_end) && parser->nodes[root].type == GRR_NODE_ALTERNATE)) {
+        parser->error = GRR_APP_RET_NOT_FOUND;
+        return GRR_NO_NODE;
+    }
+
+    entry = compileNode(parser, root, anchored_end ? GRR_MATCH_END_INSTRUCTION : GRR_MATCH_INSTRUCTION);
+
+    // An unanchored regex is preceded by a loop over every byte so that a match can start anywhere.
+    if (!anchored_start) {
+        uint32_t split;
+
+        if (parser->any_set == GRR_NO_NODE) {
+            grrByteSet set;
+
+            memset(&set, 0xff, sizeof(set));
+            parser->any_set = addSet(parser, &set);
+        }
+
+        split = emitInstruction(parser, GRR_INST_SPLIT, 0, entry, 0);
+        if (split != GRR_NO_NODE) {
+            parser->program->instructions[split].alt =
+                emitInstruction(parser, GRR_INST_SET, parser->any_set, split, 0);
+        }
+        entry = split;
+    }
+
+    return entry;
+}
+
+static uint32_t
+parseAlternation(grrParser *parser)
+{
+    uint32_t left;
+
+    left = parseConcatenation(parser);
+    while (parser->error == GRR_APP_RET_OK && parser->cursor < parser->end && *parser->cursor == '|') {
+        uint32_t right;
+
+        parser->cursor++;
+        right = parseConcatenation(parser);
+        left = newNode(parser, GRR_NODE_ALTERNATE, left, right);
+    }
+
+    return left;
+}
+
+static uint32_t
+parseConcatenation(grrParser *parser)
+{
+    uint32_t node = GRR_NO_NODE;
+
+    while (parser->error == GRR_APP_RET_OK && parser->cursor < parser->end && *parser->cursor != '|' &&
+           *parser->cursor != ')') {
+        uint32_t right;
+
+        right = parseRepetition(parser);
+        node = (node == GRR_NO_NODE) ? right : newNode(parser, GRR_NODE_CONCAT, node, right);
+    }
+
+    if (node == GRR_NO_NODE) {
+        node = newNode(parser, GRR_NODE_EMPTY, 0, 0);
+    }
+
+    return node;
+}
+
+static uint32_t
+parseRepetition(grrParser *parser)
+{
+    uint32_t node;
+
+    node = parseAtom(parser);
+    while (parser->error == GRR_APP_RET_OK && parser->cursor < parser->end) {
+        switch (*parser->cursor) {
+        case '*': node = newNode(parser, GRR_NODE_STAR, node, 0); break;
+        case '+': node = newNode(parser, GRR_NODE_PLUS, node, 0); break;
+        case '?': node = newNode(parser, GRR_NODE_QUESTION, node, 0); break;
+        case '{': parser->error = GRR_APP_RET_NOT_FOUND; return GRR_NO_NODE;
+        default: return node;
+        }
+        parser->cursor++;
+    }
+
+    return node;
+}
+
+static uint32_t
+parseAtom(grrParser *parser)
+{
+    uint32_t node;
+    grrByteSet set = {{0}};
+    char c = *parser->cursor++;
+
+    switch (c) {
+    case '(':
+        if (++parser->depth > GRR_PARSER_MAX_DEPTH) {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+        node = parseAlternation(parser);
+        if (parser->error != GRR_APP_RET_OK) {
+            return GRR_NO_NODE;
+        }
+        if (parser->cursor == parser->end || *parser->cursor != ')') {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+        parser->cursor++;
+        parser->depth--;
+        return node;
+
+    case '[': return parseClass(parser);
+
+    case '.':
+        for (unsigned int k = 0; k < 256; k++) {
+            if (k != '\n') {
+                setAdd(&set, k);
+            }
+        }
+        return newSetNode(parser, &set);
+
+    case '\\':
+        if (parser->cursor == parser->end || isalnum((unsigned char)*parser->cursor) ||
+            *parser->cursor == '\n') {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+        setAdd(&set, *parser->cursor++);
+        return newSetNode(parser, &set);
+
+    case '^':
+    case '$':
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case '}':
+    case ']': parser->error = GRR_APP_RET_NOT_FOUND; return GRR_NO_NODE;
+
+    default: setAdd(&set, c); return newSetNode(parser, &set);
+    }
+}
+
+static uint32_t
+parseClass(grrParser *parser)
+{
+    bool negated = false;
+    grrByteSet set = {{0}};
+
+    if (parser->cursor < parser->end && *parser->cursor == '^') {
+        negated = true;
+        parser->cursor++;
+    }
+
+    // Same as in literal.c, don't guess at what a leading ']' means.
+    if (parser->cursor < parser->end && *parser->cursor == ']') {
+        parser->error = GRR_APP_RET_NOT_FOUND;
+        return GRR_NO_NODE;
+    }
+
+    for (;;) {
+        unsigned char low, high;
+
+        if (parser->cursor == parser->end || *parser->cursor == '\\' || *parser->cursor == '[') {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+        if (*parser->cursor == ']') {
+            parser->cursor++;
+            break;
+        }
+
+        low = high = *parser->cursor++;
+        if (parser->cursor + 1 < parser->end && parser->cursor[0] == '-' && parser->cursor[1] != ']') {
+            high = parser->cursor[1];
+            if (high == '\\' || high == '[' || high < low) {
+                parser->error = GRR_APP_RET_NOT_FOUND;
+                return GRR_NO_NODE;
+            }
+            parser->cursor += 2;
+        }
+
+        for (unsigned int k = low; k <= high; k++) {
+            setAdd(&set, k);
+        }
+    }
+
+    if (negated) {
+        for (unsigned int k = 0; k < 4; k++) {
+            set.bits[k] = ~set.bits[k];
+        }
+        set.bits['\n' >> 6] &= ~((uint64_t)1 << ('\n' & 63));
+    }
+
+    return newSetNode(parser, &set);
+}
+
+static uint32_t
+newNode(grrParser *parser, uint32_t type, uint32_t left, uint32_t right)
+{
+    grrNode *node;
+
+    if (parser->error != GRR_APP_RET_OK) {
+        return GRR_NO_NODE;
+    }
+
+    if (parser->num_nodes == parser->nodes_capacity) {
+        size_t new_capacity = parser->nodes_capacity ? 2 * parser->nodes_capacity : 64;
+        grrNode *new_nodes;
+
+        if (new_capacity > GRR_PROGRAM_MAX_INSTRUCTIONS) {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+
+        new_nodes = realloc(parser->nodes, new_capacity * sizeof(*new_nodes));
+        if (!new_nodes) {
+            parser->error = GRR_APP_RET_OUT_OF_MEMORY;
+            return GRR_NO_NODE;
+        }
+        parser->nodes = new_nodes;
+        parser->nodes_capacity = new_capacity;
+    }
+
+    node = parser->nodes + parser->num_nodes;
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    node->set = 0;
+
+    return parser->num_nodes++;
+}
+
+static uint32_t
+newSetNode(grrParser *parser, const grrByteSet *set)
+{
+    uint32_t node;
+
+    node = newNode(parser, GRR_NODE_SET, 0, 0);
+    if (node == GRR_NO_NODE) {
+        return GRR_NO_NODE;
+    }
+
+    parser->nodes[node].set = addSet(parser, set);
+    return (parser->error == GRR_APP_RET_OK) ? node : GRR_NO_NODE;
+}
+
+static uint32_t
+addSet(grrParser *parser, const grrByteSet *set)
+{
+    grrProgram *program = parser->program;
+
+    if (parser->error != GRR_APP_RET_OK) {
+        return GRR_NO_NODE;
+    }
+
+    if (program->num_sets == parser->sets_capacity) {
+        size_t new_capacity = parser->sets_capacity ? 2 * parser->sets_capacity : 16;
+        grrByteSet *new_sets;
+
+        new_sets = realloc(program->sets, new_capacity * sizeof(*new_sets));
+        if (!new_sets) {
+            parser->error = GRR_APP_RET_OUT_OF_MEMORY;
+            return GRR_NO_NODE;
+        }
+        program->sets = new_sets;
+        parser->sets_capacity = new_capacity;
+    }
+
+    program->sets[program->num_sets] = *set;
+    return program->num_sets++;
+}
+
+/*
+ * The program is built back to front: each node is compiled knowing which instruction follows it, so there
+ * are no dangling pointers to patch afterward.
+ */
+static uint32_t
+compileNode(grrParser *parser, uint32_t node_index, uint32_t next)
+{
+    uint32_t split, body;
+    grrNode node = parser->nodes[node_index];
+
+    if (parser->error != GRR_APP_RET_OK) {
+        return GRR_NO_NODE;
+    }
+
+    switch (node.type) {
+    case GRR_NODE_EMPTY: return next;
+
+    case GRR_NODE_SET: return emitInstruction(parser, GRR_INST_SET, node.set, next, 0);
+
+    case GRR_NODE_CONCAT: return compileNode(parser, node.left, compileNode(parser, node.right, next));
+
+    case GRR_NODE_ALTERNATE:
+        body = compileNode(parser, node.left, next);
+        return emitInstruction(parser, GRR_INST_SPLIT, 0, body, compileNode(parser, node.right, next));
+
+    case GRR_NODE_STAR:
+    case GRR_NODE_PLUS:
+        split = emitInstruction(parser, GRR_INST_SPLIT, 0, next, next);
+        body = compileNode(parser, node.left, split);
+        if (parser->error != GRR_APP_RET_OK) {
+            return GRR_NO_NODE;
+        }
+        parser->program->instructions[split].next = body;
+        return (node.type == GRR_NODE_STAR) ? split : body;
+
+    case GRR_NODE_QUESTION:
+        return emitInstruction(parser, GRR_INST_SPLIT, 0, compileNode(parser, node.left, next), next);
+
+    default: parser->error = GRR_APP_RET_OTHER; return GRR_NO_NODE;
+    }
+}
+
+static uint32_t
+emitInstruction(grrParser *parser, uint32_t type, uint32_t set, uint32_t next, uint32_t alt)
+{
+    grrProgram *program = parser->program;
+    grrInstruction *instruction;
+
+    if (parser->error != GRR_APP_RET_OK) {
+        return GRR_NO_NODE;
+    }
+
+    if (program->num_instructions == parser->instructions_capacity) {
+        size_t new_capacity = parser->instructions_capacity ? 2 * parser->instructions_capacity : 64;
+        grrInstruction *new_instructions;
+
+        if (new_capacity > GRR_PROGRAM_MAX_INSTRUCTIONS) {
+            parser->error = GRR_APP_RET_NOT_FOUND;
+            return GRR_NO_NODE;
+        }
+
+        new_instructions = realloc(program->instructions, new_capacity * sizeof(*new_instructions));
+        if (!new_instructions) {
+            parser->error = GRR_APP_RET_OUT_OF_MEMORY;
+            return GRR_NO_NODE;
+        }
+        program->instructions = new_instructions;
+        parser->instructions_capacity = new_capacity;
+    }
+
+    instruction = program->instructions + program->num_instructions;
+    instruction->type = type;
+    instruction->set = set;
+    instruction->next = next;
+    instruction->alt = alt;
+
+    return program->num_instructions++;
+}
+
+/*
+ * Partitions the bytes into classes whose members are indistinguishable to the program.  This keeps the
+ * transition table down to one column per class instead of one per byte.
+ */
+static void
+computeByteClasses(grrProgram *program)
+{
+    uint32_t num_classes = 1;
+    uint8_t *classes = program->byte_classes;
+
+    memset(classes, 0, sizeof(program->byte_classes));
+
+    for (uint32_t k = 0; k <= program->num_sets; k++) {
+        int16_t renumbered[256][2];
+        uint32_t new_num_classes = 0;
+
+        memset(renumbered, 0xff, sizeof(renumbered));
+        for (unsigned int c = 0; c < 256; c++) {
+            bool member;
+            int16_t *slot;
+
+            // The extra iteration separates the bytes which have to be escalated to the NFA.
+            member = (k < program->num_sets) ? setContains(program->sets + k, c) : maybeNonPrintable(c);
+            slot = &renumbered[classes[c]][member];
+            if (*slot < 0) {
+                *slot = new_num_classes++;
+            }
+            classes[c] = *slot;
+        }
+        num_classes = new_num_classes;
+    }
+
+    program->num_classes = num_classes;
+    for (int c = 255; c >= 0; c--) {
+        program->class_representatives[classes[c]] = c;
+        program->escalating_classes[classes[c]] = maybeNonPrintable(c);
+    }
+}
+
+static int32_t
+computeTransition(grrDfa *dfa, int32_t from, uint32_t class)
+{
+    int32_t to;
+    uint32_t from_len, len = 0, flushes;
+    uint8_t c;
+    const grrProgram *program = dfa->program;
+
+    if (program->escalating_classes[class]) {
+        dfa->transitions[(size_t)from * program->num_classes + class] = GRR_DFA_ESCALATE;
+        return GRR_DFA_ESCALATE;
+    }
+
+    // Adding the new state could flush the cache so work from a copy of the current state's set.
+    from_len = dfa->set_lengths[from];
+    memcpy(dfa->scratch_copy, dfa->set_pool + dfa->set_offsets[from], from_len * sizeof(*dfa->scratch_copy));
+
+    c = program->class_representatives[class];
+    dfa->generation++;
+    for (uint32_t k = 0; k < from_len; k++) {
+        const grrInstruction *instruction = program->instructions + dfa->scratch_copy[k];
+
+        if (instruction->type == GRR_INST_SET && setContains(program->sets + instruction->set, c)) {
+            addClosure(dfa, instruction->next, dfa->scratch, &len);
+        }
+    }
+
+    flushes = dfa->flushes;
+    to = findOrAddState(dfa, dfa->scratch, len);
+    if (to >= 0 && dfa->flushes == flushes) {
+        dfa->transitions[(size_t)from * program->num_classes + class] = to;
+    }
+
+    return to;
+}
+
+static int32_t
+computeStartState(grrDfa *dfa)
+{
+    uint32_t len = 0;
+
+    dfa->generation++;
+    addClosure(dfa, dfa->program->start, dfa->scratch, &len);
+    return findOrAddState(dfa, dfa->scratch, len);
+}
+
+/*
+ * Determines whether the line continues with nothing but carriage returns up to its newline.
+ */
+static bool
+onlyCarriageReturns(const char *cursor, const char *end)
+{
+    for (; cursor < end && *cursor == '\r'; cursor++)
+        ;
+    return cursor == end || *cursor == '\n';
+}
+
+/*
+ * Checks that a program read from disk can't send the DFA outside of its tables.
+ */
+static bool
+validateProgram(const grrProgram *program)
+{
+    const uint32_t num_instructions = program->num_instructions;
+
+    if (num_instructions <= GRR_MATCH_END_INSTRUCTION || program->start >= num_instructions ||
+        program->instructions[GRR_MATCH_INSTRUCTION].type != GRR_INST_MATCH ||
+        program->instructions[GRR_MATCH_END_INSTRUCTION].type != GRR_INST_MATCH_END ||
+        program->num_classes == 0 || program->num_classes > 256) {
+        return false;
+    }
+
+    for (int c = 0; c < 256; c++) {
+        if (program->byte_classes[c] >= program->num_classes) {
+            return false;
+        }
+    }
+
+    for (uint32_t k = 0; k < num_instructions; k++) {
+        const grrInstruction *instruction = program->instructions + k;
+
+        switch (instruction->type) {
+        case GRR_INST_MATCH:
+        case GRR_INST_MATCH_END: break;
+
+        case GRR_INST_SET:
+            if (instruction->set >= program->num_sets || instruction->next >= num_instructions) {
+                return false;
+            }
+            break;
+
+        case GRR_INST_SPLIT:
+            if (instruction->alt >= num_instructions || instruction->next >= num_instructions) {
+                return false;
+            }
+            break;
+
+        case GRR_INST_EMPTY:
+            if (instruction->next >= num_instructions) {
+                return false;
+            }
+            break;
+
+        default: return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+addClosure(grrDfa *dfa, uint32_t instruction, uint32_t *set, uint32_t *len)
+{
+    uint32_t stack_len = 0;
+    const grrInstruction *instructions = dfa->program->instructions;
+
+    dfa->stack[stack_len++] = instruction;
+    while (stack_len > 0) {
+        uint32_t current = dfa->stack[--stack_len];
+
+        if (dfa->marks[current] == dfa->generation) {
+            continue;
+        }
+        dfa->marks[current] = dfa->generation;
+
+        switch (instructions[current].type) {
+        case GRR_INST_SPLIT:
+            dfa->stack[stack_len++] = instructions[current].alt;
+            dfa->stack[stack_len++] = instructions[current].next;
+            break;
+
+        case GRR_INST_EMPTY: dfa->stack[stack_len++] = instructions[current].next; break;
+
+        default: set[(*len)++] = current; break;
+        }
+    }
+}
+
+static int
+compareInstructions(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int32_t
+findOrAddState(grrDfa *dfa, uint32_t *set, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t slot;
+    int32_t state;
+    uint8_t flags = 0;
+    const grrProgram *program = dfa->program;
+
+    qsort(set, len, sizeof(*set), compareInstructions);
+
+    for (uint32_t k = 0; k < len; k++) {
+        hash = (hash ^ set[k]) * 16777619u;
+        if (program->instructions[set[k]].type == GRR_INST_MATCH) {
+            flags |= GRR_DFA_FLAG_ACCEPTING;
+        }
+        else if (program->instructions[set[k]].type == GRR_INST_MATCH_END) {
+            flags |= GRR_DFA_FLAG_ACCEPTING_AT_END;
+        }
+    }
+    if (len == 0) {
+        flags |= GRR_DFA_FLAG_DEAD;
+    }
+
+    for (slot = hash & (dfa->hash_capacity - 1); dfa->hash_table[slot] != 0;
+         slot = (slot + 1) & (dfa->hash_capacity - 1)) {
+        state = dfa->hash_table[slot] - 1;
+        if (dfa->set_lengths[state] == len &&
+            memcmp(dfa->set_pool + dfa->set_offsets[state], set, len * sizeof(*set)) == 0) {
+            return state;
+        }
+    }
+
+    if (dfa->num_states == dfa->max_states || dfa->pool_len + len > dfa->pool_capacity) {
+        flushCache(dfa);
+        if (dfa->thrashes >= GRR_DFA_MAX_THRASHES) {
+            return GRR_DFA_GIVE_UP;
+        }
+
+        // The start state always has to exist.  Its set might be the one we're adding, however, so rebuild
+        // it from a copy.
+        if (set != dfa->scratch_copy) {
+            memcpy(dfa->scratch_copy, set, len * sizeof(*set));
+            set = dfa->scratch_copy;
+        }
+        dfa->start_state = computeStartState(dfa);
+        if (dfa->start_state < 0) {
+            return dfa->start_state;
+        }
+        return findOrAddState(dfa, set, len);
+    }
+
+    state = dfa->num_states++;
+    dfa->set_offsets[state] = dfa->pool_len;
+    dfa->set_lengths[state] = len;
+    memcpy(dfa->set_pool + dfa->pool_len, set, len * sizeof(*set));
+    dfa->pool_len += len;
+    dfa->flags[state] = flags;
+    for (uint32_t k = 0; k < program->num_classes; k++) {
+        dfa->transitions[(size_t)state * program->num_classes + k] = GRR_DFA_UNKNOWN;
+    }
+    dfa->hash_table[slot] = state + 1;
+
+    return state;
+}
+
+static void
+flushCache(grrDfa *dfa)
+{
+    // Count a flush as thrashing if the states weren't reused for very many bytes.
+    if (dfa->bytes_since_flush < 16 * (size_t)dfa->max_states) {
+        dfa->thrashes++;
+    }
+    dfa->bytes_since_flush = 0;
+    dfa->flushes++;
+
+    dfa->num_states = 0;
+    dfa->pool_len = 0;
+    memset(dfa->hash_table, 0, dfa->hash_capacity * sizeof(*dfa->hash_table));
+}
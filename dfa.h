@@ -0,0 +1,83 @@
+#ifndef GRR_DFA_H
+#define GRR_DFA_H
+
+#include <stddef.h>
+
+/*
+ * The number of bytes which each thread's DFA may use for its state cache.  When it fills up, the cache is
+ * flushed and the states are rebuilt as they're needed.
+ */
+#define GRR_DFA_CACHE_SIZE (1024 * 1024)
+
+/*
+ * A compiled form of a regex which can be executed by the lazy DFA.  It's shared by all threads.
+ */
+typedef struct grrProgram grrProgram;
+
+/*
+ * A lazily constructed DFA.  Each DFA state stands for a set of the program's states and is only built
+ * when it's first reached.  Since the cache is modified while searching, each thread needs its own.
+ */
+typedef struct grrDfa grrDfa;
+
+/*
+ * Compiles a set of regexes into a single program which matches wherever any of them does.  Returns
+ * GRR_APP_RET_NOT_FOUND if any regex uses syntax which the DFA can't handle, in which case matching has to be
+ * left entirely to the engine's NFAs.
+ *
+ * The program accepts a superset of what GrrEngine matches: any line containing data which GrrEngine may
+ * consider non-printable is accepted so that GrrEngine gets to see it.  A line which the DFA rejects
+ * therefore cannot contain a match, but a line which it accepts still has to be confirmed by grrSearch.
+ */
+int
+grrCompileProgram(const char *const *regexes, size_t num_regexes, grrProgram **program);
+
+void
+grrFreeProgram(grrProgram *program);
+
+/*
+ * Returns the number of bytes which grrProgramSerialize will write.
+ */
+size_t
+grrProgramSize(const grrProgram *program);
+
+/*
+ * Writes a program into a buffer so that it can be stored on disk.  The buffer has to be aligned on an 8-byte
+ * boundary.
+ */
+void
+grrProgramSerialize(const grrProgram *program, void *buffer);
+
+/*
+ * Creates a program from a serialized one found at the given offset of a memory mapping.  The program's tables
+ * point directly into the mapping.  On success, the program takes ownership of the mapping and unmaps it when
+ * it's freed.  Returns GRR_APP_RET_BAD_DATA if the serialized program is malformed.
+ */
+int
+grrProgramMap(void *map, size_t map_len, size_t offset, grrProgram **program);
+
+int
+grrDfaCreate(const grrProgram *program, grrDfa **dfa);
+
+void
+grrDfaFree(grrDfa *dfa);
+
+/*
+ * Determines whether a line could contain a match.  Returns GRR_APP_RET_OK if it could, GRR_APP_RET_NOT_FOUND
+ * if it can't, and GRR_APP_RET_OVERFLOW if the state cache is thrashing so badly that the DFA should be
+ * abandoned in favor of the NFA.
+ */
+int
+grrDfaMatch(grrDfa *dfa, const char *line, size_t len);
+
+/*
+ * Runs the DFA over a buffer of newline-separated lines and stops at the first line which could contain a
+ * match, setting *line_start to its offset.  Lines which can't match are skipped without returning to the
+ * caller, and a line is abandoned as soon as the DFA reaches a dead state.  Trailing carriage returns are
+ * ignored, just as they are by the line-by-line search.  Returns GRR_APP_RET_NOT_FOUND if no line could
+ * match and GRR_APP_RET_OVERFLOW if the state cache is thrashing.
+ */
+int
+grrDfaScan(grrDfa *dfa, const char *data, size_t len, size_t *line_start);
+
+#endif  // GRR_DFA_H
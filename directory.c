@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "directory.h"
+#include "grr.h"
+
+/*
+ * The layout of the records returned by getdents64.  Older versions of glibc don't declare it.
+ */
+typedef struct grrDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} grrDirent64;
+
+int
+grrDirectoryOpen(grrDirectory *dir, int parent_fd, const char *path, grrArena *arena)
+{
+    *dir = (grrDirectory){.fd = -1, .borrowed = !!arena};
+
+    dir->fd = openat(parent_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir->fd == -1) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    dir->buffer = arena ? grrArenaAlloc(arena, GRR_DIRENT_BUFFER_SIZE) : malloc(GRR_DIRENT_BUFFER_SIZE);
+    if (!dir->buffer) {
+        close(dir->fd);
+        dir->fd = -1;
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+int
+grrDirectoryNext(grrDirectory *dir, const char **name, unsigned char *type)
+{
+    const grrDirent64 *entry;
+
+    if (dir->consumed == dir->filled) {
+        long filled;
+
+        do {
+            filled = syscall(SYS_getdents64, dir->fd, dir->buffer, GRR_DIRENT_BUFFER_SIZE);
+        } while (filled < 0 && errno == EINTR);
+        if (filled < 0) {
+            return GRR_APP_RET_FILE_ACCESS;
+        }
+        if (filled == 0) {
+            return GRR_APP_RET_DONE;
+        }
+
+        dir->filled = filled;
+        dir->consumed = 0;
+    }
+
+    entry = (const grrDirent64 *)(dir->buffer + dir->consumed);
+    dir->consumed += entry->d_reclen;
+    *name = entry->d_name;
+    *type = entry->d_type;
+
+    return GRR_APP_RET_OK;
+}
+
+void
+grrDirectoryClose(grrDirectory *dir)
+{
+    if (dir->fd != -1) {
+        close(dir->fd);
+    }
+    if (!dir->borrowed) {
+        free(dir->buffer);
+    }
+    *dir = (grrDirectory){.fd = -1};
+}
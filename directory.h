@@ -0,0 +1,46 @@
+#ifndef GRR_DIRECTORY_H
+#define GRR_DIRECTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/*
+ * The size of the buffer into which directory entries are read.  A single getdents64 call fills it with as
+ * many entries as will fit.
+ */
+#define GRR_DIRENT_BUFFER_SIZE (32 * 1024)
+
+/*
+ * An open directory which is read with getdents64 rather than through readdir.  Entries are handed out
+ * along with their d_type so that the caller can usually avoid a stat.  The file descriptor can be used with
+ * openat and fstatat to access the entries without resolving their full paths.
+ */
+typedef struct grrDirectory {
+    char *buffer;
+    size_t filled;
+    size_t consumed;
+    int fd;
+    bool borrowed;
+} grrDirectory;
+
+/*
+ * Opens a directory relative to parent_fd, which may be AT_FDCWD.  If arena isn't NULL, the buffer is allocated
+ * from it and is released along with the rest of the arena rather than by grrDirectoryClose.
+ */
+int
+grrDirectoryOpen(grrDirectory *dir, int parent_fd, const char *path, grrArena *arena);
+
+/*
+ * Sets *name and *type to those of the next entry.  The type is one of the DT_* constants and may be
+ * DT_UNKNOWN if the file system doesn't report it.  The name remains valid until the next call.  Returns
+ * GRR_APP_RET_DONE once the directory has been exhausted.
+ */
+int
+grrDirectoryNext(grrDirectory *dir, const char **name, unsigned char *type);
+
+void
+grrDirectoryClose(grrDirectory *dir);
+
+#endif  // GRR_DIRECTORY_H
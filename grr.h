@@ -0,0 +1,278 @@
+#ifndef GRR_H
+#define GRR_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "aho.h"
+#include "arena.h"
+#include "cache.h"
+#include "dfa.h"
+#include "directory.h"
+#include "engine/include/nfa.h"
+#include "history.h"
+#include "ignore.h"
+#include "index.h"
+#include "literal.h"
+#include "output.h"
+#include "prefetch.h"
+#include "reader.h"
+#include "stats.h"
+
+#define GRR_VERSION "2.2.0"
+#define GRR_MAX_THREADS 256
+// Files whose first GRR_BINARY_SCAN_SIZE bytes look binary are skipped unless -a is used.
+#define GRR_BINARY_SCAN_SIZE (8 * 1024)
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+enum grrAppRetValue {
+    GRR_APP_RET_OK = 0,
+    GRR_APP_RET_DONE,
+    GRR_APP_RET_FILE_ACCESS,
+    GRR_APP_RET_NOT_FOUND,
+    GRR_APP_RET_OUT_OF_MEMORY,
+    GRR_APP_RET_BAD_DATA,
+    GRR_APP_RET_OVERFLOW,
+    GRR_APP_RET_EXEC,
+    GRR_APP_RET_OTHER,
+};
+
+enum grrEntryType {
+    GRR_ENTRY_SKIP = 0,
+    GRR_ENTRY_FILE,
+    GRR_ENTRY_DIRECTORY,
+};
+
+/*
+ * One of the search regexes along with what's derived from it.  regex is the regex as it was given, which is how
+ * results are tagged.  search_regex is the one which is compiled: the case-insensitive form with -I and regex
+ * itself otherwise.
+ */
+typedef struct grrPattern {
+    char *regex;
+    char *search_regex;
+    grrNfa nfa;
+    grrLiteral literal;
+    bool anchored;
+    bool needs_context;
+} grrPattern;
+
+/*
+ * Limits on the metadata of the files which are searched.  A max_size of -1 means that there is no maximum and
+ * times of 0 mean that there is no bound.
+ */
+typedef struct grrFileFilter {
+    off_t min_size;
+    off_t max_size;
+    time_t newer_than;
+    time_t older_than;
+} grrFileFilter;
+
+typedef struct grrOptions {
+    char *starting_directory;
+    char *editor;
+    grrOutput *output;
+    grrHistory *history;
+    const char *file_regex;
+    grrPattern *patterns;
+    size_t num_patterns;
+    grrNfa file_pattern;
+    grrProgram *search_program;
+    grrAhoCorasick *search_literals;
+    grrIndex *index;
+    grrResultCache *result_cache;
+    grrIgnoreList *exclude_dirs;
+    char *exclude_dir_globs;  // The --exclude-dir arguments separated by slashes, for the history's query.
+    grrStats *stats;
+    grrFileFilter filter;
+    long depth;
+    long line_no;
+    long num_threads;
+    long io_depth;
+    long before_context;
+    long after_context;
+    int stream_fd;
+    unsigned int names_only : 1;
+    unsigned int verbose : 1;
+    unsigned int ignore_hidden : 1;
+    unsigned int no_history : 1;
+    unsigned int colorless : 1;
+    unsigned int build_index : 1;
+    unsigned int binary_as_text : 1;
+    unsigned int cache_results : 1;
+    unsigned int stream : 1;
+    unsigned int ignore_files : 1;
+    unsigned int filter_files : 1;
+    unsigned int fold_case : 1;
+    unsigned int stats_requested : 1;
+    unsigned int stats_json : 1;
+    unsigned int serve : 1;
+    unsigned int connect : 1;
+    unsigned int full_line : 1;
+    unsigned int all_matches : 1;
+    unsigned int count_matches : 1;
+    unsigned int only_matching : 1;
+} grrOptions;
+
+/*
+ * A single matching line.  The text is everything which gets printed after the "(N) <path>" prefix and is
+ * stored in the owning grrResultSet's buffer.
+ */
+typedef struct grrResult {
+    size_t file_line_no;
+    size_t offset;
+    size_t len;
+} grrResult;
+
+/*
+ * The results found within one file.  They are buffered so that they can be numbered and printed once the
+ * file's position in the traversal order has been reached.
+ */
+typedef struct grrResultSet {
+    grrResult *results;
+    size_t num_results;
+    size_t results_capacity;
+    char *text;
+    size_t text_len;
+    size_t text_capacity;
+} grrResultSet;
+
+/*
+ * The context lines (-A, -B, and -C) of the file being searched.  They're sliced out of the chunk being searched,
+ * except that copies of the last few lines of the previous chunk are carried over so that a match at the start
+ * of a chunk can still be given its before-context.  Nothing is read from the file a second time.
+ * printed_through is the number of the last line which was printed, either as a match or as context, so that no
+ * line is printed twice.  Everything but before and after is reset for each file.
+ */
+typedef struct grrContext {
+    const char *chunk;
+    size_t chunk_line_no;
+    char *carried;
+    size_t carried_len;
+    size_t carried_capacity;
+    size_t num_carried;
+    size_t printed_through;
+    size_t after_remaining;
+    size_t before;
+    size_t after;
+} grrContext;
+
+/*
+ * Where a match starts and ends within its line.
+ */
+typedef struct grrMatchSpan {
+    size_t start;
+    size_t end;
+} grrMatchSpan;
+
+/*
+ * Everything a thread needs in order to search files.  The engine's NFAs are not shared between threads so
+ * each thread compiles its own copies.  search_patterns parallels options->patterns.  If options->stats is
+ * set, the state collects its own stats which are merged into options->stats by freeSearchState.  The arena
+ * holds the thread's scratch memory, such as directory buffers, which is released directory by directory.
+ * spans holds the matches found on the current line.  With --count, file_count is the number of matches found
+ * so far in the current file and first_line_no is the line of the first one.
+ */
+typedef struct grrSearchState {
+    grrNfa *search_patterns;
+    size_t num_patterns;
+    grrNfa file_pattern;
+    grrDfa *dfa;
+    grrReader reader;
+    grrArena arena;
+    grrStats *stats;
+    grrStats *total_stats;
+    grrPrefetcher *prefetcher;
+    grrPrefetchedFile *prefetched;
+    grrContext context;
+    grrMatchSpan *spans;
+    size_t spans_capacity;
+    size_t file_count;
+    size_t first_line_no;
+    unsigned int owns_patterns : 1;
+} grrSearchState;
+
+int
+initSearchState(grrSearchState *state, const grrOptions *options, bool copy_patterns);
+
+void
+freeSearchState(grrSearchState *state);
+
+void
+clearResultSet(grrResultSet *results);
+
+void
+freeResultSet(grrResultSet *results);
+
+/*
+ * Appends name to path and determines what to do with the entry.  The type is the entry's d_type and the
+ * entry is only stat'ed (relative to dir_fd) when the type is unknown or when the index needs to check it.
+ * If file_stat isn't NULL, though, regular files are always stat'ed and the results are stored in it.  They're
+ * also always stat'ed when options->filter_files is set so that filtered files are skipped before they're
+ * opened.  Entries matched by the ignore rules (which may be NULL) or by --exclude-dir are skipped.
+ */
+int
+examineEntry(int dir_fd, const char *name, unsigned char type, char *path, size_t offset, long depth,
+             size_t *new_len, struct stat *file_stat, const grrIgnoreList *ignore, const grrSearchState *state,
+             const grrOptions *options);
+
+/*
+ * The ignore list holds the rules inherited from the directory's ancestors.
+ */
+int
+searchDirectoryTree(grrDirectory *dir, char *path, size_t offset, long depth, grrIgnoreList *ignore, long *line_no,
+                    grrSearchState *state, grrResultSet *results, const grrOptions *options);
+
+int
+searchDirectoryTreeParallel(grrDirectory *dir, const char *path, long *line_no, const grrOptions *options);
+
+/*
+ * Searches the file at name, relative to dir_fd.  The path is only used for messages and for the result cache.
+ * If file_stat isn't NULL, the results are looked up in and recorded to options->result_cache.  If
+ * state->prefetched is set, the file is taken from it instead of being opened.
+ */
+int
+searchFileForPattern(int dir_fd, const char *name, const char *path, const struct stat *file_stat,
+                     grrResultSet *results, grrSearchState *state, const grrOptions *options);
+
+/*
+ * Searches everything read from fd until the stream ends.  Each chunk's results are printed, and the output
+ * flushed, as soon as the chunk has been searched.  The name is printed in place of a path.
+ */
+int
+searchStream(int fd, const char *name, long *line_no, grrSearchState *state, grrResultSet *results,
+             const grrOptions *options);
+
+int
+emitResults(const char *path, const grrResultSet *results, long *line_no, const grrOptions *options);
+
+int
+executeEditor(const char *editor, const char *path, long line_no, bool verbose);
+
+/*
+ * Compiles a regex and adds it to options->patterns.
+ */
+int
+addPattern(grrOptions *options, const char *regex);
+
+/*
+ * Prepares the patterns for searching (folding them if options->fold_case is set and building the DFA and the
+ * literal matcher) once all of them have been added.
+ */
+int
+analyzePatterns(grrOptions *options);
+
+void
+freePatterns(grrOptions *options);
+
+#endif  // GRR_H
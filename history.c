@@ -0,0 +1,343 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "history.h"
+
+#define GRR_HISTORY_MAGIC "GRRHIST2"
+
+/*
+ * The query immediately follows the header.  The path pool runs from the end of the query up to the table,
+ * which is aligned on an 8-byte boundary.  A history file which was never finished has a table_offset of 0.
+ */
+typedef struct grrHistoryHeader {
+    char magic[8];
+    uint64_t query_len;
+    uint64_t num_results;
+    uint64_t table_offset;
+} grrHistoryHeader;
+
+/*
+ * Each result is a pair of the offset of its file's path and its line number.
+ */
+#define GRR_HISTORY_ENTRY_SIZE (2 * sizeof(uint64_t))
+
+static char *
+makeQuery(const grrOptions *options, size_t *len);
+
+int
+grrHistoryCreate(grrHistory *history, int fd, const grrOptions *options)
+{
+    int ret;
+    size_t query_len;
+    char *query;
+    grrHistoryHeader header = {0};
+
+    *history = (grrHistory){0};
+
+    query = makeQuery(options, &query_len);
+    if (!query) {
+        return GRR_APP_RET_OTHER;
+    }
+
+    ret = grrOutputInit(&history->output, fd);
+    if (ret != GRR_APP_RET_OK) {
+        free(query);
+        return ret;
+    }
+
+    // The header is rewritten with the final counts once the search is over.
+    memcpy(header.magic, GRR_HISTORY_MAGIC, sizeof(header.magic));
+    header.query_len = query_len;
+    grrOutputWrite(&history->output, (const char *)&header, sizeof(header));
+    grrOutputWrite(&history->output, query, query_len);
+    free(query);
+
+    history->query_len = query_len;
+    history->offset = sizeof(header) + query_len;
+    return GRR_APP_RET_OK;
+}
+
+void
+grrHistoryAddFile(grrHistory *history, const char *path, size_t len)
+{
+    history->path_offset = history->offset;
+    grrOutputWrite(&history->output, path, len);
+    grrOutputWrite(&history->output, "", 1);
+    history->offset += len + 1;
+}
+
+void
+grrHistoryAddResult(grrHistory *history, size_t file_line_no)
+{
+    if (history->failed) {
+        return;
+    }
+
+    if (history->num_results == history->table_capacity) {
+        size_t new_capacity = history->table_capacity ? 2 * history->table_capacity : 1024;
+        uint64_t *new_table;
+
+        new_table = realloc(history->table, new_capacity * GRR_HISTORY_ENTRY_SIZE);
+        if (!new_table) {
+            history->failed = true;
+            return;
+        }
+        history->table = new_table;
+        history->table_capacity = new_capacity;
+    }
+
+    history->table[2 * history->num_results] = history->path_offset;
+    history->table[2 * history->num_results + 1] = file_line_no;
+    history->num_results++;
+}
+
+int
+grrHistoryFinish(grrHistory *history)
+{
+    int ret;
+    int fd = history->output.fd;
+    grrHistoryHeader header = {
+        .query_len = history->query_len,
+        .num_results = history->num_results,
+    };
+    static const char padding[8] = {0};
+
+    header.table_offset = (history->offset + 7) & ~(uint64_t)7;
+    grrOutputWrite(&history->output, padding, header.table_offset - history->offset);
+    if (history->num_results > 0) {
+        grrOutputWrite(&history->output, (const char *)history->table,
+                       history->num_results * GRR_HISTORY_ENTRY_SIZE);
+    }
+    ret = grrOutputClose(&history->output);
+    free(history->table);
+
+    if (history->failed) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    if (ret != GRR_APP_RET_OK) {
+        return ret;
+    }
+
+    memcpy(header.magic, GRR_HISTORY_MAGIC, sizeof(header.magic));
+    if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+int
+grrHistoryOpenResult(const grrOptions *options)
+{
+    int ret = GRR_APP_RET_BAD_DATA, fd;
+    size_t query_len, map_len;
+    const char *home, *path;
+    char history_file[PATH_MAX], *query = NULL, *map;
+    const grrHistoryHeader *header;
+    const uint64_t *entry;
+    uint64_t pool_start;
+    struct stat file_stat;
+
+    home = getenv("HOME");
+    if (!home) {
+        if (options->verbose) {
+            fprintf(stderr, "The HOME environment variable is unset.\n");
+        }
+
+        return GRR_APP_RET_OTHER;
+    }
+    if (snprintf(history_file, sizeof(history_file), "%s/%s", home, GRR_HISTORY) >=
+        (ssize_t)sizeof(history_file)) {
+        if (options->verbose) {
+            fprintf(stderr, "%s/%s was too big for the buffer.\n", home, GRR_HISTORY);
+        }
+
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    fd = open(history_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return GRR_APP_RET_OK;
+        }
+        if (options->verbose) {
+            fprintf(stderr, "Failed to open %s: %s\n", history_file, strerror(errno));
+        }
+
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(*header)) {
+        if (options->verbose) {
+            fprintf(stderr, "%s is truncated.\n", history_file);
+        }
+        close(fd);
+        return GRR_APP_RET_BAD_DATA;
+    }
+    map_len = file_stat.st_size;
+
+    map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        if (options->verbose) {
+            fprintf(stderr, "Failed to map %s: %s\n", history_file, strerror(errno));
+        }
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    header = (const grrHistoryHeader *)map;
+    if (memcmp(header->magic, GRR_HISTORY_MAGIC, sizeof(header->magic)) != 0) {
+        if (options->verbose) {
+            fprintf(stderr, "%s was written by a different version of Grr.\n", history_file);
+        }
+        goto done;
+    }
+
+    pool_start = sizeof(*header) + header->query_len;
+    if (header->query_len > map_len - sizeof(*header) || header->table_offset < pool_start ||
+        header->table_offset > map_len || header->table_offset % sizeof(uint64_t) != 0 ||
+        header->num_results > (map_len - header->table_offset) / GRR_HISTORY_ENTRY_SIZE) {
+        if (options->verbose) {
+            fprintf(stderr, "%s is malformed.\n", history_file);
+        }
+        goto done;
+    }
+
+    query = makeQuery(options, &query_len);
+    if (!query) {
+        ret = GRR_APP_RET_OTHER;
+        goto done;
+    }
+    if (query_len != header->query_len || memcmp(query, header + 1, query_len) != 0) {
+        goto done;
+    }
+
+    if ((uint64_t)options->line_no >= header->num_results) {
+        ret = GRR_APP_RET_NOT_FOUND;
+        goto done;
+    }
+
+    entry = (const uint64_t *)(map + header->table_offset) + 2 * options->line_no;
+    if (entry[0] < pool_start || entry[0] >= header->table_offset ||
+        !memchr(map + entry[0], '\0', header->table_offset - entry[0]) || entry[1] < 1 ||
+        entry[1] > LONG_MAX) {
+        if (options->verbose) {
+            fprintf(stderr, "Invalid entry found for result %li in %s.\n", options->line_no, history_file);
+        }
+        goto done;
+    }
+    path = map + entry[0];
+
+    ret = executeEditor(options->editor, path, options->names_only ? 1 : (long)entry[1], options->verbose);
+
+done:
+
+    free(query);
+    munmap(map, map_len);
+
+    return ret;
+}
+
+/*
+ * The query is a sequence of null-terminated strings: the flags which affect the results, the maximum depth,
+ * the file filters, the --exclude-dir globs, the absolute starting directory, the file pattern's description
+ * (empty if there isn't one), and the description of every search pattern.  The flags include -g since it also
+ * changes which files are searched.  Two searches with the same query produce the same results.
+ */
+static char *
+makeQuery(const grrOptions *options, size_t *len)
+{
+    char flags[8], depth[24], filter[128], starting_directory[PATH_MAX];
+    const char *file_pattern;
+    const char *exclude_dir_globs;
+    size_t flags_len = 0, depth_len, filter_len, globs_len, directory_len, file_pattern_len, query_len;
+    char *query, *cursor;
+
+    if (!realpath(options->starting_directory, starting_directory)) {
+        if (options->verbose) {
+            fprintf(stderr, "Failed to resolve absolute path of starting directory.\n");
+        }
+        return NULL;
+    }
+
+    if (options->names_only) {
+        flags[flags_len++] = 'n';
+    }
+    if (options->ignore_hidden) {
+        flags[flags_len++] = 'i';
+    }
+    if (options->binary_as_text) {
+        flags[flags_len++] = 'a';
+    }
+    if (options->ignore_files) {
+        flags[flags_len++] = 'g';
+    }
+    // These change which results there are, unlike the options which only change how they're printed.
+    if (options->count_matches) {
+        flags[flags_len++] = 'C';
+    }
+    if (options->only_matching) {
+        flags[flags_len++] = 'o';
+    }
+    flags[flags_len++] = '\0';
+
+    depth_len = snprintf(depth, sizeof(depth), "%li", options->depth) + 1;
+    filter_len = 1;
+    filter[0] = '\0';
+    if (options->filter_files) {
+        const grrFileFilter *file_filter = &options->filter;
+
+        filter_len = snprintf(filter, sizeof(filter), "%lli:%lli:%lli:%lli", (long long)file_filter->min_size,
+                              (long long)file_filter->max_size, (long long)file_filter->newer_than,
+                              (long long)file_filter->older_than) +
+                     1;
+    }
+    exclude_dir_globs = options->exclude_dir_globs ? options->exclude_dir_globs : "";
+    globs_len = strlen(exclude_dir_globs) + 1;
+    directory_len = strlen(starting_directory) + 1;
+    file_pattern = options->file_pattern ? grrDescription(options->file_pattern) : "";
+    file_pattern_len = strlen(file_pattern) + 1;
+
+    query_len = flags_len + depth_len + filter_len + globs_len + directory_len + file_pattern_len;
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        query_len += strlen(grrDescription(options->patterns[k].nfa)) + 1;
+    }
+
+    query = malloc(query_len);
+    if (!query) {
+        return NULL;
+    }
+
+    cursor = query;
+    memcpy(cursor, flags, flags_len);
+    cursor += flags_len;
+    memcpy(cursor, depth, depth_len);
+    cursor += depth_len;
+    memcpy(cursor, filter, filter_len);
+    cursor += filter_len;
+    memcpy(cursor, exclude_dir_globs, globs_len);
+    cursor += globs_len;
+    memcpy(cursor, starting_directory, directory_len);
+    cursor += directory_len;
+    memcpy(cursor, file_pattern, file_pattern_len);
+    cursor += file_pattern_len;
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        const char *description = grrDescription(options->patterns[k].nfa);
+        size_t description_len = strlen(description) + 1;
+
+        memcpy(cursor, description, description_len);
+        cursor += description_len;
+    }
+
+    *len = query_len;
+    return query;
+}
@@ -0,0 +1,66 @@
+#ifndef GRR_HISTORY_H
+#define GRR_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+
+/*
+ * The name of the history file.  It's stored in the HOME directory.
+ */
+#define GRR_HISTORY ".grr_history"
+
+/*
+ * The history file records the results of the latest search so that -l can open one of them without searching
+ * again.  It consists of a header, the query (the options which determine the results), a pool of the
+ * null-terminated paths of the files containing results, and a table with one entry per result.  The file is
+ * memory-mapped when it's read so that looking up a result takes the same time however many there are.
+ *
+ * While the search runs, paths are streamed out as they're reported and the table is accumulated in memory.
+ */
+typedef struct grrHistory {
+    grrOutput output;
+    uint64_t *table;
+    size_t num_results;
+    size_t table_capacity;
+    uint64_t offset;
+    uint64_t path_offset;
+    uint64_t query_len;
+    bool failed;
+} grrHistory;
+
+struct grrOptions;
+
+/*
+ * Starts a history file for the search described by options.  On failure, the file descriptor is left open.
+ */
+int
+grrHistoryCreate(grrHistory *history, int fd, const struct grrOptions *options);
+
+/*
+ * Records the path of the file whose results are about to be added.
+ */
+void
+grrHistoryAddFile(grrHistory *history, const char *path, size_t len);
+
+void
+grrHistoryAddResult(grrHistory *history, size_t file_line_no);
+
+/*
+ * Writes out the result table and the final header and frees the history.  The file descriptor is left open.
+ * Returns GRR_APP_RET_FILE_ACCESS if any write failed.
+ */
+int
+grrHistoryFinish(grrHistory *history);
+
+/*
+ * Opens the editor at the options->line_no'th result of the previous search if that search used the same
+ * options.  Returns GRR_APP_RET_OK if the editor was run or if there is no history file.  Any other value means
+ * that the history couldn't be used and so the directory tree has to be searched.
+ */
+int
+grrHistoryOpenResult(const struct grrOptions *options);
+
+#endif  // GRR_HISTORY_H
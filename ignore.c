@@ -0,0 +1,391 @@
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "ignore.h"
+
+// Ignore files larger than this are assumed not to be ignore files at all.
+#define GRR_IGNORE_FILE_LIMIT (1024 * 1024)
+
+/*
+ * Rules are classified when they're parsed so that the common cases (a plain name such as node_modules or a
+ * suffix such as *.o) are matched without running the glob matcher.
+ */
+enum grrRuleKind {
+    GRR_RULE_LITERAL = 0,
+    GRR_RULE_SUFFIX,
+    GRR_RULE_GLOB,
+};
+
+typedef struct grrIgnoreRule {
+    char *pattern;
+    size_t len;
+    unsigned int kind : 2;
+    unsigned int negated : 1;
+    unsigned int dir_only : 1;
+    unsigned int anchored : 1;
+} grrIgnoreRule;
+
+struct grrIgnoreList {
+    grrIgnoreList *parent;
+    grrIgnoreRule *rules;
+    size_t num_rules;
+    size_t capacity;
+    size_t base_offset;
+    atomic_uint refs;
+};
+
+static grrIgnoreList *
+newList(grrIgnoreList *parent, size_t base_offset);
+
+static int
+addRule(grrIgnoreList *list, const char *line, size_t len);
+
+static bool
+ruleMatches(const grrIgnoreRule *rule, const char *subject);
+
+static bool
+globMatch(const char *pattern, const char *string);
+
+static bool
+classMatch(const char **pattern, char c);
+
+int
+grrIgnoreLoad(int dir_fd, size_t base_offset, grrIgnoreList *parent, grrIgnoreList **list)
+{
+    int ret = GRR_APP_RET_OK, fd;
+    ssize_t num_read;
+    char *contents = NULL;
+    grrIgnoreList *new_list = NULL;
+    struct stat file_stat;
+
+    *list = grrIgnoreRetain(parent);
+
+    fd = openat(dir_fd, GRR_IGNORE_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return GRR_APP_RET_OK;
+    }
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0 ||
+        file_stat.st_size > GRR_IGNORE_FILE_LIMIT) {
+        goto done;
+    }
+
+    contents = malloc(file_stat.st_size);
+    new_list = newList(parent, base_offset);
+    if (!contents || !new_list) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    num_read = read(fd, contents, file_stat.st_size);
+    if (num_read <= 0) {
+        goto done;
+    }
+
+    for (const char *line = contents, *end = contents + num_read; line < end;) {
+        const char *newline = memchr(line, '\n', end - line);
+        size_t len = (newline ? newline : end) - line;
+
+        ret = addRule(new_list, line, len);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+        line += len + 1;
+    }
+
+    if (new_list->num_rules > 0) {
+        grrIgnoreRelease(*list);
+        *list = new_list;
+        new_list = NULL;
+    }
+
+done:
+
+    grrIgnoreRelease(new_list);
+    free(contents);
+    close(fd);
+    return ret;
+}
+
+int
+grrIgnoreAddRule(grrIgnoreList **list, const char *rule, size_t base_offset)
+{
+    if (!*list) {
+        *list = newList(NULL, base_offset);
+        if (!*list) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+    }
+
+    return addRule(*list, rule, strlen(rule));
+}
+
+bool
+grrIgnoreMatch(const grrIgnoreList *list, const char *path, const char *name, bool is_dir)
+{
+    for (; list; list = list->parent) {
+        for (size_t k = list->num_rules; k > 0; k--) {
+            const grrIgnoreRule *rule = list->rules + k - 1;
+
+            if (rule->dir_only && !is_dir) {
+                continue;
+            }
+            if (ruleMatches(rule, rule->anchored ? path + list->base_offset : name)) {
+                return !rule->negated;
+            }
+        }
+    }
+
+    return false;
+}
+
+grrIgnoreList *
+grrIgnoreRetain(grrIgnoreList *list)
+{
+    if (list) {
+        atomic_fetch_add(&list->refs, 1);
+    }
+    return list;
+}
+
+void
+grrIgnoreRelease(grrIgnoreList *list)
+{
+    while (list && atomic_fetch_sub(&list->refs, 1) == 1) {
+        grrIgnoreList *parent = list->parent;
+
+        for (size_t k = 0; k < list->num_rules; k++) {
+            free(list->rules[k].pattern);
+        }
+        free(list->rules);
+        free(list);
+        list = parent;
+    }
+}
+
+static grrIgnoreList *
+newList(grrIgnoreList *parent, size_t base_offset)
+{
+    grrIgnoreList *list;
+
+    list = calloc(1, sizeof(*list));
+    if (!list) {
+        return NULL;
+    }
+    list->parent = grrIgnoreRetain(parent);
+    list->base_offset = base_offset;
+    atomic_init(&list->refs, 1);
+
+    return list;
+}
+
+/*
+ * Parses a line of an ignore file.  Blank lines and comments are skipped.
+ */
+static int
+addRule(grrIgnoreList *list, const char *line, size_t len)
+{
+    grrIgnoreRule rule = {0};
+
+    while (len > 0 && (line[len - 1] == '\r' || (line[len - 1] == ' ' && (len < 2 || line[len - 2] != '\\')))) {
+        len--;
+    }
+    if (len == 0 || line[0] == '#') {
+        return GRR_APP_RET_OK;
+    }
+
+    if (line[0] == '!') {
+        rule.negated = true;
+        line++;
+        len--;
+    }
+    else if (line[0] == '\\' && len > 1 && (line[1] == '!' || line[1] == '#')) {
+        line++;
+        len--;
+    }
+
+    if (len > 0 && line[len - 1] == '/') {
+        rule.dir_only = true;
+        len--;
+    }
+    // A slash anywhere but at the end ties the pattern to the ignore file's directory.
+    if (memchr(line, '/', len)) {
+        rule.anchored = true;
+        if (line[0] == '/') {
+            line++;
+            len--;
+        }
+    }
+    if (len == 0) {
+        return GRR_APP_RET_OK;
+    }
+
+    rule.pattern = strndup(line, len);
+    if (!rule.pattern) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    rule.len = len;
+
+    if (!strpbrk(rule.pattern, "*?[\\")) {
+        rule.kind = GRR_RULE_LITERAL;
+    }
+    else if (!rule.anchored && rule.pattern[0] == '*' && !strpbrk(rule.pattern + 1, "*?[\\")) {
+        rule.kind = GRR_RULE_SUFFIX;
+    }
+    else {
+        rule.kind = GRR_RULE_GLOB;
+    }
+
+    if (list->num_rules == list->capacity) {
+        size_t new_capacity = list->capacity ? 2 * list->capacity : 8;
+        grrIgnoreRule *new_rules;
+
+        new_rules = realloc(list->rules, new_capacity * sizeof(*new_rules));
+        if (!new_rules) {
+            free(rule.pattern);
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        list->rules = new_rules;
+        list->capacity = new_capacity;
+    }
+    list->rules[list->num_rules++] = rule;
+
+    return GRR_APP_RET_OK;
+}
+
+static bool
+ruleMatches(const grrIgnoreRule *rule, const char *subject)
+{
+    size_t subject_len;
+
+    switch (rule->kind) {
+    case GRR_RULE_LITERAL: return strcmp(rule->pattern, subject) == 0;
+
+    case GRR_RULE_SUFFIX:
+        subject_len = strlen(subject);
+        return subject_len >= rule->len - 1 &&
+               memcmp(subject + subject_len - (rule->len - 1), rule->pattern + 1, rule->len - 1) == 0;
+
+    default: return globMatch(rule->pattern, subject);
+    }
+}
+
+/*
+ * Matches a string against a glob.  A single * or ? doesn't match a slash.  A ** matches across slashes and,
+ * when it's followed by a slash, the two together may also match nothing at all.
+ */
+static bool
+globMatch(const char *pattern, const char *string)
+{
+    for (;;) {
+        switch (*pattern) {
+        case '\0': return *string == '\0';
+
+        case '*':
+            if (pattern[1] == '*') {
+                pattern += 2;
+                if (*pattern == '/') {
+                    pattern++;
+                    for (;;) {
+                        if (globMatch(pattern, string)) {
+                            return true;
+                        }
+                        string = strchr(string, '/');
+                        if (!string) {
+                            return false;
+                        }
+                        string++;
+                    }
+                }
+                for (;; string++) {
+                    if (globMatch(pattern, string)) {
+                        return true;
+                    }
+                    if (*string == '\0') {
+                        return false;
+                    }
+                }
+            }
+
+            pattern++;
+            for (;; string++) {
+                if (globMatch(pattern, string)) {
+                    return true;
+                }
+                if (*string == '\0' || *string == '/') {
+                    return false;
+                }
+            }
+
+        case '?':
+            if (*string == '\0' || *string == '/') {
+                return false;
+            }
+            pattern++;
+            string++;
+            break;
+
+        case '[':
+            if (*string == '\0' || *string == '/' || !classMatch(&pattern, *string)) {
+                return false;
+            }
+            string++;
+            break;
+
+        case '\\':
+            if (pattern[1] != '\0') {
+                pattern++;
+            }
+            // fall through
+
+        default:
+            if (*pattern != *string) {
+                return false;
+            }
+            pattern++;
+            string++;
+            break;
+        }
+    }
+}
+
+/*
+ * Matches a character against a bracket expression and advances the pattern past it.  An unterminated bracket
+ * is treated as a literal '['.
+ */
+static bool
+classMatch(const char **pattern, char c)
+{
+    const char *cursor = *pattern + 1;
+    bool negated = false, matched = false;
+
+    if (*cursor == '!' || *cursor == '^') {
+        negated = true;
+        cursor++;
+    }
+
+    for (bool first = true; *cursor != ']' || first; first = false) {
+        char low, high;
+
+        if (*cursor == '\0') {
+            *pattern += 1;
+            return c == '[';
+        }
+
+        low = high = *cursor++;
+        if (cursor[0] == '-' && cursor[1] != ']' && cursor[1] != '\0') {
+            high = cursor[1];
+            cursor += 2;
+        }
+        if (low <= c && c <= high) {
+            matched = true;
+        }
+    }
+
+    *pattern = cursor + 1;
+    return matched != negated;
+}
@@ -0,0 +1,50 @@
+#ifndef GRR_IGNORE_H
+#define GRR_IGNORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The name of the ignore files which are read when -g is used.
+ */
+#define GRR_IGNORE_FILE ".gitignore"
+
+/*
+ * The rules read from one directory's ignore file.  Each list points to the list of its closest ancestor
+ * directory which had an ignore file so that the rules are inherited down the tree.  As with git, the last
+ * rule which matches an entry decides whether it's ignored and the rules of deeper directories take
+ * precedence.
+ *
+ * Lists are reference-counted since the parallel traversal shares them between threads.
+ */
+typedef struct grrIgnoreList grrIgnoreList;
+
+/*
+ * Reads the ignore file in the directory referred to by dir_fd.  base_offset is the length of the directory's
+ * path (including the trailing slash) within the path buffer which is later passed to grrIgnoreMatch.  If the
+ * directory has no ignore file (or it has no rules), *list is set to parent and a reference to parent is taken
+ * instead.
+ */
+int
+grrIgnoreLoad(int dir_fd, size_t base_offset, grrIgnoreList *parent, grrIgnoreList **list);
+
+/*
+ * Adds a single rule (in .gitignore syntax) to a list whose patterns are relative to the given offset.  If
+ * *list is NULL, a new list is created.
+ */
+int
+grrIgnoreAddRule(grrIgnoreList **list, const char *rule, size_t base_offset);
+
+/*
+ * Determines whether an entry is ignored.  The path is the entry's whole path and name is its last component.
+ */
+bool
+grrIgnoreMatch(const grrIgnoreList *list, const char *path, const char *name, bool is_dir);
+
+grrIgnoreList *
+grrIgnoreRetain(grrIgnoreList *list);
+
+void
+grrIgnoreRelease(grrIgnoreList *list);
+
+#endif  // GRR_IGNORE_H
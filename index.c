@@ -0,0 +1,646 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "index.h"
+
+#define GRR_INDEX_MAGIC     "GRRINDX1"
+#define GRR_TRIGRAM_SPACE   (1 << 24)
+#define GRR_TRIGRAM_BITS    64
+#define BIT_WORD(trigram)   ((trigram) / GRR_TRIGRAM_BITS)
+#define BIT_MASK(trigram)   ((uint64_t)1 << ((trigram) % GRR_TRIGRAM_BITS))
+#define FOLD_BYTE(c)        (((c) >= 'A' && (c) <= 'Z') ? (c) + ('a' - 'A') : (c))
+
+/*
+ * The index file consists of a header, an array of entries sorted by path, the trigram arrays, and finally the
+ * null-terminated paths.  All offsets are from the start of the file.  The file is written in the host's byte
+ * order since it's never moved between machines.
+ */
+typedef struct grrIndexHeader {
+    char magic[8];
+    uint64_t num_files;
+} grrIndexHeader;
+
+typedef struct grrIndexEntry {
+    uint64_t path_offset;
+    uint64_t trigrams_offset;
+    uint64_t num_trigrams;
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} grrIndexEntry;
+
+struct grrIndex {
+    char *map;
+    size_t map_len;
+    const grrIndexEntry *entries;
+    size_t num_files;
+    size_t root_len;
+    uint32_t *trigrams;
+    size_t *group_ends;
+    size_t num_groups;
+};
+
+typedef struct grrIndexedFile {
+    char *path;
+    uint32_t *trigrams;
+    size_t num_trigrams;
+    struct stat file_stat;
+} grrIndexedFile;
+
+typedef struct grrIndexBuilder {
+    const grrOptions *options;
+    const grrIndex *old_index;
+    grrIndexedFile *files;
+    size_t num_files;
+    size_t files_capacity;
+    uint64_t *seen;
+    uint32_t *trigrams;
+    size_t trigrams_capacity;
+    size_t num_reused;
+    size_t root_len;
+    grrReader reader;
+} grrIndexBuilder;
+
+static int
+mapIndex(const char *directory, grrIndex **index);
+
+static const grrIndexEntry *
+findEntry(const grrIndex *index, const char *path);
+
+static bool
+entryIsCurrent(const grrIndexEntry *entry, const struct stat *file_stat);
+
+static int
+indexDirectory(grrIndexBuilder *builder, grrDirectory *dir, char *path, size_t offset, long depth);
+
+static int
+indexFile(grrIndexBuilder *builder, const char *path, const struct stat *file_stat);
+
+static int
+collectTrigrams(grrIndexBuilder *builder, const char *path, grrIndexedFile *file);
+
+static int
+addTrigram(grrIndexBuilder *builder, size_t *num_trigrams, uint32_t trigram);
+
+static int
+writeIndex(grrIndexBuilder *builder);
+
+static int
+compareTrigrams(const void *item1, const void *item2);
+
+static int
+compareFiles(const void *item1, const void *item2);
+
+int
+grrIndexBuild(const grrOptions *options)
+{
+    int ret;
+    char path[PATH_MAX];
+    grrDirectory dir;
+    grrIndex *old_index = NULL;
+    grrIndexBuilder builder = {.options = options};
+
+    builder.root_len = strlen(options->starting_directory);
+    if (mapIndex(options->starting_directory, &old_index) != GRR_APP_RET_OK) {
+        old_index = NULL;
+    }
+    builder.old_index = old_index;
+    grrReaderInit(&builder.reader);
+
+    builder.seen = calloc(GRR_TRIGRAM_SPACE / GRR_TRIGRAM_BITS, sizeof(*builder.seen));
+    if (!builder.seen) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    if (grrDirectoryOpen(&dir, AT_FDCWD, options->starting_directory, NULL) != GRR_APP_RET_OK) {
+        fprintf(stderr, "Failed to access starting directory.\n");
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto done;
+    }
+    memcpy(path, options->starting_directory, builder.root_len + 1);
+    ret = indexDirectory(&builder, &dir, path, builder.root_len, -1);
+    grrDirectoryClose(&dir);
+    if (ret != GRR_APP_RET_OK) {
+        goto done;
+    }
+
+    qsort(builder.files, builder.num_files, sizeof(*builder.files), compareFiles);
+    ret = writeIndex(&builder);
+    if (ret == GRR_APP_RET_OK && options->verbose) {
+        fprintf(stderr, "Indexed %zu files (%zu of which were unchanged).\n", builder.num_files,
+                builder.num_reused);
+    }
+
+done:
+
+    if (ret == GRR_APP_RET_OUT_OF_MEMORY) {
+        fprintf(stderr, "Ran out of memory while building the index.\n");
+    }
+
+    for (size_t k = 0; k < builder.num_files; k++) {
+        free(builder.files[k].path);
+        free(builder.files[k].trigrams);
+    }
+    free(builder.files);
+    free(builder.seen);
+    free(builder.trigrams);
+    grrReaderFree(&builder.reader);
+    grrIndexFree(old_index);
+
+    return ret;
+}
+
+int
+grrIndexLoad(const char *directory, const grrPattern *patterns, size_t num_patterns, grrIndex **index)
+{
+    int ret;
+    size_t total_len = 0, num_trigrams = 0;
+    grrIndex *new_index;
+
+    *index = NULL;
+
+    for (size_t k = 0; k < num_patterns; k++) {
+        if (patterns[k].literal.len < 3) {
+            return GRR_APP_RET_NOT_FOUND;
+        }
+        total_len += patterns[k].literal.len;
+    }
+
+    ret = mapIndex(directory, &new_index);
+    if (ret != GRR_APP_RET_OK) {
+        return ret;
+    }
+
+    new_index->trigrams = malloc(total_len * sizeof(*new_index->trigrams));
+    new_index->group_ends = malloc(num_patterns * sizeof(*new_index->group_ends));
+    if (!new_index->trigrams || !new_index->group_ends) {
+        grrIndexFree(new_index);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    // Each pattern's literal contributes a group of trigrams, all of which a file needs for that pattern to
+    // match.
+    for (size_t k = 0; k < num_patterns; k++) {
+        uint32_t trigram = 0;
+        const grrLiteral *literal = &patterns[k].literal;
+
+        for (size_t j = 0; j < literal->len; j++) {
+            trigram = ((trigram << 8) | FOLD_BYTE((unsigned char)literal->string[j])) & (GRR_TRIGRAM_SPACE - 1);
+            if (j >= 2) {
+                new_index->trigrams[num_trigrams++] = trigram;
+            }
+        }
+        new_index->group_ends[k] = num_trigrams;
+    }
+    new_index->num_groups = num_patterns;
+
+    *index = new_index;
+    return GRR_APP_RET_OK;
+}
+
+void
+grrIndexFree(grrIndex *index)
+{
+    if (!index) {
+        return;
+    }
+
+    munmap(index->map, index->map_len);
+    free(index->trigrams);
+    free(index->group_ends);
+    free(index);
+}
+
+bool
+grrIndexExcludes(const grrIndex *index, const char *path, const struct stat *file_stat)
+{
+    size_t k = 0;
+    const grrIndexEntry *entry;
+    const uint32_t *trigrams;
+
+    entry = findEntry(index, path + index->root_len);
+    if (!entry || !entryIsCurrent(entry, file_stat)) {
+        return false;
+    }
+
+    trigrams = (const uint32_t *)(index->map + entry->trigrams_offset);
+    for (size_t group = 0; group < index->num_groups; group++) {
+        for (; k < index->group_ends[group]; k++) {
+            if (!bsearch(index->trigrams + k, trigrams, entry->num_trigrams, sizeof(*trigrams),
+                         compareTrigrams)) {
+                break;
+            }
+        }
+
+        if (k == index->group_ends[group]) {
+            return false;
+        }
+        k = index->group_ends[group];
+    }
+
+    return true;
+}
+
+static int
+mapIndex(const char *directory, grrIndex **index)
+{
+    int fd, ret;
+    char path[PATH_MAX];
+    const grrIndexHeader *header;
+    struct stat file_stat;
+    grrIndex *new_index;
+
+    if (snprintf(path, sizeof(path), "%s%s", directory, GRR_INDEX) >= (int)sizeof(path)) {
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    new_index = calloc(1, sizeof(*new_index));
+    if (!new_index) {
+        close(fd);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    new_index->root_len = strlen(directory);
+
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(*header)) {
+        ret = GRR_APP_RET_BAD_DATA;
+        goto error;
+    }
+
+    new_index->map_len = file_stat.st_size;
+    new_index->map = mmap(NULL, new_index->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (new_index->map == MAP_FAILED) {
+        new_index->map = NULL;
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto error;
+    }
+    close(fd);
+    fd = -1;
+
+    header = (const grrIndexHeader *)new_index->map;
+    if (memcmp(header->magic, GRR_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->num_files > (new_index->map_len - sizeof(*header)) / sizeof(grrIndexEntry) ||
+        new_index->map[new_index->map_len - 1] != '\0') {
+        ret = GRR_APP_RET_BAD_DATA;
+        goto error;
+    }
+    new_index->entries = (const grrIndexEntry *)(header + 1);
+    new_index->num_files = header->num_files;
+
+    for (size_t k = 0; k < new_index->num_files; k++) {
+        const grrIndexEntry *entry = new_index->entries + k;
+
+        if (entry->path_offset >= new_index->map_len || entry->trigrams_offset % sizeof(uint32_t) != 0 ||
+            entry->trigrams_offset > new_index->map_len ||
+            entry->num_trigrams > (new_index->map_len - entry->trigrams_offset) / sizeof(uint32_t)) {
+            ret = GRR_APP_RET_BAD_DATA;
+            goto error;
+        }
+    }
+
+    *index = new_index;
+    return GRR_APP_RET_OK;
+
+error:
+
+    if (fd != -1) {
+        close(fd);
+    }
+    if (new_index->map) {
+        munmap(new_index->map, new_index->map_len);
+    }
+    free(new_index);
+    fprintf(stderr, "Ignoring %s since it's not a valid index.\n", path);
+
+    return ret;
+}
+
+static const grrIndexEntry *
+findEntry(const grrIndex *index, const char *path)
+{
+    size_t low = 0, high = index->num_files;
+
+    while (low < high) {
+        int comparison;
+        size_t middle = low + (high - low) / 2;
+        const grrIndexEntry *entry = index->entries + middle;
+
+        comparison = strcmp(path, index->map + entry->path_offset);
+        if (comparison == 0) {
+            return entry;
+        }
+        else if (comparison < 0) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+entryIsCurrent(const grrIndexEntry *entry, const struct stat *file_stat)
+{
+    return entry->inode == (uint64_t)file_stat->st_ino && entry->size == (int64_t)file_stat->st_size &&
+           entry->mtime_sec == (int64_t)file_stat->st_mtim.tv_sec &&
+           entry->mtime_nsec == (int64_t)file_stat->st_mtim.tv_nsec;
+}
+
+static int
+indexDirectory(grrIndexBuilder *builder, grrDirectory *dir, char *path, size_t offset, long depth)
+{
+    int ret = GRR_APP_RET_OK;
+    unsigned char type;
+    size_t new_len;
+    const char *name;
+    struct stat file_stat;
+    grrSearchState state = {0};
+
+    // Every file is indexed regardless of -f since the index is shared by all queries.
+    while (grrDirectoryNext(dir, &name, &type) == GRR_APP_RET_OK) {
+        switch (examineEntry(dir->fd, name, type, path, offset, depth, &new_len, &file_stat, NULL, &state,
+                             builder->options)) {
+        case GRR_ENTRY_FILE:
+            ret = indexFile(builder, path, &file_stat);
+            if (ret != GRR_APP_RET_OK) {
+                goto done;
+            }
+            break;
+
+        case GRR_ENTRY_DIRECTORY: {
+            grrDirectory subdir;
+
+            if (grrDirectoryOpen(&subdir, dir->fd, name, NULL) != GRR_APP_RET_OK) {
+                if (builder->options->verbose) {
+                    fprintf(stderr, "Could not access directory: %s\n", path);
+                }
+                break;
+            }
+
+            ret = indexDirectory(builder, &subdir, path, new_len, depth + 1);
+            grrDirectoryClose(&subdir);
+            if (ret != GRR_APP_RET_OK) {
+                goto done;
+            }
+        } break;
+
+        default: break;
+        }
+    }
+
+done:
+
+    path[offset] = '\0';
+
+    return ret;
+}
+
+static int
+indexFile(grrIndexBuilder *builder, const char *path, const struct stat *file_stat)
+{
+    int ret;
+    const grrIndexEntry *old_entry = NULL;
+    grrIndexedFile *file;
+
+    if (builder->num_files == builder->files_capacity) {
+        size_t new_capacity = builder->files_capacity ? builder->files_capacity * 2 : 64;
+        grrIndexedFile *success;
+
+        success = realloc(builder->files, new_capacity * sizeof(*builder->files));
+        if (!success) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        builder->files = success;
+        builder->files_capacity = new_capacity;
+    }
+
+    file = builder->files + builder->num_files;
+    *file = (grrIndexedFile){.file_stat = *file_stat};
+    file->path = strdup(path + builder->root_len);
+    if (!file->path) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    if (builder->old_index) {
+        old_entry = findEntry(builder->old_index, file->path);
+    }
+    if (old_entry && entryIsCurrent(old_entry, file_stat)) {
+        file->num_trigrams = old_entry->num_trigrams;
+        file->trigrams = malloc(MAX(file->num_trigrams, 1) * sizeof(*file->trigrams));
+        if (!file->trigrams) {
+            free(file->path);
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        memcpy(file->trigrams, builder->old_index->map + old_entry->trigrams_offset,
+               file->num_trigrams * sizeof(*file->trigrams));
+        builder->num_reused++;
+    }
+    else {
+        ret = collectTrigrams(builder, path, file);
+        if (ret != GRR_APP_RET_OK) {
+            free(file->path);
+            // A file which can't be read is left out of the index and therefore always searched.
+            return (ret == GRR_APP_RET_OUT_OF_MEMORY) ? ret : GRR_APP_RET_OK;
+        }
+    }
+
+    builder->num_files++;
+    return GRR_APP_RET_OK;
+}
+
+static int
+collectTrigrams(grrIndexBuilder *builder, const char *path, grrIndexedFile *file)
+{
+    int ret, reader_ret;
+    size_t num_trigrams = 0, chunk_len;
+    const char *chunk;
+
+    if (builder->options->verbose) {
+        fprintf(stderr, "Indexing %s.\n", path);
+    }
+
+    if (grrReaderOpen(&builder->reader, AT_FDCWD, path) != GRR_APP_RET_OK) {
+        if (builder->options->verbose) {
+            fprintf(stderr, "Could not read %s.\n", path);
+        }
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    // Chunks end on line boundaries so the only trigrams lost between them contain a newline, which no
+    // literal does.
+    while ((reader_ret = grrReaderNext(&builder->reader, &chunk, &chunk_len)) == GRR_APP_RET_OK) {
+        uint32_t trigram = 0;
+
+        for (size_t k = 0; k < chunk_len; k++) {
+            trigram = ((trigram << 8) | FOLD_BYTE((unsigned char)chunk[k])) & (GRR_TRIGRAM_SPACE - 1);
+            if (k >= 2 && !(builder->seen[BIT_WORD(trigram)] & BIT_MASK(trigram))) {
+                ret = addTrigram(builder, &num_trigrams, trigram);
+                if (ret != GRR_APP_RET_OK) {
+                    goto done;
+                }
+            }
+        }
+    }
+
+    if (reader_ret != GRR_APP_RET_DONE) {
+        if (builder->options->verbose) {
+            fprintf(stderr, "Failed to read from %s.\n", path);
+        }
+        ret = reader_ret;
+        goto done;
+    }
+
+    qsort(builder->trigrams, num_trigrams, sizeof(*builder->trigrams), compareTrigrams);
+    file->trigrams = malloc(MAX(num_trigrams, 1) * sizeof(*file->trigrams));
+    if (!file->trigrams) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+    memcpy(file->trigrams, builder->trigrams, num_trigrams * sizeof(*file->trigrams));
+    file->num_trigrams = num_trigrams;
+    ret = GRR_APP_RET_OK;
+
+done:
+
+    grrReaderClose(&builder->reader);
+
+    // Only the bits which were set are cleared so that small files don't pay for the whole bitmap.
+    for (size_t k = 0; k < num_trigrams; k++) {
+        builder->seen[BIT_WORD(builder->trigrams[k])] &= ~BIT_MASK(builder->trigrams[k]);
+    }
+
+    return ret;
+}
+
+static int
+addTrigram(grrIndexBuilder *builder, size_t *num_trigrams, uint32_t trigram)
+{
+    if (*num_trigrams == builder->trigrams_capacity) {
+        size_t new_capacity = builder->trigrams_capacity ? builder->trigrams_capacity * 2 : 1024;
+        uint32_t *success;
+
+        success = realloc(builder->trigrams, new_capacity * sizeof(*builder->trigrams));
+        if (!success) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        builder->trigrams = success;
+        builder->trigrams_capacity = new_capacity;
+    }
+
+    builder->seen[BIT_WORD(trigram)] |= BIT_MASK(trigram);
+    builder->trigrams[(*num_trigrams)++] = trigram;
+    return GRR_APP_RET_OK;
+}
+
+static int
+writeIndex(grrIndexBuilder *builder)
+{
+    int fd, write_failed;
+    uint64_t trigrams_offset, path_offset;
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    FILE *f;
+    grrIndexHeader header = {.num_files = builder->num_files};
+    const char *directory = builder->options->starting_directory;
+
+    if (snprintf(path, sizeof(path), "%s%s", directory, GRR_INDEX) >= (int)sizeof(path) ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s%s.XXXXXX", directory, GRR_INDEX) >= (int)sizeof(tmp_path)) {
+        fprintf(stderr, "The index's path is too long (max. of %i characters).\n", PATH_MAX - 1);
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    // The new index is written to a temporary file and then renamed so that concurrent searches never see a
+    // partially written one.
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to create %s: %s\n", tmp_path, strerror(errno));
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(tmp_path);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    memcpy(header.magic, GRR_INDEX_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, f);
+
+    trigrams_offset = sizeof(header) + builder->num_files * sizeof(grrIndexEntry);
+    path_offset = trigrams_offset;
+    for (size_t k = 0; k < builder->num_files; k++) {
+        path_offset += builder->files[k].num_trigrams * sizeof(uint32_t);
+    }
+
+    for (size_t k = 0; k < builder->num_files; k++) {
+        const grrIndexedFile *file = builder->files + k;
+        grrIndexEntry entry = {
+            .path_offset = path_offset,
+            .trigrams_offset = trigrams_offset,
+            .num_trigrams = file->num_trigrams,
+            .inode = file->file_stat.st_ino,
+            .size = file->file_stat.st_size,
+            .mtime_sec = file->file_stat.st_mtim.tv_sec,
+            .mtime_nsec = file->file_stat.st_mtim.tv_nsec,
+        };
+
+        fwrite(&entry, sizeof(entry), 1, f);
+        trigrams_offset += file->num_trigrams * sizeof(uint32_t);
+        path_offset += strlen(file->path) + 1;
+    }
+
+    for (size_t k = 0; k < builder->num_files; k++) {
+        fwrite(builder->files[k].trigrams, sizeof(uint32_t), builder->files[k].num_trigrams, f);
+    }
+    for (size_t k = 0; k < builder->num_files; k++) {
+        fwrite(builder->files[k].path, 1, strlen(builder->files[k].path) + 1, f);
+    }
+    // The index always ends with a null byte, even if it's empty, so that every path is terminated.
+    if (builder->num_files == 0) {
+        fputc('\0', f);
+    }
+
+    write_failed = ferror(f);
+    if (fclose(f) != 0 || write_failed) {
+        fprintf(stderr, "Failed to write %s.\n", tmp_path);
+        unlink(tmp_path);
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to move the index into place: %s\n", strerror(errno));
+        unlink(tmp_path);
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+static int
+compareTrigrams(const void *item1, const void *item2)
+{
+    uint32_t trigram1 = *(const uint32_t *)item1, trigram2 = *(const uint32_t *)item2;
+
+    return (trigram1 > trigram2) - (trigram1 < trigram2);
+}
+
+static int
+compareFiles(const void *item1, const void *item2)
+{
+    return strcmp(((const grrIndexedFile *)item1)->path, ((const grrIndexedFile *)item2)->path);
+}
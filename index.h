@@ -0,0 +1,49 @@
+#ifndef GRR_INDEX_H
+#define GRR_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+/*
+ * The name of the index file.  It's stored in the directory which it indexes.
+ */
+#define GRR_INDEX ".grr_index"
+
+/*
+ * A trigram index of a directory tree.  For every regular file, it records the file's inode, size, and
+ * modification time along with the sorted set of (lowercased) trigrams which appear in it.  Once loaded, it
+ * is read-only and so can be shared by all threads.
+ */
+typedef struct grrIndex grrIndex;
+
+struct grrOptions;
+struct grrPattern;
+
+/*
+ * Builds the index for options->starting_directory.  Files whose entries in the existing index (if any) are
+ * still up to date aren't read again.
+ */
+int
+grrIndexBuild(const struct grrOptions *options);
+
+/*
+ * Loads the index for a directory.  Returns GRR_APP_RET_NOT_FOUND if there is no index or if any pattern's
+ * literal is too short for the index to be of any use.
+ */
+int
+grrIndexLoad(const char *directory, const struct grrPattern *patterns, size_t num_patterns,
+             grrIndex **index);
+
+void
+grrIndexFree(grrIndex *index);
+
+/*
+ * Determines whether the index proves that a file cannot contain any of the patterns' literals.  The path has
+ * to begin with the directory passed to grrIndexLoad.  A file which isn't in the index or whose entry is out
+ * of date is never excluded.
+ */
+bool
+grrIndexExcludes(const grrIndex *index, const char *path, const struct stat *file_stat);
+
+#endif  // GRR_INDEX_H
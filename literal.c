@@ -0,0 +1,429 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grr.h"
+#include "literal.h"
+
+static const char *
+skipClass(const char *regex);
+
+static const char *
+skipGroup(const char *regex);
+
+static void
+endRun(const char *run, size_t *run_len, grrLiteral *literal);
+
+static char *
+foldClass(const char **regex, char *out);
+
+int
+grrExtractLiteral(const char *regex, grrLiteral *literal)
+{
+    size_t run_len = 0;
+    char *run;
+    const char *cursor = regex;
+
+    *literal = (grrLiteral){0};
+
+    run = malloc(strlen(regex) + 1);
+    literal->string = malloc(strlen(regex) + 1);
+    if (!run || !literal->string) {
+        free(run);
+        free(literal->string);
+        literal->string = NULL;
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    while (*cursor) {
+        bool is_literal = false, optional = false, repeated = false;
+        char value = '\0';
+
+        switch (*cursor) {
+        case '(':
+            cursor = skipGroup(cursor);
+            if (!cursor) {
+                goto no_literal;
+            }
+            break;
+
+        case '[':
+            cursor = skipClass(cursor);
+            if (!cursor) {
+                goto no_literal;
+            }
+            break;
+
+        case '\\':
+            if (cursor[1] == '\0') {
+                goto no_literal;
+            }
+            // Escaped letters and digits may denote character classes so only escaped punctuation is
+            // taken literally.
+            if (!isalnum((unsigned char)cursor[1]) && cursor[1] != '\n') {
+                is_literal = true;
+                value = cursor[1];
+            }
+            cursor += 2;
+            break;
+
+        case '.':
+        case '^':
+        case '$':
+        case '\n': cursor++; break;
+
+        case '|':
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+        case ')':
+        case ']':
+        case '}': goto no_literal;
+
+        default:
+            is_literal = true;
+            value = *cursor++;
+            break;
+        }
+
+        while (*cursor == '*' || *cursor == '+' || *cursor == '?' || *cursor == '{') {
+            if (*cursor == '{') {
+                cursor = strchr(cursor, '}');
+                if (!cursor) {
+                    goto no_literal;
+                }
+                // The lower bound could be 0.
+                optional = true;
+            }
+            else if (*cursor == '+') {
+                repeated = true;
+            }
+            else {
+                optional = true;
+            }
+            cursor++;
+        }
+
+        if (is_literal && !optional) {
+            run[run_len++] = value;
+            if (repeated) {
+                endRun(run, &run_len, literal);
+            }
+        }
+        else {
+            endRun(run, &run_len, literal);
+        }
+    }
+
+    endRun(run, &run_len, literal);
+    free(run);
+
+    if (literal->len == 0) {
+        grrFreeLiteral(literal);
+    }
+    return GRR_APP_RET_OK;
+
+no_literal:
+
+    free(run);
+    grrFreeLiteral(literal);
+    return GRR_APP_RET_OK;
+}
+
+bool
+grrIsAnchored(const char *regex)
+{
+    unsigned int depth = 0;
+
+    if (*regex != '^') {
+        return false;
+    }
+
+    while (*regex) {
+        switch (*regex) {
+        case '\\':
+            if (regex[1] == '\0') {
+                return false;
+            }
+            regex += 2;
+            break;
+
+        case '[':
+            regex = skipClass(regex);
+            if (!regex) {
+                return false;
+            }
+            break;
+
+        case '(': depth++; regex++; break;
+
+        case ')':
+            if (depth > 0) {
+                depth--;
+            }
+            regex++;
+            break;
+
+        case '|':
+            regex++;
+            if (depth == 0 && *regex != '^') {
+                return false;
+            }
+            break;
+
+        default: regex++; break;
+        }
+    }
+
+    return true;
+}
+
+bool
+grrNeedsContext(const char *regex)
+{
+    if (grrIsAnchored(regex)) {
+        return false;
+    }
+
+    while (*regex) {
+        switch (*regex) {
+        case '^': return true;
+
+        case '\\':
+            // Word boundaries depend on the character before the match as well.
+            if (regex[1] == '\0' || strchr("bB<>A`", regex[1])) {
+                return true;
+            }
+            regex += 2;
+            break;
+
+        case '[':
+            regex = skipClass(regex);
+            if (!regex) {
+                return true;
+            }
+            break;
+
+        default: regex++; break;
+        }
+    }
+
+    return false;
+}
+
+void
+grrFreeLiteral(grrLiteral *literal)
+{
+    free(literal->string);
+    *literal = (grrLiteral){0};
+}
+
+int
+grrFoldCase(const char *regex, char **folded)
+{
+    size_t len = strlen(regex), num_classes = 0;
+    char *out;
+
+    for (size_t k = 0; k < len; k++) {
+        if (regex[k] == '[') {
+            num_classes++;
+        }
+    }
+
+    // A letter outside of a class grows into four characters and a class gains at most 52 of them.
+    *folded = malloc(4 * len + 52 * num_classes + 1);
+    if (!*folded) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    out = *folded;
+
+    while (*regex) {
+        unsigned char c = *regex;
+
+        if (c == '\\') {
+            *out++ = *regex++;
+            if (*regex) {
+                *out++ = *regex++;
+            }
+        }
+        else if (c == '{') {
+            while (*regex && *regex != '}') {
+                *out++ = *regex++;
+            }
+        }
+        else if (c == '[') {
+            out = foldClass(&regex, out);
+        }
+        else if (isalpha(c)) {
+            *out++ = '[';
+            *out++ = tolower(c);
+            *out++ = toupper(c);
+            *out++ = ']';
+            regex++;
+        }
+        else {
+            *out++ = *regex++;
+        }
+    }
+
+    *out = '\0';
+    return GRR_APP_RET_OK;
+}
+
+void
+grrLowercaseLiteral(grrLiteral *literal)
+{
+    for (size_t k = 0; k < literal->len; k++) {
+        literal->string[k] = tolower((unsigned char)literal->string[k]);
+    }
+}
+
+/*
+ * Copies the character class at *regex while adding the other case of every letter in it and advances *regex
+ * past the class.  The letters are added at the end of the class unless it ends with a literal '-', in which
+ * case they're put in front of it so that they can't form a range with it.  Returns the end of the output.
+ */
+static char *
+foldClass(const char **regex, char *out)
+{
+    const char *cursor = *regex;
+    char letters[52], *item = NULL;
+    size_t num_letters = 0;
+    bool extra[256] = {false};
+
+    *out++ = *cursor++;
+    if (*cursor == '^') {
+        *out++ = *cursor++;
+    }
+    if (*cursor == ']') {
+        *out++ = *cursor++;
+    }
+
+    while (*cursor && *cursor != ']') {
+        unsigned char low, high;
+
+        item = out;
+        if (*cursor == '\\') {
+            *out++ = *cursor++;
+            if (*cursor) {
+                *out++ = *cursor++;
+            }
+            continue;
+        }
+
+        low = high = *cursor;
+        *out++ = *cursor++;
+        if (cursor[0] == '-' && cursor[1] != ']' && cursor[1] != '\0') {
+            high = cursor[1];
+            *out++ = *cursor++;
+            *out++ = *cursor++;
+        }
+
+        for (unsigned int k = low; k <= high; k++) {
+            if (isalpha(k)) {
+                extra[islower(k) ? toupper(k) : tolower(k)] = true;
+            }
+        }
+    }
+
+    for (unsigned int k = 0; k < 256; k++) {
+        if (extra[k]) {
+            letters[num_letters++] = k;
+        }
+    }
+    if (num_letters > 0) {
+        if (item && out - item == 1 && *item == '-') {
+            memmove(item + num_letters, item, 1);
+            memcpy(item, letters, num_letters);
+        }
+        else {
+            memcpy(out, letters, num_letters);
+        }
+        out += num_letters;
+    }
+
+    if (*cursor == ']') {
+        *out++ = *cursor++;
+    }
+    *regex = cursor;
+    return out;
+}
+
+static const char *
+skipClass(const char *regex)
+{
+    regex++;
+    if (*regex == '^') {
+        regex++;
+    }
+    // Whether a leading ']' closes the class or is a member of it depends on the engine so don't guess.
+    if (*regex == ']') {
+        return NULL;
+    }
+
+    for (; *regex; regex++) {
+        if (*regex == '\\') {
+            if (*++regex == '\0') {
+                return NULL;
+            }
+        }
+        else if (*regex == ']') {
+            return regex + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *
+skipGroup(const char *regex)
+{
+    unsigned int depth = 0;
+
+    while (*regex) {
+        switch (*regex) {
+        case '(':
+            depth++;
+            regex++;
+            break;
+
+        case ')':
+            regex++;
+            if (--depth == 0) {
+                return regex;
+            }
+            break;
+
+        case '[':
+            regex = skipClass(regex);
+            if (!regex) {
+                return NULL;
+            }
+            break;
+
+        case '\\':
+            if (regex[1] == '\0') {
+                return NULL;
+            }
+            regex += 2;
+            break;
+
+        default: regex++; break;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+endRun(const char *run, size_t *run_len, grrLiteral *literal)
+{
+    if (*run_len > literal->len) {
+        memcpy(literal->string, run, *run_len);
+        literal->string[*run_len] = '\0';
+        literal->len = *run_len;
+    }
+    *run_len = 0;
+}
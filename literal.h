@@ -0,0 +1,56 @@
+#ifndef GRR_LITERAL_H
+#define GRR_LITERAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The longest literal which must appear in any line matched by a regex.  If no such literal could be found,
+ * len is 0.
+ */
+typedef struct grrLiteral {
+    char *string;
+    size_t len;
+} grrLiteral;
+
+/*
+ * Extracts the required literal from a regex.  The analysis is conservative: anything whose meaning isn't
+ * certain (e.g., alternations at the top level, character classes, escape sequences other than escaped
+ * punctuation) ends the current run of literal characters rather than guessing.
+ */
+int
+grrExtractLiteral(const char *regex, grrLiteral *literal);
+
+void
+grrFreeLiteral(grrLiteral *literal);
+
+/*
+ * Determines whether every top-level alternative of a regex starts with the start-of-line anchor, so that it can
+ * only match at the start of a line.
+ */
+bool
+grrIsAnchored(const char *regex);
+
+/*
+ * Determines whether a regex which isn't anchored might still use the start-of-line anchor or a word boundary.
+ * Such a regex can't be matched against the rest of a line, after an earlier match, as though the rest were a
+ * line of its own.  Anything uncertain counts as needing the context.
+ */
+bool
+grrNeedsContext(const char *regex);
+
+/*
+ * Rewrites a regex so that it matches regardless of (ASCII) case.  Every letter outside of a character class
+ * becomes a class of both of its cases and the other case of every letter within a class is added to the
+ * class.  Escape sequences and repetition counts are copied as they are.  The caller has to free *folded.
+ */
+int
+grrFoldCase(const char *regex, char **folded);
+
+/*
+ * Lowercases a literal so that it can be searched for with grrFindLiteralFold.
+ */
+void
+grrLowercaseLiteral(grrLiteral *literal);
+
+#endif  // GRR_LITERAL_H
@@ -1,4 +1,5 @@
-#include <dirent.h>
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -12,48 +13,49 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-#include "engine/include/nfa.h"
-
-#define GRR_VERSION "2.1.7"
-#define GRR_HISTORY ".grr_history"
-
-#ifndef MIN
-#define MIN(a, b) (((a) < (b)) ? (a) : (b))
-#endif
-
-enum grrAppRetValue {
-    GRR_APP_RET_OK = 0,
-    GRR_APP_RET_DONE,
-    GRR_APP_RET_FILE_ACCESS,
-    GRR_APP_RET_NOT_FOUND,
-    GRR_APP_RET_OUT_OF_MEMORY,
-    GRR_APP_RET_BAD_DATA,
-    GRR_APP_RET_OVERFLOW,
-    GRR_APP_RET_EXEC,
-    GRR_APP_RET_OTHER,
+#include "grr.h"
+#include "serve.h"
+
+enum grrLongOption {
+    GRR_OPTION_INDEX = 256,
+    GRR_OPTION_CACHE_RESULTS,
+    GRR_OPTION_FD,
+    GRR_OPTION_EXCLUDE_DIR,
+    GRR_OPTION_MIN_SIZE,
+    GRR_OPTION_MAX_SIZE,
+    GRR_OPTION_NEWER,
+    GRR_OPTION_OLDER,
+    GRR_OPTION_SKIP_EMPTY,
+    GRR_OPTION_STATS,
+    GRR_OPTION_IO_DEPTH,
+    GRR_OPTION_SERVE,
+    GRR_OPTION_CONNECT,
+    GRR_OPTION_FULL_LINE,
+    GRR_OPTION_ALL_MATCHES,
+    GRR_OPTION_COUNT,
+    GRR_OPTION_ONLY_MATCHING,
 };
 
-typedef struct grrOptions {
-    char *starting_directory;
-    char *editor;
-    FILE *logger;
-    grrNfa search_pattern;
-    grrNfa file_pattern;
-    long depth;
-    long line_no;
-    unsigned int names_only : 1;
-    unsigned int verbose : 1;
-    unsigned int ignore_hidden : 1;
-    unsigned int no_history : 1;
-    unsigned int colorless : 1;
-} grrOptions;
-
-typedef struct grrSimpleOptions {
-    long depth;
-    unsigned int file_pattern : 1;
-    unsigned int names_only : 1;
-    unsigned int ignore_hidden : 1;
-} grrSimpleOptions;
+static const struct option long_options[] = {
+    {"index", no_argument, NULL, GRR_OPTION_INDEX},
+    {"cache-results", no_argument, NULL, GRR_OPTION_CACHE_RESULTS},
+    {"fd", required_argument, NULL, GRR_OPTION_FD},
+    {"exclude-dir", required_argument, NULL, GRR_OPTION_EXCLUDE_DIR},
+    {"min-size", required_argument, NULL, GRR_OPTION_MIN_SIZE},
+    {"max-size", required_argument, NULL, GRR_OPTION_MAX_SIZE},
+    {"newer", required_argument, NULL, GRR_OPTION_NEWER},
+    {"older", required_argument, NULL, GRR_OPTION_OLDER},
+    {"skip-empty", no_argument, NULL, GRR_OPTION_SKIP_EMPTY},
+    {"stats", optional_argument, NULL, GRR_OPTION_STATS},
+    {"io-depth", required_argument, NULL, GRR_OPTION_IO_DEPTH},
+    {"serve", no_argument, NULL, GRR_OPTION_SERVE},
+    {"connect", no_argument, NULL, GRR_OPTION_CONNECT},
+    {"full-line", no_argument, NULL, GRR_OPTION_FULL_LINE},
+    {"all-matches", no_argument, NULL, GRR_OPTION_ALL_MATCHES},
+    {"count", no_argument, NULL, GRR_OPTION_COUNT},
+    {"only-matching", no_argument, NULL, GRR_OPTION_ONLY_MATCHING},
+    {NULL, 0, NULL, 0},
+};
 
 static char tmp_file[PATH_MAX];
 
@@ -63,38 +65,42 @@ unlinkTmpFile(void);
 static int
 parseOptions(int argc, char **argv, grrOptions *options);
 
-static void
-usage(const char *executable);
-
 static int
-isExecutable(const char *path);
+appendGlob(char **globs, const char *glob, size_t len);
 
 static int
-compareOptionsToHistory(const grrOptions *options);
+parseSize(const char *arg, off_t *size);
 
-static bool
-readLine(FILE *f, char *destination, size_t size);
+static int
+parseTime(const char *arg, time_t *time_out);
 
 static int
-searchDirectoryTree(DIR *dir, char *path, size_t offset, long depth, long *line_no,
-                    const grrOptions *options);
+readPatternFile(grrOptions *options, const char *path);
 
 static int
-searchFileForPattern(const char *path, long *line_no, const grrOptions *options);
+foldPatterns(grrOptions *options);
+
+static void
+usage(const char *executable);
 
 static int
-executeEditor(const char *editor, const char *path, long line_no, bool verbose);
+isExecutable(const char *path);
 
 int
 main(int argc, char **argv)
 {
     int ret;
     long line_no;
+    uint64_t start;
     grrOptions options = {0};
+    grrStats stats = {0};
+    grrOutput output = {.fd = -1};
+    grrHistory history;
     char path[PATH_MAX];
-    DIR *dir;
+    grrDirectory dir;
 
     options.starting_directory = path;
+    start = grrStatsStart(&stats);
 
     ret = parseOptions(argc, argv, &options);
     if (ret != GRR_APP_RET_OK) {
@@ -104,6 +110,23 @@ main(int argc, char **argv)
         goto done;
     }
 
+    if (options.build_index) {
+        ret = grrIndexBuild(&options);
+        goto done;
+    }
+
+    if (options.serve) {
+        ret = grrServe(&options);
+        goto done;
+    }
+
+    ret = grrOutputInit(&output, STDOUT_FILENO);
+    if (ret != GRR_APP_RET_OK) {
+        fprintf(stderr, "Ran out of memory while allocating the output buffer.\n");
+        goto done;
+    }
+    options.output = &output;
+
     if (!isatty(STDOUT_FILENO)) {
         options.colorless = true;
     }
@@ -123,7 +146,7 @@ main(int argc, char **argv)
         }
 
         if (!options.no_history) {
-            ret = compareOptionsToHistory(&options);
+            ret = grrHistoryOpenResult(&options);
             // This check is not a typo.  If ret is GRR_APP_RET_OK, that means we can use the history file
             // and therefore can skip past the directory search logic.
             if (ret == GRR_APP_RET_OK) {
@@ -133,7 +156,6 @@ main(int argc, char **argv)
     }
     else if (!options.no_history) {
         int fd;
-        char starting_directory[PATH_MAX];
         char *home;
 
         options.editor = NULL;
@@ -154,65 +176,142 @@ main(int argc, char **argv)
         }
         atexit(unlinkTmpFile);
 
-        options.logger = fdopen(fd, "wb");
-        if (!options.logger) {
+        ret = grrHistoryCreate(&history, fd, &options);
+        if (ret != GRR_APP_RET_OK) {
             if (options.verbose) {
-                fprintf(stderr, "fdopen failed when creating history file: %s\n", strerror(errno));
+                fprintf(stderr, "Failed to create history file.\n");
             }
 
             close(fd);
-            ret = GRR_APP_RET_OUT_OF_MEMORY;
             goto done;
         }
+        options.history = &history;
+    }
 
-        fprintf(options.logger, "%s\n", grrDescription(options.search_pattern));
+    if (options.stats_requested) {
+        options.stats = &stats;
+    }
 
-        if (!realpath(path, starting_directory)) {
-            perror("realpath");
-            ret = GRR_APP_RET_OTHER;
-            goto done;
-        }
-        fprintf(options.logger, "%s\n", starting_directory);
+    if (options.stream) {
+        grrSearchState state;
+        grrResultSet results = {0};
+        char name[32];
 
-        if (options.file_pattern) {
-            fprintf(options.logger, "f");
+        if (options.stream_fd == STDIN_FILENO) {
+            snprintf(name, sizeof(name), "<stdin>");
         }
-        if (options.names_only) {
-            fprintf(options.logger, "n");
-        }
-        if (options.ignore_hidden) {
-            fprintf(options.logger, "i");
+        else {
+            snprintf(name, sizeof(name), "<fd %i>", options.stream_fd);
         }
-        if (options.depth != -1) {
-            fprintf(options.logger, "p");
+
+        ret = initSearchState(&state, &options, false);
+        if (ret == GRR_APP_RET_OK) {
+            line_no = -1;
+            ret = searchStream(options.stream_fd, name, &line_no, &state, &results, &options);
+            freeSearchState(&state);
         }
-        fprintf(options.logger, "\n");
+        freeResultSet(&results);
+        goto done;
+    }
 
-        if (options.file_pattern) {
-            fprintf(options.logger, "%s\n", grrDescription(options.file_pattern));
+    if (options.connect) {
+        line_no = -1;
+        ret = grrServeQuery(&options, &line_no);
+        if (ret != GRR_APP_RET_NOT_FOUND) {
+            goto done;
         }
 
-        if (options.depth != -1) {
-            fprintf(options.logger, "%li\n", options.depth);
+        if (options.verbose) {
+            fprintf(stderr, "Searching %s directly instead of through the server.\n", path);
         }
+        ret = analyzePatterns(&options);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+    }
+
+    // The index is only an optimization so the search goes ahead without it if it can't be loaded.
+    if (grrIndexLoad(path, options.patterns, options.num_patterns, &options.index) == GRR_APP_RET_OK &&
+        options.verbose) {
+        fprintf(stderr, "Using the index in %s.\n", path);
+    }
+
+    // Opening a result stops the search early, which would leave the cache with only part of the tree.
+    if (options.cache_results && !options.editor &&
+        grrResultCacheOpen(&options, &options.result_cache) != GRR_APP_RET_OK && options.verbose) {
+        fprintf(stderr, "Failed to open the result cache.\n");
     }
 
-    dir = opendir(path);
-    if (!dir) {
+    if (grrDirectoryOpen(&dir, AT_FDCWD, path, NULL) != GRR_APP_RET_OK) {
         fprintf(stderr, "Failed to access starting directory.\n");
         ret = GRR_APP_RET_FILE_ACCESS;
         goto done;
     }
     line_no = -1;
-    searchDirectoryTree(dir, path, strlen(path), -1, &line_no, &options);
-    closedir(dir);
+    if (options.num_threads > 1) {
+        ret = searchDirectoryTreeParallel(&dir, path, &line_no, &options);
+        if (ret == GRR_APP_RET_DONE) {
+            ret = GRR_APP_RET_OK;
+        }
+    }
+    else {
+        grrSearchState state;
+        grrResultSet results = {0};
+
+        ret = initSearchState(&state, &options, false);
+        if (ret != GRR_APP_RET_OK) {
+            grrDirectoryClose(&dir);
+            goto done;
+        }
+        // Files whose results are cached aren't opened at all so reading them ahead would be wasted.
+        if (options.io_depth > 1 && !options.result_cache) {
+            if (grrPrefetcherCreate(options.io_depth, &state.prefetcher) != GRR_APP_RET_OK) {
+                state.prefetcher = NULL;
+                if (options.verbose) {
+                    fprintf(stderr, "Failed to set up the file prefetcher.\n");
+                }
+            }
+            else if (options.verbose) {
+                fprintf(stderr, "Reading up to %li files ahead using %s.\n", options.io_depth,
+                        grrPrefetcherBackend(state.prefetcher));
+            }
+        }
+        searchDirectoryTree(&dir, path, strlen(path), -1, NULL, &line_no, &state, &results, &options);
+        freeResultSet(&results);
+        freeSearchState(&state);
+    }
+    grrDirectoryClose(&dir);
 
 done:
 
-    grrFreeNfa(options.search_pattern);
+    freePatterns(&options);
     grrFreeNfa(options.file_pattern);
-    if (options.logger) {
-        fclose(options.logger);
+    grrIndexFree(options.index);
+    grrIgnoreRelease(options.exclude_dirs);
+    free(options.exclude_dir_globs);
+    if (grrOutputClose(&output) != GRR_APP_RET_OK && ret == GRR_APP_RET_OK) {
+        ret = GRR_APP_RET_FILE_ACCESS;
+    }
+    // The report comes after the results have been flushed so that the two don't interleave on a terminal.
+    if (options.stats) {
+        grrStatsPrint(&stats, grrStatsStart(&stats) - start, options.num_threads, options.stats_json);
+    }
+    if (options.result_cache && grrResultCacheClose(options.result_cache) != GRR_APP_RET_OK && options.verbose) {
+        fprintf(stderr, "Failed to store the results in the cache.\n");
+    }
+    if (options.history) {
+        int fd = history.output.fd;
+
+        // A history file which couldn't be written completely isn't kept.
+        if (grrHistoryFinish(&history) != GRR_APP_RET_OK) {
+            if (options.verbose) {
+                fprintf(stderr, "Failed to write the history file.\n");
+            }
+            if (ret == GRR_APP_RET_OK) {
+                ret = GRR_APP_RET_FILE_ACCESS;
+            }
+        }
+        close(fd);
 
         if (ret == GRR_APP_RET_OK) {
             const char *home;
@@ -258,9 +357,11 @@ parseOptions(int argc, char **argv, grrOptions *options)
 {
     int ret, optval;
 
-    options->search_pattern = NULL;
     options->depth = -1;
     options->line_no = -1;
+    options->num_threads = 1;
+    options->io_depth = GRR_PREFETCH_DEFAULT_DEPTH;
+    options->filter.max_size = -1;
     sprintf(options->starting_directory, "./");
 
     if (argc == 1) {
@@ -268,15 +369,22 @@ parseOptions(int argc, char **argv, grrOptions *options)
         return GRR_APP_RET_BAD_DATA;
     }
 
-    while ((optval = getopt(argc, argv, ":r:d:p:f:e:l:niycvuh")) != -1) {
+    while ((optval = getopt_long(argc, argv, ":r:R:d:p:f:e:l:j:A:B:C:sniIagycvuh", long_options, NULL)) != -1) {
         struct stat file_stat;
         char *temp;
+        long num_lines;
 
         switch (optval) {
         case 'r':
-            ret = grrCompile(argv[optind - 1], strlen(argv[optind - 1]), &options->search_pattern);
+            ret = addPattern(options, argv[optind - 1]);
+            if (ret != GRR_APP_RET_OK) {
+                return ret;
+            }
+            break;
+
+        case 'R':
+            ret = readPatternFile(options, optarg);
             if (ret != GRR_APP_RET_OK) {
-                fprintf(stderr, "Could not compile pattern.\n");
                 return ret;
             }
             break;
@@ -329,10 +437,44 @@ parseOptions(int argc, char **argv, grrOptions *options)
                 fprintf(stderr, "Could not compile file pattern.\n");
                 return ret;
             }
+            options->file_regex = optarg;
             break;
 
         case 'e': options->editor = optarg; break;
 
+        case 'A':
+        case 'B':
+        case 'C':
+            errno = 0;
+            num_lines = strtol(optarg, &temp, 10);
+            if (errno != 0 || temp == optarg || temp[0] != '\0' || num_lines < 0) {
+                fprintf(stderr, "Invalid '%c' option: %s\n", optval, optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            if (optval != 'B') {
+                options->after_context = num_lines;
+            }
+            if (optval != 'A') {
+                options->before_context = num_lines;
+            }
+            break;
+
+        case 'j':
+            errno = 0;
+            options->num_threads = strtol(optarg, &temp, 10);
+            if (errno != 0 || temp == optarg || temp[0] != '\0' || options->num_threads < 0 ||
+                options->num_threads > GRR_MAX_THREADS) {
+                fprintf(stderr, "Invalid 'j' option: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            if (options->num_threads == 0) {
+                options->num_threads = MIN(sysconf(_SC_NPROCESSORS_ONLN), GRR_MAX_THREADS);
+                if (options->num_threads < 1) {
+                    options->num_threads = 1;
+                }
+            }
+            break;
+
         case 'l':
             errno = 0;
             options->line_no = strtol(optarg, &temp, 10);
@@ -342,10 +484,21 @@ parseOptions(int argc, char **argv, grrOptions *options)
             }
             break;
 
+        case 's':
+            options->stream = true;
+            options->stream_fd = STDIN_FILENO;
+            break;
+
         case 'n': options->names_only = true; break;
 
         case 'i': options->ignore_hidden = true; break;
 
+        case 'I': options->fold_case = true; break;
+
+        case 'a': options->binary_as_text = true; break;
+
+        case 'g': options->ignore_files = true; break;
+
         case 'y': options->no_history = true; break;
 
         case 'c': options->colorless = true; break;
@@ -356,492 +509,608 @@ parseOptions(int argc, char **argv, grrOptions *options)
 
         case 'h': usage(argv[0]); return GRR_APP_RET_DONE;
 
-        case '?': fprintf(stderr, "Invalid option: %c\n", optopt); return GRR_APP_RET_BAD_DATA;
+        case GRR_OPTION_INDEX: options->build_index = true; break;
 
-        case ':': fprintf(stderr, "-%c requires an argument.\n", optopt); return GRR_APP_RET_BAD_DATA;
+        case GRR_OPTION_CACHE_RESULTS: options->cache_results = true; break;
 
-        default: abort();
-        }
-    }
+        case GRR_OPTION_FD: {
+            long fd;
 
-    if (!options->search_pattern) {
-        fprintf(stderr, "No search pattern was provided.\n");
-        return GRR_APP_RET_BAD_DATA;
-    }
+            errno = 0;
+            fd = strtol(optarg, &temp, 10);
+            if (errno != 0 || temp == optarg || temp[0] != '\0' || fd < 0 || fd > INT_MAX ||
+                fcntl(fd, F_GETFD) == -1) {
+                fprintf(stderr, "Invalid file descriptor: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            options->stream = true;
+            options->stream_fd = fd;
+        } break;
 
-    return GRR_APP_RET_OK;
-}
+        case GRR_OPTION_EXCLUDE_DIR: {
+            size_t len = strlen(optarg);
 
-static void
-usage(const char *executable)
-{
-    printf("Usage: %s [options]\n", executable);
-    printf("Options:\n");
-    printf("\t-r <pattern>        -- Specify the search regex.  Required unless either -u or -h are\n");
-    printf("\t                       specified.\n");
-    printf("\t-d <directory>      -- Specify the staring directory.  Defaults to the current directory.\n");
-    printf("\t-p <depth>          -- Specify the directory search maximum depth.  Defaults to infinite.\n");
-    printf("\t                       A value of 0 means that only the starting directory is searched.\n");
-    printf("\t-f <file-pattern>   -- Only examine files whose names (excluding the directory) match this\n");
-    printf("\t                       regex.\n");
-    printf("\t-e <editor>         -- When used in conjunction with -l, specify the editor for opening\n");
-    printf("\t                       files.  Defaults to the EDITOR environment variable or vi/vim if\n");
-    printf("\t                       that is unset.\n");
-    printf("\t-l <result-number>  -- Open up the file specified in the l^th result.\n");
-    printf("\t-n                  -- Display only the file names and not the individual lines within\n");
-    printf("\t                       them.\n");
-    printf("\t-i                  -- Ignore hidden files and directories.\n");
-    printf("\t-y                  -- Neither read from nor write to the history file.\n");
-    printf("\t-c                  -- Remove color from the output text.\n");
-    printf("\t-v                  -- Print verbose output to stderr.\n");
-    printf("\t-u                  -- Print Grr's version.\n");
-    printf("\t-h                  -- Print this message.\n");
-}
+            // The globs are matched against directory names so a slash is only allowed at the end.
+            if (len == 0 || memchr(optarg, '/', len - 1)) {
+                fprintf(stderr, "Invalid --exclude-dir glob: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            if (grrIgnoreAddRule(&options->exclude_dirs, optarg, 0) != GRR_APP_RET_OK ||
+                appendGlob(&options->exclude_dir_globs, optarg, len) != GRR_APP_RET_OK) {
+                fprintf(stderr, "Ran out of memory while adding the --exclude-dir glob.\n");
+                return GRR_APP_RET_OUT_OF_MEMORY;
+            }
+        } break;
+
+        case GRR_OPTION_MIN_SIZE:
+        case GRR_OPTION_MAX_SIZE:
+            if (parseSize(optarg, (optval == GRR_OPTION_MIN_SIZE) ? &options->filter.min_size :
+                                                                     &options->filter.max_size) !=
+                GRR_APP_RET_OK) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            options->filter_files = true;
+            break;
 
-static int
-isExecutable(const char *path)
-{
-    int ret;
-    char line[PATH_MAX + 6];
-    FILE *f;
+        case GRR_OPTION_NEWER:
+            if (parseTime(optarg, &options->filter.newer_than) != GRR_APP_RET_OK) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            options->filter_files = true;
+            break;
 
-    if (access(path, X_OK) == 0) {
-        return GRR_APP_RET_OK;
-    }
+        case GRR_OPTION_OLDER:
+            if (parseTime(optarg, &options->filter.older_than) != GRR_APP_RET_OK) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            options->filter_files = true;
+            break;
 
-    if (snprintf(line, sizeof(line), "which %s", path) >= (ssize_t)sizeof(line)) {
-        return GRR_APP_RET_OVERFLOW;
-    }
+        case GRR_OPTION_SKIP_EMPTY:
+            options->filter.min_size = MAX(options->filter.min_size, 1);
+            options->filter_files = true;
+            break;
 
-    f = popen(line, "r");
-    if (!f) {
-        return GRR_APP_RET_OUT_OF_MEMORY;
-    }
+        case GRR_OPTION_STATS:
+            if (optarg && strcmp(optarg, "json") != 0) {
+                fprintf(stderr, "Invalid --stats format: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            options->stats_requested = true;
+            options->stats_json = !!optarg;
+            break;
 
-    if (fgets(line, sizeof(line), f)) {
-        ret = line[0] ? GRR_APP_RET_OK : GRR_APP_RET_NOT_FOUND;
-    }
-    else {
-        ret = GRR_APP_RET_FILE_ACCESS;
-    }
-    pclose(f);
+        case GRR_OPTION_SERVE: options->serve = true; break;
 
-    return ret;
-}
+        case GRR_OPTION_CONNECT: options->connect = true; break;
 
-static int
-compareOptionsToHistory(const grrOptions *options)
-{
-    int ret = GRR_APP_RET_BAD_DATA;
-    size_t len;
-    const char *home;
-    char history_file[50], line[PATH_MAX + 10], absolute_starting_directory[PATH_MAX];
-    FILE *f;
-    grrSimpleOptions observed_options = {.depth = -1};
+        case GRR_OPTION_FULL_LINE: options->full_line = true; break;
 
-    home = getenv("HOME");
-    if (!home) {
-        if (options->verbose) {
-            fprintf(stderr, "The HOME environment variable is unset.\n");
-        }
+        case GRR_OPTION_ALL_MATCHES: options->all_matches = true; break;
 
-        return GRR_APP_RET_OTHER;
-    }
-    if (snprintf(history_file, sizeof(history_file), "%s/%s", home, GRR_HISTORY) >=
-        (ssize_t)sizeof(history_file)) {
-        if (options->verbose) {
-            fprintf(stderr, "%s/%s was too big for the buffer.\n", home, GRR_HISTORY);
-        }
+        case GRR_OPTION_COUNT: options->count_matches = true; break;
 
-        return GRR_APP_RET_OVERFLOW;
-    }
+        case GRR_OPTION_ONLY_MATCHING: options->only_matching = true; break;
 
-    if (access(history_file, F_OK) != 0) {
-        return GRR_APP_RET_OK;
-    }
+        case GRR_OPTION_IO_DEPTH:
+            errno = 0;
+            options->io_depth = strtol(optarg, &temp, 10);
+            if (errno != 0 || temp == optarg || temp[0] != '\0' || options->io_depth < 0 ||
+                options->io_depth > GRR_PREFETCH_MAX_DEPTH) {
+                fprintf(stderr, "Invalid --io-depth option: %s\n", optarg);
+                return GRR_APP_RET_BAD_DATA;
+            }
+            break;
 
-    f = fopen(history_file, "rb");
-    if (!f) {
-        if (options->verbose) {
-            fprintf(stderr, "Failed to open %s: %s\n", history_file, strerror(errno));
-        }
+        case '?':
+            if (optopt) {
+                fprintf(stderr, "Invalid option: %c\n", optopt);
+            }
+            else {
+                fprintf(stderr, "Invalid option: %s\n", argv[optind - 1]);
+            }
+            return GRR_APP_RET_BAD_DATA;
 
-        return GRR_APP_RET_FILE_ACCESS;
-    }
+        case ':':
+            if (optopt < GRR_OPTION_INDEX) {
+                fprintf(stderr, "-%c requires an argument.\n", optopt);
+            }
+            else {
+                fprintf(stderr, "%s requires an argument.\n", argv[optind - 1]);
+            }
+            return GRR_APP_RET_BAD_DATA;
 
-    if (!readLine(f, line, sizeof(line))) {
-        goto failed_read;
+        default: abort();
+        }
     }
-    if (strcmp(line, grrDescription(options->search_pattern)) != 0) {
-        goto done;
+
+    if (options->build_index) {
+        // The index has to cover every file in order to be used by later searches.
+        options->filter_files = false;
+        return GRR_APP_RET_OK;
     }
 
-    if (!readLine(f, line, sizeof(line))) {
-        goto failed_read;
+    if (options->serve) {
+        return GRR_APP_RET_OK;
     }
 
-    if (!realpath(options->starting_directory, absolute_starting_directory)) {
-        if (options->verbose) {
-            fprintf(stderr, "Failed to resolve absolute path of starting directory.\n");
+    if (options->stream) {
+        if (options->line_no >= 0) {
+            fprintf(stderr, "-l cannot be used when searching a stream.\n");
+            return GRR_APP_RET_BAD_DATA;
         }
-
-        ret = GRR_APP_RET_OTHER;
-        goto done;
+        // A stream can't be read a second time so there's no point in recording its results.
+        options->no_history = true;
+        options->connect = false;
     }
 
-    if (strcmp(line, absolute_starting_directory) != 0) {
-        goto done;
+    if (options->num_patterns == 0) {
+        fprintf(stderr, "No search pattern was provided.\n");
+        return GRR_APP_RET_BAD_DATA;
     }
 
-    if (!readLine(f, line, sizeof(line))) {
-        goto failed_read;
+    // -n reports each file once so there's nothing to count.
+    if (options->names_only) {
+        options->count_matches = false;
+        options->only_matching = false;
+    }
+    if (options->count_matches) {
+        options->only_matching = false;
+    }
+    if (options->only_matching) {
+        options->all_matches = true;
     }
 
-    len = strlen(line);
-    for (size_t k = 0; k < len; k++) {
-        switch (line[k]) {
-        case 'f': observed_options.file_pattern = true; break;
-
-        case 'n': observed_options.names_only = true; break;
-
-        case 'i': observed_options.ignore_hidden = true; break;
-
-        case 'p': observed_options.depth = 0; break;
-
-        default:
-            if (options->verbose) {
-                fprintf(stderr, "Skipping unsupported option: '%c'\n", line[k]);
+    // Every match after the first is found by searching the rest of the line on its own, which would give the
+    // wrong matches for a regex that looks at what comes before them.
+    if (options->all_matches && !options->names_only) {
+        for (size_t k = 0; k < options->num_patterns; k++) {
+            if (options->patterns[k].needs_context) {
+                fprintf(stderr, "--all-matches and --only-matching cannot be used with a regex which uses ^ "
+                                "other than at the start or a word boundary: %s\n",
+                        options->patterns[k].regex);
+                return GRR_APP_RET_BAD_DATA;
             }
-            break;
         }
     }
 
-    if (observed_options.names_only != options->names_only) {
-        goto done;
+    // The server analyzes the patterns itself so they're only analyzed here if the search is done locally.
+    if (options->connect) {
+        return GRR_APP_RET_OK;
     }
 
-    if (observed_options.ignore_hidden != options->ignore_hidden) {
-        goto done;
-    }
+    return analyzePatterns(options);
+}
 
-    if (observed_options.file_pattern) {
-        if (!options->file_pattern) {
-            goto done;
-        }
+/*
+ * Adds a glob to a string of slash-separated globs, which is allocated if *globs is NULL.  Since a glob can only
+ * end with a slash, the string is unambiguous.
+ */
+static int
+appendGlob(char **globs, const char *glob, size_t len)
+{
+    size_t globs_len = *globs ? strlen(*globs) : 0;
+    char *new_globs;
 
-        if (!readLine(f, line, sizeof(line))) {
-            goto failed_read;
-        }
-        if (strcmp(line, grrDescription(options->file_pattern)) != 0) {
-            goto done;
-        }
+    new_globs = realloc(*globs, globs_len + len + 2);
+    if (!new_globs) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
     }
-    else if (options->file_pattern) {
-        goto done;
+    if (globs_len > 0) {
+        new_globs[globs_len++] = '/';
     }
+    memcpy(new_globs + globs_len, glob, len + 1);
+    *globs = new_globs;
 
-    if (observed_options.depth != -1) {
-        char *temp;
-
-        if (options->depth == -1) {
-            goto done;
-        }
-
-        if (!readLine(f, line, sizeof(line))) {
-            goto failed_read;
-        }
+    return GRR_APP_RET_OK;
+}
 
-        errno = 0;
-        observed_options.depth = strtol(line, &temp, 10);
-        if (errno != 0 || temp == line || temp[0] != '\0') {
-            if (options->verbose) {
-                fprintf(stderr, "Invalid depth (%s) found in %s.\n", line, history_file);
-            }
-            goto done;
-        }
+/*
+ * Parses a number of bytes with an optional K, M, G, or T suffix (powers of 1024).
+ */
+static int
+parseSize(const char *arg, off_t *size)
+{
+    int shift = 0;
+    long long value;
+    char *end;
 
-        if (observed_options.depth != options->depth) {
-            goto done;
-        }
+    errno = 0;
+    value = strtoll(arg, &end, 10);
+    if (errno != 0 || end == arg || value < 0) {
+        return GRR_APP_RET_BAD_DATA;
     }
 
-    for (long k = 0; k <= options->line_no; k++) {
-        if (!readLine(f, line, sizeof(line))) {
-            goto failed_read;
-        }
+    switch (*end) {
+    case 'T':
+    case 't': shift += 10; // fall through
+    case 'G':
+    case 'g': shift += 10; // fall through
+    case 'M':
+    case 'm': shift += 10; // fall through
+    case 'K':
+    case 'k':
+        shift += 10;
+        end++;
+        break;
+
+    default: break;
     }
-
-    if (observed_options.names_only) {
-        ret = executeEditor(options->editor, line, 1, options->verbose);
+    if (*end != '\0' || value > (LLONG_MAX >> shift)) {
+        return GRR_APP_RET_BAD_DATA;
     }
-    else {
-        char *colon_ptr, *temp;
-        long line_no;
-
-        colon_ptr = strstr(line, ":");
-        if (!colon_ptr || colon_ptr[1] == '\0') {
-            if (options->verbose) {
-                fprintf(stderr, "No ':' found for result '%s' in %s.\n", line, history_file);
-            }
-            goto done;
-        }
 
-        line[colon_ptr - (char *)line] = '\0';
-        line_no = strtol(colon_ptr + 1, &temp, 10);
-        if (temp[0] != '\0' || (line_no == LONG_MAX && errno == ERANGE) || line_no < 1) {
-            if (options->verbose) {
-                fprintf(stderr, "Invalid line number found for result '%s' in %s.\n", line, history_file);
-            }
+    *size = (off_t)(value << shift);
+    return GRR_APP_RET_OK;
+}
 
-            goto done;
+/*
+ * Parses either an age (a number followed by s, m, h, d, or w), which is subtracted from the current time, or a
+ * local date in the form YYYY-MM-DD optionally followed by HH:MM or HH:MM:SS.
+ */
+static int
+parseTime(const char *arg, time_t *time_out)
+{
+    static const char *const formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+    long long value;
+    long unit;
+    char *end;
+    struct tm tm;
+
+    errno = 0;
+    value = strtoll(arg, &end, 10);
+    if (errno == 0 && end != arg && value >= 0 && end[0] != '\0' && end[1] == '\0') {
+        switch (end[0]) {
+        case 's': unit = 1; break;
+        case 'm': unit = 60; break;
+        case 'h': unit = 60 * 60; break;
+        case 'd': unit = 24 * 60 * 60; break;
+        case 'w': unit = 7 * 24 * 60 * 60; break;
+        default: return GRR_APP_RET_BAD_DATA;
+        }
+        if (value > (long long)(time(NULL) / unit)) {
+            return GRR_APP_RET_BAD_DATA;
         }
 
-        ret = executeEditor(options->editor, line, line_no, options->verbose);
+        // The history's query records the resolved time so -l only reuses a run which resolved the same time.
+        *time_out = time(NULL) - value * unit;
+        return GRR_APP_RET_OK;
     }
-    goto done;
 
-failed_read:
-
-    if (options->verbose) {
-        if (ferror(f)) {
-            fprintf(stderr, "Failed to read from %s.\n", history_file);
-        }
-        else {
-            fprintf(stderr, "Unexpected end of file found in %s.\n", history_file);
+    for (size_t k = 0; k < sizeof(formats) / sizeof(formats[0]); k++) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(arg, formats[k], &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            *time_out = mktime(&tm);
+            return (*time_out > 0) ? GRR_APP_RET_OK : GRR_APP_RET_BAD_DATA;
         }
     }
-    ret = GRR_APP_RET_FILE_ACCESS;
-
-done:
-
-    fclose(f);
 
-    return ret;
+    return GRR_APP_RET_BAD_DATA;
 }
 
-static bool
-readLine(FILE *f, char *destination, size_t size)
+int
+addPattern(grrOptions *options, const char *regex)
 {
-    size_t len;
+    int ret;
+    grrPattern *pattern, *success;
+
+    success = realloc(options->patterns, (options->num_patterns + 1) * sizeof(*options->patterns));
+    if (!success) {
+        fprintf(stderr, "Ran out of memory while adding the pattern.\n");
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    options->patterns = success;
+    pattern = options->patterns + options->num_patterns;
+    *pattern = (grrPattern){0};
 
-    if (!fgets(destination, size, f)) {
-        return false;
+    ret = grrCompile(regex, strlen(regex), &pattern->nfa);
+    if (ret != GRR_APP_RET_OK) {
+        fprintf(stderr, "Could not compile pattern.\n");
+        return ret;
     }
-    len = strlen(destination);
-    if (len == 0) {
-        return false;
+
+    pattern->regex = strdup(regex);
+    if (!pattern->regex || grrExtractLiteral(regex, &pattern->literal) != GRR_APP_RET_OK) {
+        fprintf(stderr, "Ran out of memory while analyzing the pattern.\n");
+        free(pattern->regex);
+        grrFreeNfa(pattern->nfa);
+        return GRR_APP_RET_OUT_OF_MEMORY;
     }
 
-    destination[len - 1] = '\0';
-    return true;
+    pattern->search_regex = pattern->regex;
+    pattern->anchored = grrIsAnchored(regex);
+    pattern->needs_context = grrNeedsContext(regex);
+
+    options->num_patterns++;
+    return GRR_APP_RET_OK;
 }
 
 static int
-searchDirectoryTree(DIR *dir, char *path, size_t offset, long depth, long *line_no,
-                    const grrOptions *options)
+readPatternFile(grrOptions *options, const char *path)
 {
     int ret = GRR_APP_RET_OK;
-    size_t new_len;
-    struct dirent *entry;
-
-    while ((entry = readdir(dir))) {
-        struct stat file_stat;
-
-        if (entry->d_name[0] == '.') {
-            if (options->ignore_hidden || entry->d_name[1] == '\0' ||
-                (entry->d_name[1] == '.' && entry->d_name[2] == '\0')) {
-                continue;
-            }
-        }
+    size_t size = 0;
+    ssize_t len;
+    char *line = NULL;
+    FILE *f;
 
-        path[offset] = '\0';
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return GRR_APP_RET_FILE_ACCESS;
+    }
 
-        strncat(path, entry->d_name, PATH_MAX);
-        new_len = strlen(path);
-        if (new_len >= PATH_MAX) {
-            if (options->verbose) {
-                path[offset] = '\0';
-                fprintf(stderr, "Skipping file in the %s directory because its name is too long.\n", path);
-            }
-            continue;
+    // Each non-empty line is a pattern.
+    while ((len = getline(&line, &size, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
         }
-
-        if (lstat(path, &file_stat) != 0) {
-            if (options->verbose) {
-                fprintf(stderr, "Could not lstat %s: %s\n", path, strerror(errno));
-            }
+        if (len == 0) {
             continue;
         }
 
-        if (S_ISREG(file_stat.st_mode)) {
-            if (options->file_pattern &&
-                grrSearch(options->file_pattern, entry->d_name, strlen(entry->d_name), NULL, NULL, NULL,
-                          false) != GRR_RET_OK) {
-                continue;
-            }
-
-            if (searchFileForPattern(path, line_no, options) == GRR_APP_RET_DONE) {
-                ret = GRR_APP_RET_DONE;
-                goto done;
-            }
+        ret = addPattern(options, line);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
         }
-        else if (S_ISDIR(file_stat.st_mode)) {
-            DIR *subdir;
-
-            if (depth + 1 == options->depth) {
-                continue;
-            }
-
-            if (new_len + 1 == PATH_MAX) {
-                if (options->verbose) {
-                    path[offset] = '\0';
-                    fprintf(stderr, "Skipping subdirectory of %s because its name is too long.\n", path);
-                }
-                continue;
-            }
-
-            path[new_len++] = '/';
-            path[new_len] = '\0';
-
-            subdir = opendir(path);
-            if (!subdir) {
-                if (options->verbose) {
-                    fprintf(stderr, "Could not access directory: %s\n", path);
-                }
-                continue;
-            }
+    }
 
-            ret = searchDirectoryTree(subdir, path, new_len, depth + 1, line_no, options);
-            closedir(subdir);
-            if (ret == GRR_APP_RET_DONE) {
-                goto done;
-            }
-            ret = GRR_APP_RET_OK;
-        }
+    if (ferror(f)) {
+        fprintf(stderr, "Failed to read from %s.\n", path);
+        ret = GRR_APP_RET_FILE_ACCESS;
     }
 
 done:
 
-    path[offset] = '\0';
+    free(line);
+    fclose(f);
 
     return ret;
 }
 
+/*
+ * Replaces each pattern's search regex and NFA with their case-insensitive forms.  The literal is still the one
+ * extracted from the original regex, only lowercased, since the folded regex has character classes where the
+ * letters were.
+ */
 static int
-searchFileForPattern(const char *path, long *line_no, const grrOptions *options)
+foldPatterns(grrOptions *options)
 {
-    int ret = GRR_APP_RET_NOT_FOUND;
-    FILE *f;
-    char line[2048];
+    int ret;
 
-    if (options->verbose) {
-        fprintf(stderr, "Opening %s.\n", path);
-    }
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        grrPattern *pattern = options->patterns + k;
+        grrNfa nfa;
+        char *folded;
 
-    f = fopen(path, "rb");
-    if (!f) {
-        if (options->verbose) {
-            fprintf(stderr, "Could not read %s.\n", path);
+        ret = grrFoldCase(pattern->regex, &folded);
+        if (ret != GRR_APP_RET_OK) {
+            fprintf(stderr, "Ran out of memory while analyzing the patterns.\n");
+            return ret;
         }
-        return GRR_APP_RET_FILE_ACCESS;
-    }
-
-    for (size_t file_line_no = 1; fgets(line, sizeof(line), f); file_line_no++) {
-        int engine_ret;
-        size_t len, start, end, offset, cursor;
-        const char change_color_to_red[] = {0x1b, '[', '9', '1', 'm', '\0'};
-        const char restore_color[] = {0x1b, '[', '0', 'm', '\0'};
 
-        len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            len--;
-        }
-        for (; len > 0 && line[len - 1] == '\r'; len--)
-            ;
-        if (len == 0) {
-            continue;
-        }
-        engine_ret = grrSearch(options->search_pattern, line, len, &start, &end, &cursor, false);
-        if (engine_ret == GRR_RET_BAD_DATA) {
-            ret = GRR_APP_RET_BAD_DATA;
-            if (options->verbose) {
-                fprintf(stderr,
-                        "Terminating processing of %s since it contains non-printable data on line "
-                        "%zu, column %zu.\n",
-                        path, file_line_no, cursor);
-            }
-            break;
+        ret = grrCompile(folded, strlen(folded), &nfa);
+        if (ret != GRR_APP_RET_OK) {
+            fprintf(stderr, "Could not compile the case-insensitive form of the pattern: %s\n", folded);
+            free(folded);
+            return ret;
         }
 
-        if (engine_ret == GRR_RET_NOT_FOUND) {
-            continue;
+        grrFreeNfa(pattern->nfa);
+        pattern->nfa = nfa;
+        if (pattern->search_regex != pattern->regex) {
+            free(pattern->search_regex);
         }
+        pattern->search_regex = folded;
+        grrLowercaseLiteral(&pattern->literal);
+    }
 
-        (*line_no)++;
+    return GRR_APP_RET_OK;
+}
 
-        if (options->editor) {
-            if (*line_no == options->line_no) {
-                executeEditor(options->editor, path, options->names_only ? 1 : file_line_no,
-                              options->verbose);
-                ret = GRR_APP_RET_DONE;
-                break;
-            }
-            else if (options->names_only) {
-                break;
-            }
-            continue;
-        }
+int
+analyzePatterns(grrOptions *options)
+{
+    int ret;
+    const char **regexes;
 
-        if (options->logger) {
-            fprintf(options->logger, "%s", path);
-            if (!options->names_only) {
-                fprintf(options->logger, ":%li", file_line_no);
-            }
-            fprintf(options->logger, "\n");
+    if (options->fold_case) {
+        ret = foldPatterns(options);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
         }
+    }
 
-        if (options->names_only) {
-            printf("(%li) %s\n", *line_no, path);
-            break;
-        }
+    regexes = malloc(options->num_patterns * sizeof(*regexes));
+    if (!regexes) {
+        fprintf(stderr, "Ran out of memory while analyzing the patterns.\n");
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        regexes[k] = options->patterns[k].search_regex;
+    }
 
-        printf("(%li) %s (line %zu): ", *line_no, path, file_line_no);
-        if (start > 10) {
-            printf("... ");
-            offset = start - 10;
+    // Parsing the regexes again is skipped if an earlier invocation already compiled them.
+    ret = grrCacheLoadProgram(regexes, options->num_patterns, &options->search_program);
+    if (ret == GRR_APP_RET_OK) {
+        if (options->verbose) {
+            fprintf(stderr, "Loaded the compiled patterns from the cache.\n");
         }
-        else {
-            offset = 0;
+        if (!options->search_program) {
+            ret = GRR_APP_RET_NOT_FOUND;
         }
-
-        printf("%.*s", (int)(start - offset), line + offset);
-        if (!options->colorless) {
-            printf("%s", change_color_to_red);
+    }
+    else if (ret != GRR_APP_RET_OUT_OF_MEMORY) {
+        ret = grrCompileProgram(regexes, options->num_patterns, &options->search_program);
+        if ((ret == GRR_APP_RET_OK || ret == GRR_APP_RET_NOT_FOUND) &&
+            grrCacheStoreProgram(regexes, options->num_patterns,
+                                 (ret == GRR_APP_RET_OK) ? options->search_program : NULL) != GRR_APP_RET_OK &&
+            options->verbose) {
+            fprintf(stderr, "Failed to store the compiled patterns in the cache.\n");
         }
-        if (end - start > 50) {
-            printf("%.*s ... %.*s", 10, line + start, 10, line + end - 10);
+    }
+    free(regexes);
+    if (ret == GRR_APP_RET_OUT_OF_MEMORY) {
+        fprintf(stderr, "Ran out of memory while analyzing the patterns.\n");
+        return ret;
+    }
+    if (ret != GRR_APP_RET_OK) {
+        options->search_program = NULL;
+        if (options->verbose) {
+            fprintf(stderr, "The patterns cannot be run as a DFA so only the NFAs will be used.\n");
         }
-        else {
-            printf("%.*s", (int)(end - start), line + start);
+    }
+
+    // A single pattern's literal is searched for directly.
+    if (options->num_patterns > 1) {
+        ret = grrAhoCorasickBuild(options->patterns, options->num_patterns, options->fold_case,
+                                  &options->search_literals);
+        if (ret == GRR_APP_RET_OUT_OF_MEMORY) {
+            fprintf(stderr, "Ran out of memory while analyzing the patterns.\n");
+            return ret;
         }
-        if (!options->colorless) {
-            printf("%s", restore_color);
+        if (ret != GRR_APP_RET_OK) {
+            options->search_literals = NULL;
         }
+    }
 
-        if (len - end > 50) {
-            printf("%.*s ...\n", 50, line + end);
-        }
-        else {
-            printf("%.*s\n", (int)(len - end), line + end);
+    return GRR_APP_RET_OK;
+}
+
+void
+freePatterns(grrOptions *options)
+{
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        if (options->patterns[k].search_regex != options->patterns[k].regex) {
+            free(options->patterns[k].search_regex);
         }
+        free(options->patterns[k].regex);
+        grrFreeNfa(options->patterns[k].nfa);
+        grrFreeLiteral(&options->patterns[k].literal);
     }
+    free(options->patterns);
+    options->patterns = NULL;
+    options->num_patterns = 0;
+
+    grrFreeProgram(options->search_program);
+    options->search_program = NULL;
+    grrAhoCorasickFree(options->search_literals);
+    options->search_literals = NULL;
+}
 
-    fclose(f);
+static void
+usage(const char *executable)
+{
+    printf("Usage: %s [options]\n", executable);
+    printf("Options:\n");
+    printf("\t-r <pattern>        -- Specify the search regex.  Required unless either -u or -h are\n");
+    printf("\t                       specified.  May be given more than once, in which case each result\n");
+    printf("\t                       is tagged with the first regex which matched.\n");
+    printf("\t-R <pattern-file>   -- Read search regexes, one per line, from a file.  May be combined with\n");
+    printf("\t                       -r.\n");
+    printf("\t-d <directory>      -- Specify the staring directory.  Defaults to the current directory.\n");
+    printf("\t-p <depth>          -- Specify the directory search maximum depth.  Defaults to infinite.\n");
+    printf("\t                       A value of 0 means that only the starting directory is searched.\n");
+    printf("\t-f <file-pattern>   -- Only examine files whose names (excluding the directory) match this\n");
+    printf("\t                       regex.\n");
+    printf("\t-e <editor>         -- When used in conjunction with -l, specify the editor for opening\n");
+    printf("\t                       files.  Defaults to the EDITOR environment variable or vi/vim if\n");
+    printf("\t                       that is unset.\n");
+    printf("\t-l <result-number>  -- Open up the file specified in the l^th result.\n");
+    printf("\t-j <threads>        -- Search the directory tree using this many threads.  A value of 0\n");
+    printf("\t                       means one thread per processor.  Defaults to 1.\n");
+    printf("\t--io-depth <n>      -- When searching with a single thread, open and read up to this many\n");
+    printf("\t                       files ahead of the one being searched.  A value of 0 or 1 turns\n");
+    printf("\t                       this off.  Defaults to %i.\n", GRR_PREFETCH_DEFAULT_DEPTH);
+    printf("\t-s                  -- Search standard input instead of a directory tree.  Results are\n");
+    printf("\t                       printed as soon as they're found.\n");
+    printf("\t--fd <fd>           -- Search the given file descriptor instead of a directory tree.\n");
+    printf("\t-n                  -- Display only the file names and not the individual lines within\n");
+    printf("\t                       them.\n");
+    printf("\t-A <lines>          -- Print this many lines of context after each matching line.\n");
+    printf("\t-B <lines>          -- Print this many lines of context before each matching line.\n");
+    printf("\t-C <lines>          -- Print this many lines of context before and after each matching\n");
+    printf("\t                       line.\n");
+    printf("\t--full-line         -- Print the whole of each matching line instead of only the text\n");
+    printf("\t                       around the match.\n");
+    printf("\t--all-matches       -- Find every match within each matching line instead of only the\n");
+    printf("\t                       first.  The lines are printed in full with each match highlighted.\n");
+    printf("\t--only-matching     -- Print each match as a result of its own without the rest of its\n");
+    printf("\t                       line.\n");
+    printf("\t--count             -- Print the number of matching lines in each file (or the number of\n");
+    printf("\t                       matches with --all-matches) instead of the lines themselves.\n");
+    printf("\t-i                  -- Ignore hidden files and directories.\n");
+    printf("\t-I                  -- Match the search regexes regardless of case.\n");
+    printf("\t-a                  -- Search binary files as though they were text.  Non-printable\n");
+    printf("\t                       characters are then skipped over instead of ending the search.\n");
+    printf("\t-g                  -- Skip the files and directories listed in .gitignore files.\n");
+    printf("\t--exclude-dir <glob>\n");
+    printf("\t                    -- Skip directories whose names match this glob.  May be given more\n");
+    printf("\t                       than once.\n");
+    printf("\t--min-size <size>   -- Skip files smaller than this many bytes.  A K, M, G, or T suffix\n");
+    printf("\t                       multiplies the size by a power of 1024.\n");
+    printf("\t--max-size <size>   -- Skip files larger than this many bytes.\n");
+    printf("\t--newer <time>      -- Skip files last modified before this time.  The time is either an\n");
+    printf("\t                       age, such as 30m or 2d (units of s, m, h, d, and w), or a date of\n");
+    printf("\t                       the form YYYY-MM-DD[ HH:MM[:SS]].\n");
+    printf("\t--older <time>      -- Skip files last modified at or after this time.\n");
+    printf("\t--skip-empty        -- Skip empty files.\n");
+    printf("\t-y                  -- Neither read from nor write to the history file.\n");
+    printf("\t-c                  -- Remove color from the output text.\n");
+    printf("\t-v                  -- Print verbose output to stderr.\n");
+    printf("\t--index             -- Build or update the trigram index of the starting directory and\n");
+    printf("\t                       exit.  Searches of the directory use the index if it exists.\n");
+    printf("\t--cache-results     -- Cache each file's results so that files which haven't changed since\n");
+    printf("\t                       the same search was last run aren't read again.\n");
+    printf("\t--serve             -- Keep the starting directory's tree, and the contents of its smaller\n");
+    printf("\t                       files, in memory and answer searches sent with --connect until\n");
+    printf("\t                       interrupted.\n");
+    printf("\t--connect           -- Send the search to the server for the starting directory.  The\n");
+    printf("\t                       tree is searched directly if there is no server or if -g,\n");
+    printf("\t                       --exclude-dir, or a size or time filter is given.\n");
+    printf("\t--stats[=json]      -- Print counters and the time spent in each phase of the search to\n");
+    printf("\t                       stderr once it's over, optionally as JSON.\n");
+    printf("\t-u                  -- Print Grr's version.\n");
+    printf("\t-h                  -- Print this message.\n");
+}
+
+static int
+isExecutable(const char *path)
+{
+    int ret;
+    char line[PATH_MAX + 6];
+    FILE *f;
+
+    if (access(path, X_OK) == 0) {
+        return GRR_APP_RET_OK;
+    }
+
+    if (snprintf(line, sizeof(line), "which %s", path) >= (ssize_t)sizeof(line)) {
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    f = popen(line, "r");
+    if (!f) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    if (fgets(line, sizeof(line), f)) {
+        ret = line[0] ? GRR_APP_RET_OK : GRR_APP_RET_NOT_FOUND;
+    }
+    else {
+        ret = GRR_APP_RET_FILE_ACCESS;
+    }
+    pclose(f);
 
     return ret;
 }
 
-static int
+int
 executeEditor(const char *editor, const char *path, long line_no, bool verbose)
 {
     if (strncmp(editor, "vi", 3) == 0 || strncmp(editor, "vim", 4) == 0) {
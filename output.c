@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "output.h"
+
+static void
+writeAll(grrOutput *output, const char *data, size_t len);
+
+int
+grrOutputInit(grrOutput *output, int fd)
+{
+    *output = (grrOutput){.fd = fd, .interactive = isatty(fd)};
+
+    output->buffer = malloc(GRR_OUTPUT_BUFFER_SIZE);
+    if (!output->buffer) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+void
+grrOutputWrite(grrOutput *output, const char *data, size_t len)
+{
+    if (len <= GRR_OUTPUT_BUFFER_SIZE - output->len) {
+        memcpy(output->buffer + output->len, data, len);
+        output->len += len;
+    }
+    else {
+        writeAll(output, data, len);
+    }
+}
+
+void
+grrOutputString(grrOutput *output, const char *string)
+{
+    grrOutputWrite(output, string, strlen(string));
+}
+
+void
+grrOutputNumber(grrOutput *output, long value)
+{
+    char digits[24];
+    size_t k = sizeof(digits);
+    unsigned long magnitude = (value < 0) ? -(unsigned long)value : (unsigned long)value;
+
+    do {
+        digits[--k] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[--k] = '-';
+    }
+
+    grrOutputWrite(output, digits + k, sizeof(digits) - k);
+}
+
+void
+grrOutputFlush(grrOutput *output)
+{
+    writeAll(output, NULL, 0);
+}
+
+int
+grrOutputClose(grrOutput *output)
+{
+    int ret;
+
+    if (!output->buffer) {
+        return GRR_APP_RET_OK;
+    }
+
+    grrOutputFlush(output);
+    ret = output->failed ? GRR_APP_RET_FILE_ACCESS : GRR_APP_RET_OK;
+    free(output->buffer);
+    *output = (grrOutput){.fd = -1};
+
+    return ret;
+}
+
+/*
+ * Writes out the buffer followed by the given data in as few system calls as possible.
+ */
+static void
+writeAll(grrOutput *output, const char *data, size_t len)
+{
+    struct iovec vectors[2] = {
+        {.iov_base = output->buffer, .iov_len = output->len},
+        {.iov_base = (char *)data, .iov_len = len},
+    };
+    struct iovec *next = vectors;
+    int num_vectors = 2;
+
+    output->len = 0;
+    if (output->failed) {
+        return;
+    }
+
+    while (num_vectors > 0) {
+        ssize_t written;
+
+        if (next->iov_len == 0) {
+            next++;
+            num_vectors--;
+            continue;
+        }
+
+        written = writev(output->fd, next, num_vectors);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            output->failed = true;
+            return;
+        }
+
+        while (num_vectors > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            num_vectors--;
+        }
+        if (num_vectors > 0) {
+            next->iov_base = (char *)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+}
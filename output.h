@@ -0,0 +1,49 @@
+#ifndef GRR_OUTPUT_H
+#define GRR_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The size of an output buffer.  Writes which don't fit are handed to writev along with whatever is already
+ * buffered instead of being split.
+ */
+#define GRR_OUTPUT_BUFFER_SIZE (256 * 1024)
+
+/*
+ * A buffered writer for a file descriptor.  Unlike stdio, it does no locking and no formatting beyond what's
+ * needed for results.  Once a write fails, everything else written is silently dropped and the error is
+ * reported by grrOutputClose.  When the file descriptor refers to a terminal, the output is marked as
+ * interactive so that the caller can flush it after each file's results.
+ */
+typedef struct grrOutput {
+    char *buffer;
+    size_t len;
+    int fd;
+    bool interactive;
+    bool failed;
+} grrOutput;
+
+int
+grrOutputInit(grrOutput *output, int fd);
+
+void
+grrOutputWrite(grrOutput *output, const char *data, size_t len);
+
+void
+grrOutputString(grrOutput *output, const char *string);
+
+void
+grrOutputNumber(grrOutput *output, long value);
+
+void
+grrOutputFlush(grrOutput *output);
+
+/*
+ * Flushes the buffer and frees it.  The file descriptor is left open.  Returns GRR_APP_RET_FILE_ACCESS if any
+ * write failed.
+ */
+int
+grrOutputClose(grrOutput *output);
+
+#endif  // GRR_OUTPUT_H
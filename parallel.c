@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grr.h"
+#include "pool.h"
+
+/*
+ * Every directory entry which is to be visited becomes a task.  A directory's children are linked together
+ * in getdents64 order once the directory has been enumerated.  The main thread walks the resulting tree in
+ * order, waiting on each task as it reaches it, so that results are numbered and printed exactly as they are
+ * by the serial traversal.
+ *
+ * A directory's children, along with their paths, are allocated from the directory's arena, which is freed once
+ * all of them have been printed.  A file's results are copied into a single allocation from the shared arena of
+ * the worker which searched it.
+ */
+typedef struct grrTask {
+    struct grrTask *next;
+    struct grrTask *children;
+    char *path;
+    grrIgnoreList *ignore;
+    long depth;
+    struct stat file_stat;
+    grrResultSet results;
+    grrArenaBlock *results_block;
+    grrArena arena;
+    bool is_dir;
+    bool complete;
+} grrTask;
+
+/*
+ * Each thread gathers a file's results in its scratch set, which is reused from one file to the next, before
+ * copying them into its results arena.
+ */
+typedef struct grrWorkerMemory {
+    grrResultSet scratch;
+    grrArena results;
+} grrWorkerMemory;
+
+typedef struct grrParallelSearch {
+    const grrOptions *options;
+    grrSearchState *states;
+    grrWorkerMemory *memory;
+    grrPool *pool;
+    grrTask *awaited;
+    unsigned int num_workers;
+    atomic_bool cancelled;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} grrParallelSearch;
+
+static grrTask *
+newTask(grrArena *arena, const char *path, size_t len, long depth, bool is_dir);
+
+static void
+freeTaskList(grrTask *task);
+
+static int
+keepResults(grrTask *task, const grrResultSet *results, grrArena *arena);
+
+static int
+keepResults(grrTask *task, const grrResultSet *results, grrArena *arena)
+{
+    size_t results_size = results->num_results * sizeof(*results->results);
+    char *space;
+
+    if (results->num_results == 0) {
+        return GRR_APP_RET_OK;
+    }
+
+    space = grrArenaAllocShared(arena, results_size + results->text_len, &task->results_block);
+    if (!space) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    memcpy(space, results->results, results_size);
+    memcpy(space + results_size, results->text, results->text_len);
+
+    task->results = (grrResultSet){.results = (grrResult *)space,
+                                   .num_results = results->num_results,
+                                   .text = space + results_size,
+                                   .text_len = results->text_len};
+    return GRR_APP_RET_OK;
+}
+
+static void
+runTask(void *job, unsigned int worker, void *arg);
+
+static void
+enumerateDirectory(grrTask *task, grrDirectory *dir, unsigned int worker, grrParallelSearch *search);
+
+static void
+markComplete(grrParallelSearch *search, grrTask *task);
+
+static void
+waitForTask(grrParallelSearch *search, grrTask *task);
+
+static int
+emitTasks(grrParallelSearch *search, grrTask **list, long *line_no);
+
+int
+searchDirectoryTreeParallel(grrDirectory *dir, const char *path, long *line_no, const grrOptions *options)
+{
+    int ret;
+    unsigned int num_states = 0;
+    grrTask *root = NULL;
+    grrArena root_arena;
+    grrParallelSearch search = {.options = options, .num_workers = options->num_threads};
+
+    atomic_init(&search.cancelled, false);
+    grrArenaInit(&root_arena, NULL, false);
+
+    // The extra state belongs to the main thread, which enumerates the starting directory.
+    search.states = calloc(search.num_workers + 1, sizeof(*search.states));
+    search.memory = calloc(search.num_workers + 1, sizeof(*search.memory));
+    root = newTask(&root_arena, path, strlen(path), -1, true);
+    if (!search.states || !search.memory || !root) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+    for (; num_states <= search.num_workers; num_states++) {
+        ret = initSearchState(search.states + num_states, options, true);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+        grrArenaInit(&search.memory[num_states].results, search.states[num_states].stats, true);
+    }
+
+    pthread_mutex_init(&search.lock, NULL);
+    pthread_cond_init(&search.cond, NULL);
+
+    ret = grrPoolCreate(search.num_workers, runTask, &search, &search.pool);
+    if (ret != GRR_APP_RET_OK) {
+        if (options->verbose) {
+            fprintf(stderr, "Failed to start the worker threads.\n");
+        }
+        goto destroy_sync;
+    }
+
+    enumerateDirectory(root, dir, search.num_workers, &search);
+    ret = emitTasks(&search, &root, line_no);
+
+    atomic_store(&search.cancelled, true);
+    grrPoolDestroy(search.pool);
+
+destroy_sync:
+
+    pthread_mutex_destroy(&search.lock);
+    pthread_cond_destroy(&search.cond);
+
+done:
+
+    // The results still refer to the results arenas' blocks so they have to be freed first.
+    freeTaskList(root);
+    grrArenaFree(&root_arena);
+    for (unsigned int k = 0; k < num_states; k++) {
+        freeResultSet(&search.memory[k].scratch);
+        grrArenaFree(&search.memory[k].results);
+        freeSearchState(search.states + k);
+    }
+    free(search.memory);
+    free(search.states);
+
+    return ret;
+}
+
+static grrTask *
+newTask(grrArena *arena, const char *path, size_t len, long depth, bool is_dir)
+{
+    grrTask *task;
+
+    task = grrArenaAlloc(arena, sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+    *task = (grrTask){.depth = depth, .is_dir = is_dir};
+    // Most directories only have a handful of entries.
+    grrArenaInit(&task->arena, NULL, false);
+    task->arena.block_size = GRR_ARENA_MIN_BLOCK_SIZE;
+
+    // The task's memory is simply left to the arena if this fails.
+    task->path = grrArenaStrndup(arena, path, len);
+    if (!task->path) {
+        return NULL;
+    }
+
+    return task;
+}
+
+static void
+freeTaskList(grrTask *task)
+{
+    while (task) {
+        grrTask *next = task->next;
+
+        freeTaskList(task->children);
+        grrArenaReleaseBlock(task->results_block);
+        grrIgnoreRelease(task->ignore);
+        // The task itself belongs to its parent's arena but its children belong to its own.
+        grrArenaFree(&task->arena);
+        task = next;
+    }
+}
+
+static void
+runTask(void *job, unsigned int worker, void *arg)
+{
+    grrTask *task = job;
+    grrParallelSearch *search = arg;
+    const grrOptions *options = search->options;
+
+    if (atomic_load(&search->cancelled)) {
+        goto done;
+    }
+
+    if (task->is_dir) {
+        int ret;
+        uint64_t start;
+        grrDirectory dir;
+        grrArena *arena = &search->states[worker].arena;
+        grrArenaMark mark = grrArenaGetMark(arena);
+        grrStats *stats = search->states[worker].stats;
+
+        start = grrStatsStart(stats);
+        ret = grrDirectoryOpen(&dir, AT_FDCWD, task->path, arena);
+        grrStatsStop(stats, GRR_TIMER_TRAVERSAL, start);
+        if (ret != GRR_APP_RET_OK) {
+            if (options->verbose) {
+                fprintf(stderr, "Could not access directory: %s\n", task->path);
+            }
+            goto done;
+        }
+
+        enumerateDirectory(task, &dir, worker, search);
+        grrDirectoryClose(&dir);
+        grrArenaReset(arena, mark);
+        return;
+    }
+    else {
+        grrWorkerMemory *memory = search->memory + worker;
+
+        searchFileForPattern(AT_FDCWD, task->path, task->path, options->result_cache ? &task->file_stat : NULL,
+                             &memory->scratch, search->states + worker, options);
+        if (keepResults(task, &memory->scratch, &memory->results) != GRR_APP_RET_OK && options->verbose) {
+            fprintf(stderr, "Ran out of memory while storing the results for %s.\n", task->path);
+        }
+    }
+
+done:
+
+    markComplete(search, task);
+}
+
+static void
+enumerateDirectory(grrTask *task, grrDirectory *dir, unsigned int worker, grrParallelSearch *search)
+{
+    size_t offset, new_len, num_children = 0, capacity = 0;
+    uint64_t start;
+    unsigned char type;
+    char path[PATH_MAX];
+    const char *name;
+    struct stat file_stat;
+    grrTask *children = NULL, **tail = &children, **to_submit = NULL;
+    const grrOptions *options = search->options;
+    grrIgnoreList *ignore = NULL;
+    grrStats *stats = search->states[worker].stats;
+    grrArena *scratch = &search->states[worker].arena;
+    grrArenaMark mark = grrArenaGetMark(scratch);
+
+    GRR_STAT_ADD(stats, GRR_STAT_DIRECTORIES, 1);
+    start = grrStatsStart(stats);
+    task->arena.stats = stats;
+
+    offset = strlen(task->path);
+    memcpy(path, task->path, offset + 1);
+
+    if (options->ignore_files &&
+        grrIgnoreLoad(dir->fd, offset, task->ignore, &ignore) != GRR_APP_RET_OK && options->verbose) {
+        fprintf(stderr, "Failed to read the ignore file in %s.\n", path);
+    }
+
+    while (grrDirectoryNext(dir, &name, &type) == GRR_APP_RET_OK) {
+        int entry_type;
+        grrTask *child;
+
+        entry_type = examineEntry(dir->fd, name, type, path, offset, task->depth, &new_len,
+                                  options->result_cache ? &file_stat : NULL, ignore, search->states + worker,
+                                  options);
+        if (entry_type == GRR_ENTRY_SKIP) {
+            continue;
+        }
+
+        // The old array is left in the scratch arena until the directory is done.
+        if (num_children == capacity) {
+            size_t new_capacity = capacity ? 2 * capacity : 32;
+            grrTask **new_array;
+
+            new_array = grrArenaAlloc(scratch, new_capacity * sizeof(*new_array));
+            if (!new_array) {
+                goto out_of_memory;
+            }
+            if (num_children > 0) {
+                memcpy(new_array, to_submit, num_children * sizeof(*new_array));
+            }
+            to_submit = new_array;
+            capacity = new_capacity;
+        }
+
+        child = newTask(&task->arena, path, new_len, task->depth + 1, entry_type == GRR_ENTRY_DIRECTORY);
+        if (!child) {
+            goto out_of_memory;
+        }
+        if (options->result_cache && entry_type == GRR_ENTRY_FILE) {
+            child->file_stat = file_stat;
+        }
+        // Subdirectories inherit the rules which were in effect here.
+        if (entry_type == GRR_ENTRY_DIRECTORY) {
+            child->ignore = grrIgnoreRetain(ignore);
+        }
+
+        *tail = child;
+        tail = &child->next;
+        to_submit[num_children++] = child;
+    }
+
+    goto submit;
+
+out_of_memory:
+
+    if (options->verbose) {
+        path[offset] = '\0';
+        fprintf(stderr, "Ran out of memory while enumerating %s.\n", path);
+    }
+
+submit:
+
+    grrStatsStop(stats, GRR_TIMER_TRAVERSAL, start);
+
+    // The deques are LIFO for their owners so pushing the children in reverse order means that the owner
+    // processes them in the order in which they will be printed.
+    for (size_t k = num_children; k > 0; k--) {
+        if (grrPoolSubmit(search->pool, worker, to_submit[k - 1]) != GRR_APP_RET_OK) {
+            // The job couldn't be queued so we have to run it ourselves.
+            runTask(to_submit[k - 1], worker, search);
+        }
+    }
+    grrArenaReset(scratch, mark);
+    grrIgnoreRelease(ignore);
+
+    task->children = children;
+    markComplete(search, task);
+}
+
+static void
+markComplete(grrParallelSearch *search, grrTask *task)
+{
+    pthread_mutex_lock(&search->lock);
+    task->complete = true;
+    if (search->awaited == task) {
+        pthread_cond_signal(&search->cond);
+    }
+    pthread_mutex_unlock(&search->lock);
+}
+
+static void
+waitForTask(grrParallelSearch *search, grrTask *task)
+{
+    pthread_mutex_lock(&search->lock);
+    search->awaited = task;
+    while (!task->complete) {
+        pthread_cond_wait(&search->cond, &search->lock);
+    }
+    search->awaited = NULL;
+    pthread_mutex_unlock(&search->lock);
+}
+
+static int
+emitTasks(grrParallelSearch *search, grrTask **list, long *line_no)
+{
+    grrTask *task;
+    // The main thread's state is the last one.
+    grrStats *stats = search->states[search->num_workers].stats;
+
+    while ((task = *list)) {
+        waitForTask(search, task);
+
+        if (task->is_dir) {
+            if (emitTasks(search, &task->children, line_no) == GRR_APP_RET_DONE) {
+                return GRR_APP_RET_DONE;
+            }
+        }
+        else {
+            int ret;
+            uint64_t start;
+
+            start = grrStatsStart(stats);
+            ret = emitResults(task->path, &task->results, line_no, search->options);
+            grrStatsStop(stats, GRR_TIMER_OUTPUT, start);
+            if (ret == GRR_APP_RET_DONE) {
+                return GRR_APP_RET_DONE;
+            }
+        }
+
+        *list = task->next;
+        task->next = NULL;
+        freeTaskList(task);
+    }
+
+    return GRR_APP_RET_OK;
+}
@@ -0,0 +1,240 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "grr.h"
+#include "pool.h"
+
+typedef struct grrDeque {
+    pthread_mutex_t lock;
+    void **jobs;
+    size_t head;
+    size_t count;
+    size_t capacity;
+} grrDeque;
+
+typedef struct grrWorker {
+    grrPool *pool;
+    pthread_t thread;
+    unsigned int index;
+} grrWorker;
+
+struct grrPool {
+    grrPoolFunc func;
+    void *arg;
+    grrDeque *deques;
+    grrWorker *workers;
+    unsigned int num_workers;
+    unsigned int num_started;
+    atomic_size_t pending;
+    atomic_uint sleepers;
+    atomic_bool stop;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+};
+
+static void *
+workerLoop(void *arg);
+
+static bool
+popBottom(grrDeque *deque, void **job);
+
+static bool
+stealTop(grrDeque *deque, void **job);
+
+int
+grrPoolCreate(unsigned int num_workers, grrPoolFunc func, void *arg, grrPool **pool)
+{
+    grrPool *new_pool;
+
+    if (num_workers == 0) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+
+    new_pool = calloc(1, sizeof(*new_pool));
+    if (!new_pool) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    new_pool->deques = calloc(num_workers, sizeof(*new_pool->deques));
+    new_pool->workers = calloc(num_workers, sizeof(*new_pool->workers));
+    if (!new_pool->deques || !new_pool->workers) {
+        free(new_pool->deques);
+        free(new_pool->workers);
+        free(new_pool);
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+
+    new_pool->func = func;
+    new_pool->arg = arg;
+    new_pool->num_workers = num_workers;
+    atomic_init(&new_pool->pending, 0);
+    atomic_init(&new_pool->sleepers, 0);
+    atomic_init(&new_pool->stop, false);
+    pthread_mutex_init(&new_pool->idle_lock, NULL);
+    pthread_cond_init(&new_pool->idle_cond, NULL);
+
+    for (unsigned int k = 0; k < num_workers; k++) {
+        pthread_mutex_init(&new_pool->deques[k].lock, NULL);
+    }
+
+    for (unsigned int k = 0; k < num_workers; k++) {
+        grrWorker *worker = new_pool->workers + k;
+
+        worker->pool = new_pool;
+        worker->index = k;
+        if (pthread_create(&worker->thread, NULL, workerLoop, worker) != 0) {
+            grrPoolDestroy(new_pool);
+            return GRR_APP_RET_OTHER;
+        }
+        new_pool->num_started++;
+    }
+
+    *pool = new_pool;
+    return GRR_APP_RET_OK;
+}
+
+int
+grrPoolSubmit(grrPool *pool, unsigned int worker, void *job)
+{
+    grrDeque *deque;
+
+    if (worker >= pool->num_workers) {
+        worker = 0;
+    }
+    deque = pool->deques + worker;
+
+    // The job is counted before it can be seen so that a worker which takes it right away can't underflow pending.
+    pthread_mutex_lock(&deque->lock);
+    atomic_fetch_add(&pool->pending, 1);
+    if (deque->count == deque->capacity) {
+        size_t new_capacity = deque->capacity ? 2 * deque->capacity : 64;
+        void **new_jobs;
+
+        new_jobs = malloc(new_capacity * sizeof(*new_jobs));
+        if (!new_jobs) {
+            atomic_fetch_sub(&pool->pending, 1);
+            pthread_mutex_unlock(&deque->lock);
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        for (size_t k = 0; k < deque->count; k++) {
+            new_jobs[k] = deque->jobs[(deque->head + k) % deque->capacity];
+        }
+        free(deque->jobs);
+        deque->jobs = new_jobs;
+        deque->head = 0;
+        deque->capacity = new_capacity;
+    }
+    deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+void
+grrPoolDestroy(grrPool *pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->idle_lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    for (unsigned int k = 0; k < pool->num_started; k++) {
+        pthread_join(pool->workers[k].thread, NULL);
+    }
+
+    for (unsigned int k = 0; k < pool->num_workers; k++) {
+        pthread_mutex_destroy(&pool->deques[k].lock);
+        free(pool->deques[k].jobs);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
+
+static void *
+workerLoop(void *arg)
+{
+    grrWorker *worker = arg;
+    grrPool *pool = worker->pool;
+
+    while (!atomic_load(&pool->stop)) {
+        void *job = NULL;
+        bool found;
+
+        found = popBottom(pool->deques + worker->index, &job);
+        for (unsigned int k = 1; !found && k < pool->num_workers; k++) {
+            found = stealTop(pool->deques + (worker->index + k) % pool->num_workers, &job);
+        }
+
+        if (found) {
+            atomic_fetch_sub(&pool->pending, 1);
+            pool->func(job, worker->index, pool->arg);
+            continue;
+        }
+
+        if (atomic_load(&pool->pending) > 0) {
+            // Another worker beat us to the job we saw.  Try again.
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (!atomic_load(&pool->stop) && atomic_load(&pool->pending) == 0) {
+            pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+
+    return NULL;
+}
+
+static bool
+popBottom(grrDeque *deque, void **job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        *job = deque->jobs[(deque->head + deque->count) % deque->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+static bool
+stealTop(grrDeque *deque, void **job)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        *job = deque->jobs[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
@@ -0,0 +1,30 @@
+#ifndef GRR_POOL_H
+#define GRR_POOL_H
+
+/*
+ * A work-stealing thread pool.  Every worker owns a deque.  Workers push new jobs onto the bottom of their own
+ * deque and pop from the bottom as well so that they tend to stay within the subtree they are exploring.
+ * Idle workers steal from the top of the other deques.
+ */
+
+typedef struct grrPool grrPool;
+
+typedef void (*grrPoolFunc)(void *job, unsigned int worker, void *arg);
+
+int
+grrPoolCreate(unsigned int num_workers, grrPoolFunc func, void *arg, grrPool **pool);
+
+/*
+ * Queues a job onto the given worker's deque.  Threads which are not workers (e.g., the main thread) can
+ * pass any index greater than or equal to the number of workers.
+ */
+int
+grrPoolSubmit(grrPool *pool, unsigned int worker, void *job);
+
+/*
+ * Stops the workers and waits for them to exit.  Jobs which have not been started yet are discarded.
+ */
+void
+grrPoolDestroy(grrPool *pool);
+
+#endif  // GRR_POOL_H
@@ -0,0 +1,680 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define GRR_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "grr.h"
+#include "prefetch.h"
+
+enum grrSlotState {
+    GRR_SLOT_FREE = 0,
+    GRR_SLOT_QUEUED,
+    GRR_SLOT_BUSY,
+    GRR_SLOT_DONE,
+};
+
+typedef struct grrSlot {
+    grrPrefetchedFile file;
+    int dir_fd;
+    int state;
+} grrSlot;
+
+#ifdef GRR_HAVE_IO_URING
+
+// The low byte of each request's user data is the operation.  The rest is the slot's index or, for a close,
+// the file descriptor.
+enum grrUringOp {
+    GRR_URING_OPEN = 0,
+    GRR_URING_READ,
+    GRR_URING_CLOSE,
+};
+
+typedef struct grrUring {
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *sqes;
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+    unsigned int to_submit;
+} grrUring;
+
+#endif  // GRR_HAVE_IO_URING
+
+/*
+ * The slots form a ring in submission order.  The oldest file is at head.
+ */
+struct grrPrefetcher {
+    grrSlot *slots;
+    unsigned int depth;
+    unsigned int head;
+    unsigned int count;
+#ifdef GRR_HAVE_IO_URING
+    grrUring uring;
+    bool use_uring;
+#endif
+    pthread_t threads[GRR_PREFETCH_THREADS];
+    unsigned int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    bool stopping;
+};
+
+static void *
+prefetchThread(void *arg);
+
+static void
+prefetchSync(grrSlot *slot);
+
+static void
+readRest(grrSlot *slot);
+
+#ifdef GRR_HAVE_IO_URING
+
+static int
+uringSetup(grrUring *uring, unsigned int entries);
+
+static void
+uringTeardown(grrUring *uring);
+
+static struct io_uring_sqe *
+uringGetSqe(grrUring *uring);
+
+static int
+uringEnter(grrUring *uring, unsigned int min_complete);
+
+static void
+uringReap(grrPrefetcher *prefetcher);
+
+static void
+uringPrepRead(grrPrefetcher *prefetcher, unsigned int index);
+
+static void
+uringPrepClose(grrPrefetcher *prefetcher, int fd);
+
+#endif  // GRR_HAVE_IO_URING
+
+int
+grrPrefetcherCreate(unsigned int depth, grrPrefetcher **prefetcher)
+{
+    grrPrefetcher *new_prefetcher;
+
+    if (depth == 0) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+
+    new_prefetcher = calloc(1, sizeof(*new_prefetcher));
+    if (!new_prefetcher) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    new_prefetcher->depth = depth;
+    pthread_mutex_init(&new_prefetcher->lock, NULL);
+    pthread_cond_init(&new_prefetcher->work_cond, NULL);
+    pthread_cond_init(&new_prefetcher->done_cond, NULL);
+
+    new_prefetcher->slots = calloc(depth, sizeof(*new_prefetcher->slots));
+    if (!new_prefetcher->slots) {
+        goto error;
+    }
+    for (unsigned int k = 0; k < depth; k++) {
+        new_prefetcher->slots[k].file.fd = -1;
+        new_prefetcher->slots[k].file.data = malloc(GRR_PREFETCH_SIZE);
+        if (!new_prefetcher->slots[k].file.data) {
+            goto error;
+        }
+    }
+
+#ifdef GRR_HAVE_IO_URING
+    // Each slot has at most one open or read in flight and at most one close which hasn't been reaped yet.
+    if (uringSetup(&new_prefetcher->uring, 2 * depth) == GRR_APP_RET_OK) {
+        new_prefetcher->use_uring = true;
+        *prefetcher = new_prefetcher;
+        return GRR_APP_RET_OK;
+    }
+#endif
+
+    for (; new_prefetcher->num_threads < MIN(depth, GRR_PREFETCH_THREADS); new_prefetcher->num_threads++) {
+        if (pthread_create(new_prefetcher->threads + new_prefetcher->num_threads, NULL, prefetchThread,
+                           new_prefetcher) != 0) {
+            break;
+        }
+    }
+    if (new_prefetcher->num_threads == 0) {
+        goto error;
+    }
+
+    *prefetcher = new_prefetcher;
+    return GRR_APP_RET_OK;
+
+error:
+
+    grrPrefetcherFree(new_prefetcher);
+    return GRR_APP_RET_OUT_OF_MEMORY;
+}
+
+const char *
+grrPrefetcherBackend(const grrPrefetcher *prefetcher)
+{
+#ifdef GRR_HAVE_IO_URING
+    if (prefetcher->use_uring) {
+        return "io_uring";
+    }
+#endif
+    (void)prefetcher;
+    return "threads";
+}
+
+bool
+grrPrefetcherFull(const grrPrefetcher *prefetcher)
+{
+    return prefetcher->count == prefetcher->depth;
+}
+
+int
+grrPrefetcherSubmit(grrPrefetcher *prefetcher, int dir_fd, const char *name, const struct stat *file_stat)
+{
+    unsigned int index;
+    size_t name_len = strlen(name);
+    grrSlot *slot;
+
+    if (prefetcher->count == prefetcher->depth || name_len > NAME_MAX) {
+        return GRR_APP_RET_OVERFLOW;
+    }
+
+    index = (prefetcher->head + prefetcher->count) % prefetcher->depth;
+    slot = prefetcher->slots + index;
+    memcpy(slot->file.name, name, name_len + 1);
+    if (file_stat) {
+        slot->file.file_stat = *file_stat;
+    }
+    slot->file.len = 0;
+    slot->file.fd = -1;
+    slot->file.error = 0;
+    slot->dir_fd = dir_fd;
+
+#ifdef GRR_HAVE_IO_URING
+    if (prefetcher->use_uring) {
+        struct io_uring_sqe *sqe;
+
+        sqe = uringGetSqe(&prefetcher->uring);
+        if (!sqe) {
+            return GRR_APP_RET_OTHER;
+        }
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = dir_fd;
+        sqe->addr = (uintptr_t)slot->file.name;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = ((uint64_t)index << 8) | GRR_URING_OPEN;
+
+        slot->state = GRR_SLOT_BUSY;
+        prefetcher->count++;
+        return GRR_APP_RET_OK;
+    }
+#endif
+
+    pthread_mutex_lock(&prefetcher->lock);
+    slot->state = GRR_SLOT_QUEUED;
+    prefetcher->count++;
+    pthread_cond_signal(&prefetcher->work_cond);
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return GRR_APP_RET_OK;
+}
+
+grrPrefetchedFile *
+grrPrefetcherNext(grrPrefetcher *prefetcher)
+{
+    grrSlot *slot = prefetcher->slots + prefetcher->head;
+
+    if (prefetcher->count == 0) {
+        return NULL;
+    }
+
+#ifdef GRR_HAVE_IO_URING
+    if (prefetcher->use_uring) {
+        // Everything queued since the last call is submitted in the same system call which waits for the file.
+        uringReap(prefetcher);
+        while (slot->state != GRR_SLOT_DONE) {
+            if (uringEnter(&prefetcher->uring, 1) != GRR_APP_RET_OK) {
+                // Without a working ring, the rest of the file's I/O is done right here.
+                if (slot->file.fd == -1) {
+                    prefetchSync(slot);
+                }
+                else {
+                    readRest(slot);
+                }
+                slot->state = GRR_SLOT_DONE;
+                break;
+            }
+            uringReap(prefetcher);
+        }
+        if (prefetcher->uring.to_submit > 0) {
+            uringEnter(&prefetcher->uring, 0);
+        }
+        return &slot->file;
+    }
+#endif
+
+    pthread_mutex_lock(&prefetcher->lock);
+    while (slot->state != GRR_SLOT_DONE) {
+        pthread_cond_wait(&prefetcher->done_cond, &prefetcher->lock);
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return &slot->file;
+}
+
+void
+grrPrefetcherRelease(grrPrefetcher *prefetcher, grrPrefetchedFile *file)
+{
+    grrSlot *slot = prefetcher->slots + prefetcher->head;
+
+    if (file != &slot->file) {
+        return;
+    }
+
+    if (file->fd != -1) {
+#ifdef GRR_HAVE_IO_URING
+        if (prefetcher->use_uring) {
+            uringPrepClose(prefetcher, file->fd);
+        }
+        else
+#endif
+        {
+            close(file->fd);
+        }
+        file->fd = -1;
+    }
+
+    pthread_mutex_lock(&prefetcher->lock);
+    slot->state = GRR_SLOT_FREE;
+    prefetcher->head = (prefetcher->head + 1) % prefetcher->depth;
+    prefetcher->count--;
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+void
+grrPrefetcherCancel(grrPrefetcher *prefetcher)
+{
+    grrPrefetchedFile *file;
+
+    // The kernel or a thread may still be writing into the buffers so every file has to be waited for.
+    while ((file = grrPrefetcherNext(prefetcher))) {
+        grrPrefetcherRelease(prefetcher, file);
+    }
+}
+
+void
+grrPrefetcherFree(grrPrefetcher *prefetcher)
+{
+    if (!prefetcher) {
+        return;
+    }
+
+    if (prefetcher->slots) {
+        grrPrefetcherCancel(prefetcher);
+    }
+
+#ifdef GRR_HAVE_IO_URING
+    if (prefetcher->use_uring) {
+        if (prefetcher->uring.to_submit > 0) {
+            uringEnter(&prefetcher->uring, 0);
+        }
+        uringTeardown(&prefetcher->uring);
+    }
+#endif
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stopping = true;
+    pthread_cond_broadcast(&prefetcher->work_cond);
+    pthread_mutex_unlock(&prefetcher->lock);
+    for (unsigned int k = 0; k < prefetcher->num_threads; k++) {
+        pthread_join(prefetcher->threads[k], NULL);
+    }
+
+    if (prefetcher->slots) {
+        for (unsigned int k = 0; k < prefetcher->depth; k++) {
+            free(prefetcher->slots[k].file.data);
+        }
+        free(prefetcher->slots);
+    }
+    pthread_mutex_destroy(&prefetcher->lock);
+    pthread_cond_destroy(&prefetcher->work_cond);
+    pthread_cond_destroy(&prefetcher->done_cond);
+    free(prefetcher);
+}
+
+static void *
+prefetchThread(void *arg)
+{
+    grrPrefetcher *prefetcher = arg;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    for (;;) {
+        grrSlot *slot = NULL;
+
+        // The oldest queued file is taken first since it'll be the first one needed.
+        for (unsigned int k = 0; k < prefetcher->count; k++) {
+            grrSlot *candidate = prefetcher->slots + (prefetcher->head + k) % prefetcher->depth;
+
+            if (candidate->state == GRR_SLOT_QUEUED) {
+                slot = candidate;
+                break;
+            }
+        }
+
+        if (!slot) {
+            if (prefetcher->stopping) {
+                break;
+            }
+            pthread_cond_wait(&prefetcher->work_cond, &prefetcher->lock);
+            continue;
+        }
+
+        slot->state = GRR_SLOT_BUSY;
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        prefetchSync(slot);
+
+        pthread_mutex_lock(&prefetcher->lock);
+        slot->state = GRR_SLOT_DONE;
+        pthread_cond_broadcast(&prefetcher->done_cond);
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return NULL;
+}
+
+static void
+prefetchSync(grrSlot *slot)
+{
+    slot->file.fd = openat(slot->dir_fd, slot->file.name, O_RDONLY | O_CLOEXEC);
+    if (slot->file.fd == -1) {
+        slot->file.error = errno;
+        return;
+    }
+
+    readRest(slot);
+}
+
+/*
+ * Reads until either the buffer is full or the end of the file is reached, in which case the file is closed.
+ * pread is used so that the file's offset stays at 0 for whoever reads the rest of it.
+ */
+static void
+readRest(grrSlot *slot)
+{
+    while (slot->file.len < GRR_PREFETCH_SIZE) {
+        ssize_t num_read;
+
+        num_read = pread(slot->file.fd, slot->file.data + slot->file.len, GRR_PREFETCH_SIZE - slot->file.len,
+                         slot->file.len);
+        if (num_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            if (num_read == -1) {
+                slot->file.error = errno;
+            }
+            close(slot->file.fd);
+            slot->file.fd = -1;
+            return;
+        }
+        slot->file.len += num_read;
+    }
+}
+
+#ifdef GRR_HAVE_IO_URING
+
+static int
+uringSetup(grrUring *uring, unsigned int entries)
+{
+    struct io_uring_params params = {0};
+
+    *uring = (grrUring){.fd = -1};
+
+    uring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (uring->fd < 0) {
+        uring->fd = -1;
+        return GRR_APP_RET_OTHER;
+    }
+
+    uring->sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    uring->cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->sq_map_len = uring->cq_map_len = MAX(uring->sq_map_len, uring->cq_map_len);
+    }
+
+    uring->sq_map = mmap(NULL, uring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                         IORING_OFF_SQ_RING);
+    if (uring->sq_map == MAP_FAILED) {
+        uring->sq_map = NULL;
+        goto error;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_map = uring->sq_map;
+    }
+    else {
+        uring->cq_map = mmap(NULL, uring->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_map == MAP_FAILED) {
+            uring->cq_map = NULL;
+            goto error;
+        }
+    }
+
+    uring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                       IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        goto error;
+    }
+
+    uring->sq_head = (unsigned int *)((char *)uring->sq_map + params.sq_off.head);
+    uring->sq_tail = (unsigned int *)((char *)uring->sq_map + params.sq_off.tail);
+    uring->sq_mask = (unsigned int *)((char *)uring->sq_map + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned int *)((char *)uring->sq_map + params.sq_off.array);
+    uring->sq_entries = params.sq_entries;
+    uring->cq_head = (unsigned int *)((char *)uring->cq_map + params.cq_off.head);
+    uring->cq_tail = (unsigned int *)((char *)uring->cq_map + params.cq_off.tail);
+    uring->cq_mask = (unsigned int *)((char *)uring->cq_map + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)((char *)uring->cq_map + params.cq_off.cqes);
+
+    return GRR_APP_RET_OK;
+
+error:
+
+    uringTeardown(uring);
+    return GRR_APP_RET_OTHER;
+}
+
+static void
+uringTeardown(grrUring *uring)
+{
+    if (uring->sqes) {
+        munmap(uring->sqes, uring->sqes_len);
+    }
+    if (uring->cq_map && uring->cq_map != uring->sq_map) {
+        munmap(uring->cq_map, uring->cq_map_len);
+    }
+    if (uring->sq_map) {
+        munmap(uring->sq_map, uring->sq_map_len);
+    }
+    if (uring->fd != -1) {
+        close(uring->fd);
+    }
+    *uring = (grrUring){.fd = -1};
+}
+
+/*
+ * Returns a zeroed submission queue entry which will be submitted by the next call to uringEnter.
+ */
+static struct io_uring_sqe *
+uringGetSqe(grrUring *uring)
+{
+    unsigned int tail = *uring->sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries &&
+        uringEnter(uring, 0) != GRR_APP_RET_OK) {
+        return NULL;
+    }
+
+    index = tail & *uring->sq_mask;
+    sqe = uring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring->to_submit++;
+
+    return sqe;
+}
+
+static int
+uringEnter(grrUring *uring, unsigned int min_complete)
+{
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return GRR_APP_RET_OTHER;
+    }
+
+    uring->to_submit -= MIN((unsigned int)ret, uring->to_submit);
+    return GRR_APP_RET_OK;
+}
+
+static void
+uringReap(grrPrefetcher *prefetcher)
+{
+    grrUring *uring = &prefetcher->uring;
+    unsigned int head = *uring->cq_head;
+
+    while (head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = uring->cqes + (head & *uring->cq_mask);
+        unsigned int op = cqe->user_data & 0xff;
+        uint64_t value = cqe->user_data >> 8;
+        int res = cqe->res;
+        grrSlot *slot = prefetcher->slots + ((op == GRR_URING_CLOSE) ? 0 : value);
+
+        __atomic_store_n(uring->cq_head, ++head, __ATOMIC_RELEASE);
+
+        switch (op) {
+        case GRR_URING_OPEN:
+            if (res == -EINVAL) {
+                // The kernel predates IORING_OP_OPENAT.
+                prefetchSync(slot);
+                slot->state = GRR_SLOT_DONE;
+            }
+            else if (res < 0) {
+                slot->file.error = -res;
+                slot->state = GRR_SLOT_DONE;
+            }
+            else {
+                slot->file.fd = res;
+                uringPrepRead(prefetcher, value);
+            }
+            break;
+
+        case GRR_URING_READ:
+            if (res == -EINTR || res == -EAGAIN) {
+                uringPrepRead(prefetcher, value);
+            }
+            else if (res == -EINVAL) {
+                readRest(slot);
+                slot->state = GRR_SLOT_DONE;
+            }
+            else if (res <= 0) {
+                // The whole file has been read.
+                if (res < 0) {
+                    slot->file.error = -res;
+                }
+                uringPrepClose(prefetcher, slot->file.fd);
+                slot->file.fd = -1;
+                slot->state = GRR_SLOT_DONE;
+            }
+            else {
+                slot->file.len += res;
+                if (slot->file.len == GRR_PREFETCH_SIZE) {
+                    slot->state = GRR_SLOT_DONE;
+                }
+                else {
+                    uringPrepRead(prefetcher, value);
+                }
+            }
+            break;
+
+        default:
+            if (res == -EINVAL) {
+                close(value);
+            }
+            break;
+        }
+    }
+}
+
+static void
+uringPrepRead(grrPrefetcher *prefetcher, unsigned int index)
+{
+    grrSlot *slot = prefetcher->slots + index;
+    struct io_uring_sqe *sqe;
+
+    sqe = uringGetSqe(&prefetcher->uring);
+    if (!sqe) {
+        readRest(slot);
+        slot->state = GRR_SLOT_DONE;
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->file.fd;
+    sqe->addr = (uintptr_t)(slot->file.data + slot->file.len);
+    sqe->len = GRR_PREFETCH_SIZE - slot->file.len;
+    sqe->off = slot->file.len;
+    sqe->user_data = ((uint64_t)index << 8) | GRR_URING_READ;
+}
+
+static void
+uringPrepClose(grrPrefetcher *prefetcher, int fd)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uringGetSqe(&prefetcher->uring);
+    if (!sqe) {
+        close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = ((uint64_t)fd << 8) | GRR_URING_CLOSE;
+}
+
+#endif  // GRR_HAVE_IO_URING
@@ -0,0 +1,95 @@
+#ifndef GRR_PREFETCH_H
+#define GRR_PREFETCH_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "reader.h"
+
+/*
+ * The number of bytes read from each prefetched file.  A file which is smaller than this is read in its
+ * entirety.  Anything larger is memory-mapped by the reader anyway, so only its first block is read in order
+ * to get the file's pages on their way into the page cache.
+ */
+#define GRR_PREFETCH_SIZE GRR_MMAP_THRESHOLD
+
+/*
+ * The number of files which are read ahead of the search by default and at most (see --io-depth).
+ */
+#define GRR_PREFETCH_DEFAULT_DEPTH 16
+#define GRR_PREFETCH_MAX_DEPTH 256
+
+/*
+ * The number of threads which perform the I/O when io_uring isn't available.
+ */
+#define GRR_PREFETCH_THREADS 4
+
+/*
+ * A file which has been (or is being) opened and read ahead of the search.  If error is nonzero, it's the errno
+ * value of the failed open.  Otherwise, if fd is -1, data holds the whole file.  If fd isn't -1, data holds the
+ * file's first GRR_PREFETCH_SIZE bytes and the rest is still to be read from fd, whose offset is still 0.
+ */
+typedef struct grrPrefetchedFile {
+    char name[NAME_MAX + 1];
+    struct stat file_stat;
+    char *data;
+    size_t len;
+    int fd;
+    int error;
+} grrPrefetchedFile;
+
+/*
+ * Opens and reads files ahead of the search so that their I/O overlaps with the matching of the files before
+ * them.  Up to depth files are in flight at once and they're handed back in the order in which they were
+ * submitted.  On Linux, the openat, read, and close calls are submitted in batches through io_uring.
+ * Elsewhere, or if the kernel refuses to set up a ring, a few threads perform the calls instead.
+ *
+ * A prefetcher is used by a single thread.
+ */
+typedef struct grrPrefetcher grrPrefetcher;
+
+int
+grrPrefetcherCreate(unsigned int depth, grrPrefetcher **prefetcher);
+
+/*
+ * Returns a description of the mechanism which performs the I/O (for verbose messages).
+ */
+const char *
+grrPrefetcherBackend(const grrPrefetcher *prefetcher);
+
+/*
+ * Determines whether another file can be submitted.
+ */
+bool
+grrPrefetcherFull(const grrPrefetcher *prefetcher);
+
+/*
+ * Starts opening the file at name, relative to dir_fd, which has to remain open until the file has been
+ * handed back.  The stat structure (if not NULL) is stored alongside the file for the caller's use.
+ */
+int
+grrPrefetcherSubmit(grrPrefetcher *prefetcher, int dir_fd, const char *name, const struct stat *file_stat);
+
+/*
+ * Waits for the oldest submitted file and returns it or returns NULL if no files are pending.  The file has
+ * to be handed back with grrPrefetcherRelease before the next one is requested.  The caller may take over the
+ * file descriptor by setting fd to -1.
+ */
+grrPrefetchedFile *
+grrPrefetcherNext(grrPrefetcher *prefetcher);
+
+void
+grrPrefetcherRelease(grrPrefetcher *prefetcher, grrPrefetchedFile *file);
+
+/*
+ * Waits for every pending file and discards them.
+ */
+void
+grrPrefetcherCancel(grrPrefetcher *prefetcher);
+
+void
+grrPrefetcherFree(grrPrefetcher *prefetcher);
+
+#endif  // GRR_PREFETCH_H
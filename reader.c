@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "reader.h"
+
+static void
+resetReader(grrReader *reader);
+
+static int
+fillBuffer(grrReader *reader);
+
+void
+grrReaderInit(grrReader *reader)
+{
+    *reader = (grrReader){.fd = -1};
+}
+
+int
+grrReaderOpen(grrReader *reader, int dir_fd, const char *path)
+{
+    int fd;
+
+    fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        resetReader(reader);
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    return grrReaderAdopt(reader, fd, NULL, 0);
+}
+
+int
+grrReaderAdopt(grrReader *reader, int fd, const char *data, size_t len)
+{
+    int compression;
+    struct stat file_stat;
+
+    resetReader(reader);
+
+    if (fd == -1) {
+        // The data is handed out just like a mapping, except that it's never unmapped.
+        reader->map = (char *)data;
+        reader->map_len = len;
+        reader->borrowed = true;
+        reader->sniffed = true;
+        if (len == 0) {
+            reader->eof = true;
+            return GRR_APP_RET_OK;
+        }
+
+        compression = grrDetectCompression(data, len);
+        if (compression != GRR_COMPRESSION_NONE &&
+            grrDecompressorStart(compression, data, len, true, -1, &reader->decompressor) != GRR_APP_RET_OK) {
+            grrReaderClose(reader);
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        return GRR_APP_RET_OK;
+    }
+
+    reader->fd = fd;
+
+    if (fstat(reader->fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+        file_stat.st_size >= GRR_MMAP_THRESHOLD) {
+        void *map;
+
+        map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+            reader->map = map;
+            reader->map_len = file_stat.st_size;
+            reader->sniffed = true;
+
+            // A compressed file is decompressed straight out of the mapping.
+            compression = grrDetectCompression(map, reader->map_len);
+            if (compression != GRR_COMPRESSION_NONE &&
+                grrDecompressorStart(compression, map, reader->map_len, true, -1, &reader->decompressor) !=
+                    GRR_APP_RET_OK) {
+                grrReaderClose(reader);
+                return GRR_APP_RET_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+void
+grrReaderAttach(grrReader *reader, int fd)
+{
+    resetReader(reader);
+    reader->stream = true;
+    reader->fd = fd;
+}
+
+int
+grrReaderNext(grrReader *reader, const char **data, size_t *len)
+{
+    int ret;
+    char *newline;
+
+    if (reader->map && !reader->decompressor) {
+        if (reader->eof) {
+            return GRR_APP_RET_DONE;
+        }
+        reader->eof = true;
+        *data = reader->map;
+        *len = reader->map_len;
+        return GRR_APP_RET_OK;
+    }
+
+    // Move the partial line left over from the previous chunk to the start of the buffer.
+    if (reader->consumed > 0) {
+        reader->filled -= reader->consumed;
+        memmove(reader->buffer, reader->buffer + reader->consumed, reader->filled);
+        reader->consumed = 0;
+    }
+
+    for (;;) {
+        size_t searched = reader->filled;
+
+        if (reader->eof) {
+            if (reader->filled == 0) {
+                return GRR_APP_RET_DONE;
+            }
+            *data = reader->buffer;
+            *len = reader->consumed = reader->filled;
+            return GRR_APP_RET_OK;
+        }
+
+        ret = fillBuffer(reader);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+
+        if (reader->eof) {
+            continue;
+        }
+
+        newline = memrchr(reader->buffer + searched, '\n', reader->filled - searched);
+        if (newline) {
+            *data = reader->buffer;
+            *len = reader->consumed = newline + 1 - reader->buffer;
+            return GRR_APP_RET_OK;
+        }
+
+        if (reader->stream && reader->filled >= GRR_STREAM_LINE_LIMIT) {
+            *data = reader->buffer;
+            *len = reader->consumed = reader->filled;
+            return GRR_APP_RET_OK;
+        }
+    }
+}
+
+void
+grrReaderClose(grrReader *reader)
+{
+    // The decompressor may still be reading from the mapping.
+    if (reader->decompressor) {
+        grrDecompressorFree(reader->decompressor);
+        reader->decompressor = NULL;
+    }
+    if (reader->map) {
+        if (!reader->borrowed) {
+            munmap(reader->map, reader->map_len);
+        }
+        reader->map = NULL;
+        reader->borrowed = false;
+    }
+    if (reader->fd != -1) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+void
+grrReaderFree(grrReader *reader)
+{
+    grrReaderClose(reader);
+    free(reader->buffer);
+    grrReaderInit(reader);
+}
+
+/*
+ * Prepares the reader for a new file while keeping its buffer.
+ */
+static void
+resetReader(grrReader *reader)
+{
+    reader->filled = reader->consumed = 0;
+    reader->map = NULL;
+    reader->map_len = 0;
+    reader->fd = -1;
+    reader->eof = false;
+    reader->stream = false;
+    reader->sniffed = false;
+    reader->borrowed = false;
+}
+
+static int
+fillBuffer(grrReader *reader)
+{
+    int ret;
+    ssize_t num_read;
+
+    // The buffer only has to grow when a single line doesn't fit into it.
+    if (reader->capacity - reader->filled < GRR_READ_BLOCK_SIZE / 2) {
+        size_t new_capacity = reader->capacity ? 2 * reader->capacity : GRR_READ_BLOCK_SIZE;
+        char *new_buffer;
+
+        new_buffer = realloc(reader->buffer, new_capacity);
+        if (!new_buffer) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        reader->buffer = new_buffer;
+        reader->capacity = new_capacity;
+    }
+
+    if (reader->decompressor) {
+        size_t len;
+
+        ret = grrDecompressorRead(reader->decompressor, reader->buffer + reader->filled,
+                                  reader->capacity - reader->filled, &len);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+        num_read = len;
+    }
+    else {
+        do {
+            num_read = read(reader->fd, reader->buffer + reader->filled, reader->capacity - reader->filled);
+        } while (num_read == -1 && errno == EINTR);
+
+        if (num_read == -1) {
+            return GRR_APP_RET_FILE_ACCESS;
+        }
+
+        // The first block read tells whether the file is compressed.  If it is, the block is handed over to the
+        // decompressor, which reads the rest of the file itself.
+        if (!reader->sniffed) {
+            int compression;
+
+            reader->sniffed = true;
+            compression = grrDetectCompression(reader->buffer + reader->filled, num_read);
+            if (compression != GRR_COMPRESSION_NONE) {
+                ret = grrDecompressorStart(compression, reader->buffer + reader->filled, num_read, false,
+                                           reader->fd, &reader->decompressor);
+                if (ret != GRR_APP_RET_OK) {
+                    return ret;
+                }
+                return fillBuffer(reader);
+            }
+        }
+    }
+
+    if (num_read == 0) {
+        reader->eof = true;
+    }
+    reader->filled += num_read;
+
+    return GRR_APP_RET_OK;
+}
@@ -0,0 +1,87 @@
+#ifndef GRR_READER_H
+#define GRR_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "decompress.h"
+
+/*
+ * Regular files at least this large are memory-mapped.  Anything smaller is read with a single read() into
+ * the reader's buffer since that's cheaper than setting up and tearing down a mapping.
+ */
+#define GRR_MMAP_THRESHOLD (64 * 1024)
+
+/*
+ * The size of the blocks read from files which aren't memory-mapped.
+ */
+#define GRR_READ_BLOCK_SIZE (256 * 1024)
+
+/*
+ * When reading from a stream, a line which grows beyond this many bytes is handed out in pieces so that the
+ * buffer stays bounded.  The pieces don't overlap, so a match which crosses from one to the next isn't found.
+ */
+#define GRR_STREAM_LINE_LIMIT (4 * 1024 * 1024)
+
+/*
+ * Hands out the contents of a file as a series of chunks, each of which ends on a line boundary (except,
+ * possibly, the last one).  Memory-mapped files are handed out as a single chunk.  Otherwise, the partial line
+ * at the end of each block is carried over to the start of the next one.  The buffer is kept between files so
+ * that a thread only allocates it once.
+ *
+ * Compressed files are recognized by their first bytes and are handed out decompressed.  The decompression
+ * runs on a separate thread (see decompress.h) and its output is read into the buffer just like a file's.
+ */
+typedef struct grrReader {
+    char *buffer;
+    size_t capacity;
+    size_t filled;
+    size_t consumed;
+    char *map;
+    size_t map_len;
+    grrDecompressor *decompressor;
+    int fd;
+    bool eof;
+    bool stream;
+    bool sniffed;
+    bool borrowed;
+} grrReader;
+
+void
+grrReaderInit(grrReader *reader);
+
+/*
+ * Opens the file at path, relative to dir_fd, which may be AT_FDCWD.
+ */
+int
+grrReaderOpen(grrReader *reader, int dir_fd, const char *path);
+
+/*
+ * Takes over a file which has already been opened and, possibly, partly read (see prefetch.h).  If fd is -1,
+ * data holds the whole file and is handed out without being copied, so it has to remain valid until the reader
+ * is closed.  Otherwise, the reader takes ownership of the file descriptor, whose offset has to be 0, and
+ * proceeds exactly as grrReaderOpen would.
+ */
+int
+grrReaderAdopt(grrReader *reader, int fd, const char *data, size_t len);
+
+/*
+ * Reads from an already open file descriptor (e.g., stdin or a pipe) which is never memory-mapped.  The reader
+ * takes ownership of the file descriptor.  Each chunk is handed out as soon as a complete line has been read.
+ */
+void
+grrReaderAttach(grrReader *reader, int fd);
+
+/*
+ * Sets *data and *len to the next chunk.  Returns GRR_APP_RET_DONE once the file has been exhausted.
+ */
+int
+grrReaderNext(grrReader *reader, const char **data, size_t *len);
+
+void
+grrReaderClose(grrReader *reader);
+
+void
+grrReaderFree(grrReader *reader);
+
+#endif  // GRR_READER_H
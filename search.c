@@ -0,0 +1,1491 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "grr.h"
+#include "simd.h"
+
+static bool
+passesFilter(const struct stat *file_stat, const grrFileFilter *filter);
+
+static int
+searchNextPrefetched(char *path, size_t offset, long *line_no, grrSearchState *state, grrResultSet *results,
+                     const grrOptions *options);
+
+static int
+drainPrefetcher(char *path, size_t offset, long *line_no, grrSearchState *state, grrResultSet *results,
+                const grrOptions *options);
+
+static int
+nextChunk(grrSearchState *state, const char **chunk, size_t *chunk_len);
+
+static int
+searchChunk(const char *path, const char *chunk, size_t chunk_len, size_t *file_line_no,
+            grrResultSet *results, grrSearchState *state, const grrOptions *options);
+
+static int
+checkSkippedLines(const char *path, const char *from, const char *to, size_t file_line_no, grrSearchState *state,
+                  const grrOptions *options);
+
+static int
+searchLine(const char *path, const char *line, size_t len, size_t file_line_no, bool filtered,
+           grrResultSet *results, grrSearchState *state, const grrOptions *options);
+
+static void
+abandonDfa(grrSearchState *state, const grrOptions *options);
+
+static int
+addResult(grrResultSet *results, size_t file_line_no);
+
+static int
+appendText(grrResultSet *results, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static int
+appendBytes(grrResultSet *results, const char *data, size_t len);
+
+static size_t
+findAllMatches(const char *line, size_t len, size_t start, size_t end, size_t pattern, grrSearchState *state,
+               const grrOptions *options);
+
+static int
+formatResult(grrResultSet *results, const char *line, size_t len, const grrMatchSpan *spans, size_t num_spans,
+             size_t file_line_no, size_t pattern, grrContext *context, const grrOptions *options);
+
+static int
+formatMatches(grrResultSet *results, const char *line, const grrMatchSpan *spans, size_t num_spans,
+              size_t file_line_no, size_t pattern, const grrOptions *options);
+
+static int
+formatCount(grrResultSet *results, const grrSearchState *state, const grrOptions *options);
+
+static int
+appendFullLine(grrResultSet *results, const char *line, size_t len, const grrMatchSpan *spans, size_t num_spans,
+               const grrOptions *options);
+
+static void
+resetContext(grrContext *context);
+
+static const char *
+precedingLines(const char *base, const char *end, size_t count, size_t *found);
+
+static int
+carryContext(grrContext *context, const char *chunk, size_t chunk_len);
+
+static int
+appendBeforeContext(grrResultSet *results, const char *line, size_t file_line_no, const grrContext *context,
+                    const grrOptions *options);
+
+static int
+appendContextLines(grrResultSet *results, const char *start, const char *end, size_t file_line_no,
+                   const grrOptions *options);
+
+static int
+appendContextLine(grrResultSet *results, const char *line, size_t len, size_t file_line_no,
+                  const grrOptions *options);
+
+int
+initSearchState(grrSearchState *state, const grrOptions *options, bool copy_patterns)
+{
+    int ret;
+
+    *state = (grrSearchState){0};
+    grrReaderInit(&state->reader);
+
+    // Stats are only a diagnostic so the search goes ahead without them if they can't be allocated.
+    if (options->stats) {
+        state->stats = calloc(1, sizeof(*state->stats));
+        state->total_stats = options->stats;
+    }
+    grrArenaInit(&state->arena, state->stats, false);
+
+    // Context is only printed along with the matching lines themselves.
+    if (!options->names_only && !options->editor && !options->count_matches && !options->only_matching) {
+        state->context.before = options->before_context;
+        state->context.after = options->after_context;
+    }
+
+    state->search_patterns = calloc(options->num_patterns, sizeof(*state->search_patterns));
+    if (!state->search_patterns) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto error;
+    }
+    state->num_patterns = options->num_patterns;
+
+    // Without a DFA, every line is simply left to the NFAs.
+    if (options->search_program && grrDfaCreate(options->search_program, &state->dfa) != GRR_APP_RET_OK) {
+        state->dfa = NULL;
+    }
+
+    if (!copy_patterns) {
+        for (size_t k = 0; k < options->num_patterns; k++) {
+            state->search_patterns[k] = options->patterns[k].nfa;
+        }
+        state->file_pattern = options->file_pattern;
+        return GRR_APP_RET_OK;
+    }
+
+    state->owns_patterns = true;
+
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        const char *regex = options->patterns[k].search_regex;
+
+        ret = grrCompile(regex, strlen(regex), state->search_patterns + k);
+        if (ret != GRR_APP_RET_OK) {
+            goto error;
+        }
+    }
+
+    if (options->file_regex) {
+        ret = grrCompile(options->file_regex, strlen(options->file_regex), &state->file_pattern);
+        if (ret != GRR_APP_RET_OK) {
+            goto error;
+        }
+    }
+
+    return GRR_APP_RET_OK;
+
+error:
+
+    freeSearchState(state);
+    return ret;
+}
+
+void
+freeSearchState(grrSearchState *state)
+{
+    if (state->owns_patterns) {
+        for (size_t k = 0; k < state->num_patterns; k++) {
+            grrFreeNfa(state->search_patterns[k]);
+        }
+        grrFreeNfa(state->file_pattern);
+    }
+    free(state->search_patterns);
+    grrDfaFree(state->dfa);
+    grrReaderFree(&state->reader);
+    grrPrefetcherFree(state->prefetcher);
+    grrArenaFree(&state->arena);
+    free(state->context.carried);
+    free(state->spans);
+    grrStatsMerge(state->total_stats, state->stats);
+    free(state->stats);
+    *state = (grrSearchState){0};
+}
+
+void
+clearResultSet(grrResultSet *results)
+{
+    results->num_results = 0;
+    results->text_len = 0;
+}
+
+void
+freeResultSet(grrResultSet *results)
+{
+    free(results->results);
+    free(results->text);
+    *results = (grrResultSet){0};
+}
+
+int
+examineEntry(int dir_fd, const char *name, unsigned char type, char *path, size_t offset, long depth,
+             size_t *new_len, struct stat *file_stat, const grrIgnoreList *ignore, const grrSearchState *state,
+             const grrOptions *options)
+{
+    size_t name_len, len;
+    struct stat entry_stat;
+
+    GRR_STAT_ADD(state->stats, GRR_STAT_ENTRIES, 1);
+
+    if (name[0] == '.') {
+        if (options->ignore_hidden || name[1] == '\0' || (name[1] == '.' && name[2] == '\0') ||
+            strcmp(name, GRR_INDEX) == 0 || (options->ignore_files && strcmp(name, ".git") == 0)) {
+            return GRR_ENTRY_SKIP;
+        }
+    }
+
+    name_len = strlen(name);
+    len = offset + name_len;
+    if (len >= PATH_MAX) {
+        if (options->verbose) {
+            path[offset] = '\0';
+            fprintf(stderr, "Skipping file in the %s directory because its name is too long.\n", path);
+        }
+        return GRR_ENTRY_SKIP;
+    }
+    memcpy(path + offset, name, name_len + 1);
+
+    if (type == DT_UNKNOWN || (type == DT_REG && (file_stat || options->index || options->filter_files))) {
+        if (!file_stat) {
+            file_stat = &entry_stat;
+        }
+
+        GRR_STAT_ADD(state->stats, GRR_STAT_LSTATS, 1);
+        if (fstatat(dir_fd, name, file_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+            if (options->verbose) {
+                fprintf(stderr, "Could not lstat %s: %s\n", path, strerror(errno));
+            }
+            return GRR_ENTRY_SKIP;
+        }
+
+        if (S_ISREG(file_stat->st_mode)) {
+            type = DT_REG;
+        }
+        else if (S_ISDIR(file_stat->st_mode)) {
+            type = DT_DIR;
+        }
+        else {
+            return GRR_ENTRY_SKIP;
+        }
+    }
+
+    if (ignore && (type == DT_REG || type == DT_DIR) && grrIgnoreMatch(ignore, path, name, type == DT_DIR)) {
+        if (options->verbose) {
+            fprintf(stderr, "Skipping %s since it's ignored.\n", path);
+        }
+        return GRR_ENTRY_SKIP;
+    }
+
+    if (type == DT_REG) {
+        if (state->file_pattern &&
+            grrSearch(state->file_pattern, name, name_len, NULL, NULL, NULL, false) != GRR_RET_OK) {
+            GRR_STAT_ADD(state->stats, GRR_STAT_FILE_PATTERN_SKIPS, 1);
+            return GRR_ENTRY_SKIP;
+        }
+
+        if (options->filter_files && !passesFilter(file_stat, &options->filter)) {
+            if (options->verbose) {
+                fprintf(stderr, "Skipping %s because of its size or modification time.\n", path);
+            }
+            return GRR_ENTRY_SKIP;
+        }
+
+        if (options->index && grrIndexExcludes(options->index, path, file_stat)) {
+            if (options->verbose) {
+                fprintf(stderr, "Skipping %s since the index shows that it can't match.\n", path);
+            }
+            return GRR_ENTRY_SKIP;
+        }
+
+        *new_len = len;
+        return GRR_ENTRY_FILE;
+    }
+    else if (type == DT_DIR) {
+        if (depth + 1 == options->depth) {
+            return GRR_ENTRY_SKIP;
+        }
+
+        if (options->exclude_dirs && grrIgnoreMatch(options->exclude_dirs, path, name, true)) {
+            if (options->verbose) {
+                fprintf(stderr, "Skipping %s since it's excluded.\n", path);
+            }
+            return GRR_ENTRY_SKIP;
+        }
+
+        if (len + 1 == PATH_MAX) {
+            if (options->verbose) {
+                path[offset] = '\0';
+                fprintf(stderr, "Skipping subdirectory of %s because its name is too long.\n", path);
+            }
+            return GRR_ENTRY_SKIP;
+        }
+
+        path[len++] = '/';
+        path[len] = '\0';
+
+        *new_len = len;
+        return GRR_ENTRY_DIRECTORY;
+    }
+
+    return GRR_ENTRY_SKIP;
+}
+
+int
+searchDirectoryTree(grrDirectory *dir, char *path, size_t offset, long depth, grrIgnoreList *ignore, long *line_no,
+                    grrSearchState *state, grrResultSet *results, const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK, entry_type;
+    unsigned char type;
+    size_t new_len;
+    uint64_t start;
+    const char *name;
+    struct stat file_stat, *stat_ptr = options->result_cache ? &file_stat : NULL;
+
+    GRR_STAT_ADD(state->stats, GRR_STAT_DIRECTORIES, 1);
+    start = grrStatsStart(state->stats);
+
+    // The directory's own rules are added to the inherited ones before any of its entries are looked at.
+    if (options->ignore_files) {
+        grrIgnoreList *parent = ignore;
+
+        if (grrIgnoreLoad(dir->fd, offset, parent, &ignore) != GRR_APP_RET_OK && options->verbose) {
+            fprintf(stderr, "Failed to read the ignore file in %s.\n", path);
+        }
+    }
+
+    while (grrDirectoryNext(dir, &name, &type) == GRR_APP_RET_OK) {
+        entry_type =
+            examineEntry(dir->fd, name, type, path, offset, depth, &new_len, stat_ptr, ignore, state, options);
+        grrStatsStop(state->stats, GRR_TIMER_TRAVERSAL, start);
+
+        switch (entry_type) {
+        case GRR_ENTRY_FILE:
+            // With a prefetcher, the file is only submitted and is searched once the window is full.
+            if (state->prefetcher) {
+                if (grrPrefetcherFull(state->prefetcher)) {
+                    ret = searchNextPrefetched(path, offset, line_no, state, results, options);
+                    if (ret == GRR_APP_RET_DONE) {
+                        grrPrefetcherCancel(state->prefetcher);
+                        goto done;
+                    }
+                    ret = GRR_APP_RET_OK;
+                }
+                if (grrPrefetcherSubmit(state->prefetcher, dir->fd, name, stat_ptr) == GRR_APP_RET_OK) {
+                    break;
+                }
+                ret = drainPrefetcher(path, offset, line_no, state, results, options);
+                if (ret == GRR_APP_RET_DONE) {
+                    goto done;
+                }
+            }
+
+            searchFileForPattern(dir->fd, name, path, stat_ptr, results, state, options);
+            start = grrStatsStart(state->stats);
+            ret = emitResults(path, results, line_no, options);
+            grrStatsStop(state->stats, GRR_TIMER_OUTPUT, start);
+            if (ret == GRR_APP_RET_DONE) {
+                goto done;
+            }
+            break;
+
+        case GRR_ENTRY_DIRECTORY: {
+            grrDirectory subdir;
+            grrArenaMark mark = grrArenaGetMark(&state->arena);
+
+            // The files before the subdirectory have to be printed before anything in it.
+            if (state->prefetcher) {
+                ret = drainPrefetcher(path, offset, line_no, state, results, options);
+                if (ret == GRR_APP_RET_DONE) {
+                    goto done;
+                }
+            }
+
+            start = grrStatsStart(state->stats);
+            ret = grrDirectoryOpen(&subdir, dir->fd, name, &state->arena);
+            grrStatsStop(state->stats, GRR_TIMER_TRAVERSAL, start);
+            if (ret != GRR_APP_RET_OK) {
+                ret = GRR_APP_RET_OK;
+                if (options->verbose) {
+                    fprintf(stderr, "Could not access directory: %s\n", path);
+                }
+                break;
+            }
+
+            ret = searchDirectoryTree(&subdir, path, new_len, depth + 1, ignore, line_no, state, results, options);
+            grrDirectoryClose(&subdir);
+            grrArenaReset(&state->arena, mark);
+            if (ret == GRR_APP_RET_DONE) {
+                goto done;
+            }
+            ret = GRR_APP_RET_OK;
+        } break;
+
+        default: break;
+        }
+
+        start = grrStatsStart(state->stats);
+    }
+    grrStatsStop(state->stats, GRR_TIMER_TRAVERSAL, start);
+
+    if (state->prefetcher) {
+        ret = drainPrefetcher(path, offset, line_no, state, results, options);
+    }
+
+done:
+
+    path[offset] = '\0';
+    if (options->ignore_files) {
+        grrIgnoreRelease(ignore);
+    }
+
+    return ret;
+}
+
+int
+searchFileForPattern(int dir_fd, const char *name, const char *path, const struct stat *file_stat,
+                     grrResultSet *results, grrSearchState *state, const grrOptions *options)
+{
+    int ret, reader_ret;
+    size_t file_line_no = 1, chunk_len;
+    uint64_t start;
+    const char *chunk;
+
+    clearResultSet(results);
+
+    if (file_stat && grrResultCacheLookup(options->result_cache, path, file_stat, results)) {
+        if (options->verbose) {
+            fprintf(stderr, "Reusing the cached results for %s.\n", path);
+        }
+        GRR_STAT_ADD(state->stats, GRR_STAT_CACHE_HITS, 1);
+        grrResultCacheRecord(options->result_cache, path, file_stat, results);
+        return (results->num_results > 0) ? GRR_APP_RET_OK : GRR_APP_RET_NOT_FOUND;
+    }
+
+    if (options->verbose) {
+        fprintf(stderr, "Opening %s.\n", path);
+    }
+
+    start = grrStatsStart(state->stats);
+    if (state->prefetched) {
+        grrPrefetchedFile *file = state->prefetched;
+
+        if (file->error != 0) {
+            ret = GRR_APP_RET_FILE_ACCESS;
+        }
+        else {
+            // The reader now owns the file descriptor, if there is one.
+            ret = grrReaderAdopt(&state->reader, file->fd, file->data, file->len);
+            file->fd = -1;
+        }
+    }
+    else {
+        ret = grrReaderOpen(&state->reader, dir_fd, name);
+    }
+    grrStatsStop(state->stats, GRR_TIMER_IO, start);
+    if (ret != GRR_APP_RET_OK) {
+        if (options->verbose) {
+            fprintf(stderr, "Could not read %s.\n", path);
+        }
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+    GRR_STAT_ADD(state->stats, GRR_STAT_FILES_OPENED, 1);
+    resetContext(&state->context);
+    state->file_count = 0;
+
+    while ((reader_ret = nextChunk(state, &chunk, &chunk_len)) == GRR_APP_RET_OK) {
+        if (file_line_no == 1 && state->reader.decompressor && options->verbose) {
+            fprintf(stderr, "Decompressing %s.\n", path);
+        }
+
+        if (file_line_no == 1 && !options->binary_as_text &&
+            grrLooksBinary(chunk, MIN(chunk_len, GRR_BINARY_SCAN_SIZE))) {
+            if (options->verbose) {
+                fprintf(stderr, "Skipping %s since it appears to be a binary file.\n", path);
+            }
+            GRR_STAT_ADD(state->stats, GRR_STAT_BINARY_ABORTS, 1);
+            ret = GRR_APP_RET_NOT_FOUND;
+            goto done;
+        }
+
+        start = grrStatsStart(state->stats);
+        ret = searchChunk(path, chunk, chunk_len, &file_line_no, results, state, options);
+        grrStatsStop(state->stats, GRR_TIMER_MATCHING, start);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+    }
+
+    if (reader_ret != GRR_APP_RET_DONE) {
+        if (options->verbose) {
+            fprintf(stderr, "Failed to read from %s.\n", path);
+        }
+        ret = reader_ret;
+        goto done;
+    }
+
+    if (state->file_count > 0 && formatCount(results, state, options) != GRR_APP_RET_OK) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    ret = (results->num_results > 0) ? GRR_APP_RET_OK : GRR_APP_RET_NOT_FOUND;
+
+done:
+
+    grrReaderClose(&state->reader);
+
+    if (ret == GRR_APP_RET_DONE) {
+        ret = GRR_APP_RET_OK;
+    }
+    // Read errors aren't cached so that the file is tried again next time.
+    if (file_stat && (ret == GRR_APP_RET_OK || ret == GRR_APP_RET_NOT_FOUND)) {
+        grrResultCacheRecord(options->result_cache, path, file_stat, results);
+    }
+    return ret;
+}
+
+int
+searchStream(int fd, const char *name, long *line_no, grrSearchState *state, grrResultSet *results,
+             const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK, reader_ret;
+    size_t file_line_no = 1, chunk_len;
+    uint64_t start;
+    const char *chunk;
+    bool warned_split = false;
+
+    grrReaderAttach(&state->reader, fd);
+    GRR_STAT_ADD(state->stats, GRR_STAT_FILES_OPENED, 1);
+    resetContext(&state->context);
+    state->file_count = 0;
+
+    while ((reader_ret = nextChunk(state, &chunk, &chunk_len)) == GRR_APP_RET_OK) {
+        size_t start_line_no = file_line_no;
+
+        if (file_line_no == 1 && !options->binary_as_text &&
+            grrLooksBinary(chunk, MIN(chunk_len, GRR_BINARY_SCAN_SIZE))) {
+            if (options->verbose) {
+                fprintf(stderr, "Skipping %s since it appears to be binary.\n", name);
+            }
+            GRR_STAT_ADD(state->stats, GRR_STAT_BINARY_ABORTS, 1);
+            goto done;
+        }
+
+        clearResultSet(results);
+        start = grrStatsStart(state->stats);
+        ret = searchChunk(name, chunk, chunk_len, &file_line_no, results, state, options);
+        grrStatsStop(state->stats, GRR_TIMER_MATCHING, start);
+        if (ret != GRR_APP_RET_OK && ret != GRR_APP_RET_DONE) {
+            goto done;
+        }
+
+        start = grrStatsStart(state->stats);
+        emitResults(name, results, line_no, options);
+        grrOutputFlush(options->output);
+        grrStatsStop(state->stats, GRR_TIMER_OUTPUT, start);
+
+        // With -n, the stream is done with as soon as it's known to match.
+        if (ret == GRR_APP_RET_DONE) {
+            ret = GRR_APP_RET_OK;
+            goto done;
+        }
+
+        // A line which was too long to be buffered in one piece continues into the next chunk.
+        if (chunk[chunk_len - 1] != '\n') {
+            file_line_no = start_line_no + grrCountNewlines(chunk, chunk_len);
+
+            // The pieces don't overlap so the user is told that matches could have been missed.
+            if (!state->reader.eof && !warned_split) {
+                fprintf(stderr,
+                        "Line %zu of %s is longer than %i MiB so it is searched in pieces.  Matches which cross "
+                        "from one piece to the next are missed.\n",
+                        file_line_no, name, GRR_STREAM_LINE_LIMIT / (1024 * 1024));
+                warned_split = true;
+            }
+        }
+    }
+
+    if (reader_ret != GRR_APP_RET_DONE) {
+        if (options->verbose) {
+            fprintf(stderr, "Failed to read from %s.\n", name);
+        }
+        ret = reader_ret;
+        goto done;
+    }
+
+    // The count can only be printed once the whole stream has been read.
+    if (state->file_count > 0) {
+        clearResultSet(results);
+        ret = formatCount(results, state, options);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+        emitResults(name, results, line_no, options);
+        grrOutputFlush(options->output);
+    }
+
+done:
+
+    grrReaderClose(&state->reader);
+
+    return ret;
+}
+
+int
+emitResults(const char *path, const grrResultSet *results, long *line_no, const grrOptions *options)
+{
+    size_t path_len = strlen(path);
+
+    for (size_t k = 0; k < results->num_results; k++) {
+        const grrResult *result = results->results + k;
+
+        (*line_no)++;
+
+        if (options->editor) {
+            if (*line_no == options->line_no) {
+                executeEditor(options->editor, path, options->names_only ? 1 : result->file_line_no,
+                              options->verbose);
+                return GRR_APP_RET_DONE;
+            }
+            continue;
+        }
+
+        if (options->history) {
+            if (k == 0) {
+                grrHistoryAddFile(options->history, path, path_len);
+            }
+            grrHistoryAddResult(options->history, result->file_line_no);
+        }
+
+        grrOutputWrite(options->output, "(", 1);
+        grrOutputNumber(options->output, *line_no);
+        grrOutputWrite(options->output, ") ", 2);
+        grrOutputWrite(options->output, path, path_len);
+        grrOutputWrite(options->output, results->text + result->offset, result->len);
+    }
+
+    if (options->output->interactive) {
+        grrOutputFlush(options->output);
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Searches the oldest file in the prefetcher, whose name is appended to path, and emits its results.  The entry
+ * which was at the end of path is restored afterward.  Returns GRR_APP_RET_NOT_FOUND if no files are pending.
+ */
+static int
+searchNextPrefetched(char *path, size_t offset, long *line_no, grrSearchState *state, grrResultSet *results,
+                     const grrOptions *options)
+{
+    int ret;
+    uint64_t start;
+    char entry[NAME_MAX + 2];
+    grrPrefetchedFile *file;
+
+    start = grrStatsStart(state->stats);
+    file = grrPrefetcherNext(state->prefetcher);
+    grrStatsStop(state->stats, GRR_TIMER_IO, start);
+    if (!file) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    // examineEntry already made sure that the name fits.
+    strcpy(entry, path + offset);
+    strcpy(path + offset, file->name);
+
+    state->prefetched = file;
+    searchFileForPattern(AT_FDCWD, file->name, path, options->result_cache ? &file->file_stat : NULL, results,
+                         state, options);
+    state->prefetched = NULL;
+    grrPrefetcherRelease(state->prefetcher, file);
+
+    start = grrStatsStart(state->stats);
+    ret = emitResults(path, results, line_no, options);
+    grrStatsStop(state->stats, GRR_TIMER_OUTPUT, start);
+
+    strcpy(path + offset, entry);
+    return ret;
+}
+
+/*
+ * Searches every file in the prefetcher.  If the search is over, the rest are discarded.
+ */
+static int
+drainPrefetcher(char *path, size_t offset, long *line_no, grrSearchState *state, grrResultSet *results,
+                const grrOptions *options)
+{
+    int ret;
+
+    while ((ret = searchNextPrefetched(path, offset, line_no, state, results, options)) !=
+           GRR_APP_RET_NOT_FOUND) {
+        if (ret == GRR_APP_RET_DONE) {
+            grrPrefetcherCancel(state->prefetcher);
+            return GRR_APP_RET_DONE;
+        }
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+static bool
+passesFilter(const struct stat *file_stat, const grrFileFilter *filter)
+{
+    if (file_stat->st_size < filter->min_size ||
+        (filter->max_size >= 0 && file_stat->st_size > filter->max_size)) {
+        return false;
+    }
+    if ((filter->newer_than && file_stat->st_mtime < filter->newer_than) ||
+        (filter->older_than && file_stat->st_mtime >= filter->older_than)) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Gets the next chunk from the reader while accounting for the time spent reading it.
+ */
+static int
+nextChunk(grrSearchState *state, const char **chunk, size_t *chunk_len)
+{
+    int ret;
+    uint64_t start;
+
+    start = grrStatsStart(state->stats);
+    ret = grrReaderNext(&state->reader, chunk, chunk_len);
+    grrStatsStop(state->stats, GRR_TIMER_IO, start);
+    if (ret == GRR_APP_RET_OK) {
+        GRR_STAT_ADD(state->stats, GRR_STAT_BYTES_READ, *chunk_len);
+    }
+
+    return ret;
+}
+
+static int
+searchChunk(const char *path, const char *chunk, size_t chunk_len, size_t *file_line_no,
+            grrResultSet *results, grrSearchState *state, const grrOptions *options)
+{
+    const char *cursor = chunk, *chunk_end = chunk + chunk_len;
+    const grrLiteral *literal = &options->patterns[0].literal;
+    bool prefilter = options->search_literals || (options->num_patterns == 1 && literal->len > 0);
+    grrContext *context = &state->context;
+
+    context->chunk = chunk;
+    context->chunk_line_no = *file_line_no;
+
+    while (cursor < chunk_end) {
+        int ret;
+        bool filtered = false;
+        size_t num_results = results->num_results;
+        const char *line, *newline;
+
+        // Each line after a match has to be looked at until the match's after-context is complete.
+        if (context->after_remaining > 0) {
+            line = cursor;
+        }
+        // Only the lines which contain a required literal can possibly match so skip straight to them.
+        else if (prefilter) {
+            const char *hit;
+
+            if (options->search_literals) {
+                hit = grrAhoCorasickFind(options->search_literals, cursor, chunk_end - cursor);
+            }
+            else if (options->fold_case) {
+                hit = grrFindLiteralFold(cursor, chunk_end - cursor, literal->string, literal->len);
+            }
+            else {
+                hit = grrFindLiteral(cursor, chunk_end - cursor, literal->string, literal->len);
+            }
+            line = hit ? memrchr(cursor, '\n', hit - cursor) : NULL;
+            line = line ? line + 1 : (hit ? cursor : chunk_end);
+
+            // The skipped lines still have to be rejected if the engine would consider them non-printable.
+            if (!options->binary_as_text) {
+                ret = checkSkippedLines(path, cursor, line, *file_line_no, state, options);
+                if (ret != GRR_APP_RET_OK) {
+                    return ret;
+                }
+            }
+            if (!hit) {
+                break;
+            }
+        }
+        // Otherwise, let the DFA run across the rest of the chunk until it finds a line which could match.
+        else if (state->dfa) {
+            size_t offset;
+
+            ret = grrDfaScan(state->dfa, cursor, chunk_end - cursor, &offset);
+            if (ret == GRR_APP_RET_NOT_FOUND) {
+                break;
+            }
+            if (ret == GRR_APP_RET_OK) {
+                line = cursor + offset;
+                filtered = true;
+            }
+            else {
+                abandonDfa(state, options);
+                line = cursor;
+            }
+        }
+        else {
+            line = cursor;
+        }
+
+        // Line numbers are only needed for the lines which are actually searched.
+        if (line > cursor) {
+            *file_line_no += grrCountNewlines(cursor, line - cursor);
+        }
+
+        newline = memchr(line, '\n', chunk_end - line);
+        ret = searchLine(path, line, (newline ? newline : chunk_end) - line, *file_line_no, filtered, results,
+                         state, options);
+        if (ret == GRR_APP_RET_OK && context->after_remaining > 0 && results->num_results == num_results) {
+            ret = appendContextLine(results, line, (newline ? newline : chunk_end) - line, *file_line_no, options);
+            context->printed_through = *file_line_no;
+            context->after_remaining--;
+        }
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+
+        (*file_line_no)++;
+        cursor = newline ? newline + 1 : chunk_end;
+    }
+
+    if (cursor < chunk_end) {
+        *file_line_no += grrCountNewlines(cursor, chunk_end - cursor);
+    }
+
+    return (context->before > 0) ? carryContext(context, chunk, chunk_len) : GRR_APP_RET_OK;
+}
+
+/*
+ * Has the engine look at each of the lines in [from, to) which might contain a non-printable byte, even though
+ * they can't match, so that a file is abandoned on them just as it would be if they had been searched.
+ * file_line_no is the number of the line which starts at from.
+ */
+static int
+checkSkippedLines(const char *path, const char *from, const char *to, size_t file_line_no, grrSearchState *state,
+                  const grrOptions *options)
+{
+    const char *byte;
+
+    while (from < to && (byte = grrFindNonPrintable(from, to - from))) {
+        const char *line, *newline;
+        size_t len, start, end, cursor;
+
+        line = memrchr(from, '\n', byte - from);
+        line = line ? line + 1 : from;
+        file_line_no += grrCountNewlines(from, line - from);
+        newline = memchr(byte, '\n', to - byte);
+
+        // Carriage returns at the end of a line are stripped before it's searched.
+        for (len = (newline ? newline : to) - line; len > 0 && line[len - 1] == '\r'; len--)
+            ;
+        if (byte < line + len &&
+            grrSearch(state->search_patterns[0], line, len, &start, &end, &cursor, false) == GRR_RET_BAD_DATA) {
+            if (options->verbose) {
+                fprintf(stderr,
+                        "Terminating processing of %s since it contains non-printable data on line %zu, column "
+                        "%zu.\n",
+                        path, file_line_no, cursor);
+            }
+            return GRR_APP_RET_BAD_DATA;
+        }
+
+        if (!newline) {
+            break;
+        }
+        file_line_no++;
+        from = newline + 1;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * If filtered is true, then the DFA has already accepted the line.
+ */
+static int
+searchLine(const char *path, const char *line, size_t len, size_t file_line_no, bool filtered,
+           grrResultSet *results, grrSearchState *state, const grrOptions *options)
+{
+    int ret, engine_ret;
+    size_t start, end, cursor, num_spans;
+
+    for (; len > 0 && line[len - 1] == '\r'; len--)
+        ;
+    if (len == 0) {
+        return GRR_APP_RET_OK;
+    }
+
+    if (state->dfa && !filtered) {
+        switch (grrDfaMatch(state->dfa, line, len)) {
+        case GRR_APP_RET_NOT_FOUND: return GRR_APP_RET_OK;
+
+        case GRR_APP_RET_OVERFLOW: abandonDfa(state, options); break;
+
+        default: break;
+        }
+    }
+
+    // A line produces at most one result (one per match with --only-matching), which is attributed to the first
+    // pattern that matches it.  Only that pattern's matches are collected, even with --all-matches.
+    for (size_t k = 0; k < options->num_patterns; k++) {
+        const grrLiteral *literal = &options->patterns[k].literal;
+
+        // With only one pattern, searchChunk has already checked for the literal.
+        if (options->num_patterns > 1 && literal->len > 0 &&
+            !(options->fold_case ? grrFindLiteralFold(line, len, literal->string, literal->len) :
+                                   grrFindLiteral(line, len, literal->string, literal->len))) {
+            continue;
+        }
+
+        engine_ret =
+            grrSearch(state->search_patterns[k], line, len, &start, &end, &cursor, options->binary_as_text);
+        if (engine_ret == GRR_RET_BAD_DATA) {
+            if (options->verbose) {
+                fprintf(stderr,
+                        "Terminating processing of %s since it contains non-printable data on line %zu, column "
+                        "%zu.\n",
+                        path, file_line_no, cursor);
+            }
+            return GRR_APP_RET_BAD_DATA;
+        }
+
+        if (engine_ret == GRR_RET_NOT_FOUND) {
+            continue;
+        }
+
+        GRR_STAT_ADD(state->stats, GRR_STAT_LINES_MATCHED, 1);
+        num_spans = findAllMatches(line, len, start, end, k, state, options);
+        if (num_spans == 0) {
+            ret = GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        else if (options->count_matches) {
+            if (state->file_count == 0) {
+                state->first_line_no = file_line_no;
+            }
+            state->file_count += options->all_matches ? num_spans : 1;
+            return GRR_APP_RET_OK;
+        }
+        else if (options->only_matching) {
+            ret = formatMatches(results, line, state->spans, num_spans, file_line_no, k, options);
+        }
+        else {
+            ret = formatResult(results, line, len, state->spans, num_spans, file_line_no, k, &state->context,
+                               options);
+        }
+        if (ret != GRR_APP_RET_OK) {
+            if (options->verbose) {
+                fprintf(stderr, "Ran out of memory while buffering the results for %s.\n", path);
+            }
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+
+        return options->names_only ? GRR_APP_RET_DONE : GRR_APP_RET_OK;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Records the match at [start, end) in state->spans and, with --all-matches, every match after it by resuming the
+ * search where the previous match ended.  Each resumption first checks that the pattern's literal, if it has one,
+ * still occurs in the rest of the line.  A pattern anchored to the start of the line can only match once and
+ * --all-matches is refused for any other pattern which needs the text before its match.  Empty matches are skipped
+ * over and the first one is only kept if nothing else matches.  Returns the number of spans or 0 if they couldn't
+ * all be stored.
+ */
+static size_t
+findAllMatches(const char *line, size_t len, size_t start, size_t end, size_t pattern, grrSearchState *state,
+               const grrOptions *options)
+{
+    size_t num_spans = 1;
+    const grrPattern *pat = options->patterns + pattern;
+
+    if (state->spans_capacity == 0) {
+        state->spans = malloc(16 * sizeof(*state->spans));
+        if (!state->spans) {
+            return 0;
+        }
+        state->spans_capacity = 16;
+    }
+    state->spans[0] = (grrMatchSpan){.start = start, .end = end};
+
+    if (!options->all_matches || pat->anchored) {
+        return 1;
+    }
+
+    for (size_t from = (end > start) ? end : end + 1; from < len;) {
+        size_t cursor;
+
+        if (pat->literal.len > 0 &&
+            !(options->fold_case ?
+                  grrFindLiteralFold(line + from, len - from, pat->literal.string, pat->literal.len) :
+                  grrFindLiteral(line + from, len - from, pat->literal.string, pat->literal.len))) {
+            break;
+        }
+
+        if (grrSearch(state->search_patterns[pattern], line + from, len - from, &start, &end, &cursor,
+                      options->binary_as_text) != GRR_RET_OK) {
+            break;
+        }
+        start += from;
+        end += from;
+
+        if (end > start && num_spans == 1 && state->spans[0].end == state->spans[0].start) {
+            state->spans[0] = (grrMatchSpan){.start = start, .end = end};
+            from = end;
+        }
+        else if (end > start) {
+            if (num_spans == state->spans_capacity) {
+                grrMatchSpan *new_spans;
+
+                new_spans = realloc(state->spans, 2 * state->spans_capacity * sizeof(*new_spans));
+                if (!new_spans) {
+                    return 0;
+                }
+                state->spans = new_spans;
+                state->spans_capacity *= 2;
+            }
+            state->spans[num_spans++] = (grrMatchSpan){.start = start, .end = end};
+            from = end;
+        }
+        else {
+            from = end + 1;
+        }
+    }
+
+    return num_spans;
+}
+
+static void
+abandonDfa(grrSearchState *state, const grrOptions *options)
+{
+    if (options->verbose) {
+        fprintf(stderr, "The DFA's state cache is thrashing so switching to the NFA.\n");
+    }
+    grrDfaFree(state->dfa);
+    state->dfa = NULL;
+}
+
+static int
+addResult(grrResultSet *results, size_t file_line_no)
+{
+    grrResult *result;
+
+    if (results->num_results == results->results_capacity) {
+        size_t new_capacity = results->results_capacity ? 2 * results->results_capacity : 16;
+        grrResult *new_results;
+
+        new_results = realloc(results->results, new_capacity * sizeof(*new_results));
+        if (!new_results) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        results->results = new_results;
+        results->results_capacity = new_capacity;
+    }
+
+    result = results->results + results->num_results++;
+    result->file_line_no = file_line_no;
+    result->offset = results->text_len;
+    result->len = 0;
+
+    return GRR_APP_RET_OK;
+}
+
+static int
+appendText(grrResultSet *results, const char *format, ...)
+{
+    int len;
+    va_list args;
+
+    for (;;) {
+        size_t available = results->text_capacity - results->text_len;
+
+        va_start(args, format);
+        len = vsnprintf(results->text + results->text_len, available, format, args);
+        va_end(args);
+        if (len < 0) {
+            return GRR_APP_RET_OTHER;
+        }
+
+        if ((size_t)len < available) {
+            break;
+        }
+
+        size_t new_capacity = results->text_capacity ? 2 * results->text_capacity : 4096;
+        char *new_text;
+
+        while (new_capacity - results->text_len <= (size_t)len) {
+            new_capacity *= 2;
+        }
+
+        new_text = realloc(results->text, new_capacity);
+        if (!new_text) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        results->text = new_text;
+        results->text_capacity = new_capacity;
+    }
+
+    results->text_len += len;
+    results->results[results->num_results - 1].len += len;
+
+    return GRR_APP_RET_OK;
+}
+
+static int
+appendBytes(grrResultSet *results, const char *data, size_t len)
+{
+    // Match what printf's %.*s would have produced for lines that contain a NUL.
+    len = strnlen(data, len);
+
+    if (results->text_capacity - results->text_len <= len) {
+        size_t new_capacity = results->text_capacity ? 2 * results->text_capacity : 4096;
+        char *new_text;
+
+        while (new_capacity - results->text_len <= len) {
+            new_capacity *= 2;
+        }
+
+        new_text = realloc(results->text, new_capacity);
+        if (!new_text) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        results->text = new_text;
+        results->text_capacity = new_capacity;
+    }
+
+    memcpy(results->text + results->text_len, data, len);
+    results->text_len += len;
+    results->text[results->text_len] = '\0';
+    results->results[results->num_results - 1].len += len;
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Formats a matching line.  Unless the line is printed in full, only the first match is shown.
+ */
+static int
+formatResult(grrResultSet *results, const char *line, size_t len, const grrMatchSpan *spans, size_t num_spans,
+             size_t file_line_no, size_t pattern, grrContext *context, const grrOptions *options)
+{
+    int ret;
+    size_t offset, start = spans[0].start, end = spans[0].end;
+    const char change_color_to_red[] = {0x1b, '[', '9', '1', 'm', '\0'};
+    const char restore_color[] = {0x1b, '[', '0', 'm', '\0'};
+
+    ret = addResult(results, file_line_no);
+    if (ret != GRR_APP_RET_OK || options->editor) {
+        return ret;
+    }
+
+    if (options->num_patterns > 1) {
+        ret = appendText(results, " [%s]", options->patterns[pattern].regex);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+    }
+
+    if (options->names_only) {
+        return appendBytes(results, "\n", 1);
+    }
+
+    // With context, the result is a block of numbered lines in which the matching line is printed in full.
+    if (context->before > 0 || context->after > 0) {
+        ret = appendText(results, " (line %zu):\n", file_line_no);
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBeforeContext(results, line, file_line_no, context, options);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendText(results, "    %zu: ", file_line_no);
+        }
+        context->printed_through = file_line_no;
+        context->after_remaining = context->after;
+        return (ret == GRR_APP_RET_OK) ? appendFullLine(results, line, len, spans, num_spans, options) : ret;
+    }
+
+    ret = appendText(results, " (line %zu): ", file_line_no);
+    if (ret != GRR_APP_RET_OK) {
+        return ret;
+    }
+
+    if (options->full_line || options->all_matches) {
+        return appendFullLine(results, line, len, spans, num_spans, options);
+    }
+
+    if (start > 10) {
+        ret = appendBytes(results, "... ", 4);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+        offset = start - 10;
+    }
+    else {
+        offset = 0;
+    }
+
+    ret = appendBytes(results, line + offset, start - offset);
+    if (ret == GRR_APP_RET_OK && !options->colorless) {
+        ret = appendBytes(results, change_color_to_red, sizeof(change_color_to_red) - 1);
+    }
+    if (ret != GRR_APP_RET_OK) {
+        return ret;
+    }
+
+    if (end - start > 50) {
+        ret = appendBytes(results, line + start, 10);
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBytes(results, " ... ", 5);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBytes(results, line + end - 10, 10);
+        }
+    }
+    else {
+        ret = appendBytes(results, line + start, end - start);
+    }
+    if (ret == GRR_APP_RET_OK && !options->colorless) {
+        ret = appendBytes(results, restore_color, sizeof(restore_color) - 1);
+    }
+    if (ret != GRR_APP_RET_OK) {
+        return ret;
+    }
+
+    if (len - end > 50) {
+        ret = appendBytes(results, line + end, 50);
+        return (ret == GRR_APP_RET_OK) ? appendBytes(results, " ...\n", 5) : ret;
+    }
+    else {
+        ret = appendBytes(results, line + end, len - end);
+        return (ret == GRR_APP_RET_OK) ? appendBytes(results, "\n", 1) : ret;
+    }
+}
+
+/*
+ * Adds a result for each of the spans with only the match itself as its text.  Empty matches are left out.
+ */
+static int
+formatMatches(grrResultSet *results, const char *line, const grrMatchSpan *spans, size_t num_spans,
+              size_t file_line_no, size_t pattern, const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK;
+    const char change_color_to_red[] = {0x1b, '[', '9', '1', 'm', '\0'};
+    const char restore_color[] = {0x1b, '[', '0', 'm', '\0'};
+
+    for (size_t k = 0; k < num_spans && ret == GRR_APP_RET_OK; k++) {
+        if (spans[k].end == spans[k].start) {
+            continue;
+        }
+
+        ret = addResult(results, file_line_no);
+        if (ret != GRR_APP_RET_OK || options->editor) {
+            continue;
+        }
+
+        if (options->num_patterns > 1) {
+            ret = appendText(results, " [%s]", options->patterns[pattern].regex);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendText(results, " (line %zu): ", file_line_no);
+        }
+        if (ret == GRR_APP_RET_OK && !options->colorless) {
+            ret = appendBytes(results, change_color_to_red, sizeof(change_color_to_red) - 1);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBytes(results, line + spans[k].start, spans[k].end - spans[k].start);
+        }
+        if (ret == GRR_APP_RET_OK && !options->colorless) {
+            ret = appendBytes(results, restore_color, sizeof(restore_color) - 1);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBytes(results, "\n", 1);
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Adds the file's single --count result, which is attributed to the line of its first match.
+ */
+static int
+formatCount(grrResultSet *results, const grrSearchState *state, const grrOptions *options)
+{
+    int ret;
+
+    ret = addResult(results, state->first_line_no);
+    if (ret != GRR_APP_RET_OK || options->editor) {
+        return ret;
+    }
+    return appendText(results, ": %zu\n", state->file_count);
+}
+
+/*
+ * Appends the whole line with each of the matches highlighted.
+ */
+static int
+appendFullLine(grrResultSet *results, const char *line, size_t len, const grrMatchSpan *spans, size_t num_spans,
+               const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK;
+    size_t offset = 0;
+    const char change_color_to_red[] = {0x1b, '[', '9', '1', 'm', '\0'};
+    const char restore_color[] = {0x1b, '[', '0', 'm', '\0'};
+
+    for (size_t k = 0; k < num_spans && ret == GRR_APP_RET_OK; k++) {
+        ret = appendBytes(results, line + offset, spans[k].start - offset);
+        if (ret == GRR_APP_RET_OK && !options->colorless) {
+            ret = appendBytes(results, change_color_to_red, sizeof(change_color_to_red) - 1);
+        }
+        if (ret == GRR_APP_RET_OK) {
+            ret = appendBytes(results, line + spans[k].start, spans[k].end - spans[k].start);
+        }
+        if (ret == GRR_APP_RET_OK && !options->colorless) {
+            ret = appendBytes(results, restore_color, sizeof(restore_color) - 1);
+        }
+        offset = spans[k].end;
+    }
+    if (ret == GRR_APP_RET_OK) {
+        ret = appendBytes(results, line + offset, len - offset);
+    }
+    return (ret == GRR_APP_RET_OK) ? appendBytes(results, "\n", 1) : ret;
+}
+
+static void
+resetContext(grrContext *context)
+{
+    context->carried_len = 0;
+    context->num_carried = 0;
+    context->printed_through = 0;
+    context->after_remaining = 0;
+}
+
+/*
+ * Returns the start of the earliest of the (up to) count lines which immediately precede end, which has to be
+ * at the start of a line, without going back past base.  *found is set to the number of lines.
+ */
+static const char *
+precedingLines(const char *base, const char *end, size_t count, size_t *found)
+{
+    for (*found = 0; *found < count && end > base; (*found)++) {
+        const char *newline;
+
+        newline = memrchr(base, '\n', end - 1 - base);
+        end = newline ? newline + 1 : base;
+    }
+
+    return end;
+}
+
+/*
+ * Copies the chunk's last few lines so that they can serve as before-context for a match at the start of the
+ * next chunk.  If the chunk is too short, some of the lines carried over from earlier chunks are kept as well.
+ */
+static int
+carryContext(grrContext *context, const char *chunk, size_t chunk_len)
+{
+    size_t found, keep_len = 0, tail_len;
+    const char *tail;
+
+    // A chunk which ends partway through a line (which only happens to very long lines) can't be carried.
+    if (chunk_len == 0 || chunk[chunk_len - 1] != '\n') {
+        context->carried_len = 0;
+        context->num_carried = 0;
+        return GRR_APP_RET_OK;
+    }
+
+    tail = precedingLines(chunk, chunk + chunk_len, context->before, &found);
+    tail_len = chunk + chunk_len - tail;
+
+    if (found < context->before && context->num_carried > 0) {
+        size_t kept;
+        const char *keep;
+
+        keep = precedingLines(context->carried, context->carried + context->carried_len,
+                              MIN(context->before - found, context->num_carried), &kept);
+        keep_len = context->carried + context->carried_len - keep;
+        memmove(context->carried, keep, keep_len);
+        found += kept;
+    }
+
+    if (context->carried_capacity < keep_len + tail_len) {
+        char *new_carried;
+
+        new_carried = realloc(context->carried, keep_len + tail_len);
+        if (!new_carried) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        context->carried = new_carried;
+        context->carried_capacity = keep_len + tail_len;
+    }
+    memcpy(context->carried + keep_len, tail, tail_len);
+    context->carried_len = keep_len + tail_len;
+    context->num_carried = found;
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Appends the lines which precede a match, skipping any which have already been printed.  The line has to be
+ * within the current chunk.
+ */
+static int
+appendBeforeContext(grrResultSet *results, const char *line, size_t file_line_no, const grrContext *context,
+                    const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK;
+    size_t count, found;
+    const char *start;
+
+    count = MIN(context->before, file_line_no - 1 - context->printed_through);
+    start = precedingLines(context->chunk, line, count, &found);
+
+    if (found < count && context->num_carried > 0) {
+        size_t carried_found;
+        const char *carried_end = context->carried + context->carried_len, *carried;
+
+        carried = precedingLines(context->carried, carried_end, MIN(count - found, context->num_carried),
+                                 &carried_found);
+        ret = appendContextLines(results, carried, carried_end, context->chunk_line_no - carried_found, options);
+    }
+
+    return (ret == GRR_APP_RET_OK) ? appendContextLines(results, start, line, file_line_no - found, options) : ret;
+}
+
+/*
+ * Appends every line in [start, end), each of which ends with a newline.
+ */
+static int
+appendContextLines(grrResultSet *results, const char *start, const char *end, size_t file_line_no,
+                   const grrOptions *options)
+{
+    while (start < end) {
+        int ret;
+        const char *newline;
+
+        newline = memchr(start, '\n', end - start);
+        if (!newline) {
+            newline = end;
+        }
+
+        ret = appendContextLine(results, start, newline - start, file_line_no++, options);
+        if (ret != GRR_APP_RET_OK) {
+            return ret;
+        }
+        start = newline + 1;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+/*
+ * Appends a line of context to the latest result.  When a stream is being searched, a match's after-context can
+ * run into the next chunk, by which point the match has already been printed along with the previous chunk's
+ * results.  The line is then printed right away, ahead of the current chunk's results.
+ */
+static int
+appendContextLine(grrResultSet *results, const char *line, size_t len, size_t file_line_no,
+                  const grrOptions *options)
+{
+    int ret;
+
+    for (; len > 0 && line[len - 1] == '\r'; len--)
+        ;
+
+    if (results->num_results == 0) {
+        grrOutputWrite(options->output, "    ", 4);
+        grrOutputNumber(options->output, file_line_no);
+        grrOutputWrite(options->output, "- ", 2);
+        grrOutputWrite(options->output, line, strnlen(line, len));
+        grrOutputWrite(options->output, "\n", 1);
+        return GRR_APP_RET_OK;
+    }
+
+    ret = appendText(results, "    %zu- ", file_line_no);
+    if (ret == GRR_APP_RET_OK) {
+        ret = appendBytes(results, line, len);
+    }
+    return (ret == GRR_APP_RET_OK) ? appendBytes(results, "\n", 1) : ret;
+}
@@ -0,0 +1,1059 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "grr.h"
+#include "serve.h"
+
+#define GRR_SERVE_MAGIC        "GRRSERV3"
+#define GRR_SERVE_MAX_PATTERNS 4096
+#define GRR_SERVE_MAX_REQUEST  (1024 * 1024)
+// The status with which a server refuses a query from a client which speaks a different protocol or is a
+// different version of grr.  It's outside the range of the GRR_APP_RET_* codes.
+#define GRR_SERVE_MISMATCH 0xffff
+// The number of seconds which a client has to send its query.
+#define GRR_SERVE_TIMEOUT 5
+
+#define GRR_WATCH_MASK                                                                                         \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | \
+     IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+enum grrServeFlag {
+    GRR_SERVE_NAMES_ONLY = 0x01,
+    GRR_SERVE_IGNORE_HIDDEN = 0x02,
+    GRR_SERVE_COLORLESS = 0x04,
+    GRR_SERVE_BINARY_AS_TEXT = 0x08,
+    GRR_SERVE_FOLD_CASE = 0x10,
+    GRR_SERVE_FULL_LINE = 0x20,
+    GRR_SERVE_ALL_MATCHES = 0x40,
+    GRR_SERVE_ONLY_MATCHING = 0x80,
+    GRR_SERVE_COUNT = 0x100,
+};
+
+/*
+ * A query consists of this header, the lengths of the regexes, the regexes themselves, and then the file regex
+ * (if any).  None of the strings are null-terminated.  The server only answers clients with the same magic and
+ * GRR_VERSION, so everything is in the host's byte order.
+ */
+typedef struct grrServeRequest {
+    char magic[8];
+    char version[16];
+    int64_t depth;
+    uint32_t flags;
+    uint32_t num_patterns;
+    uint32_t file_regex_len;
+    uint32_t before_context;
+    uint32_t after_context;
+    uint32_t reserved;
+} grrServeRequest;
+
+/*
+ * The response is a series of these records, each followed by a file's path (relative to the starting
+ * directory), its results, and their text.  A record with a path_len of 0 ends the response and holds the
+ * query's status.
+ */
+typedef struct grrServeRecord {
+    uint32_t path_len;
+    uint32_t status;
+    uint64_t num_results;
+    uint64_t text_len;
+} grrServeRecord;
+
+typedef struct grrServeDir grrServeDir;
+
+/*
+ * A regular file or a subdirectory.  A file's contents are NULL until it's been searched (and may remain NULL
+ * if the file is too large to be kept).
+ */
+typedef struct grrServeEntry {
+    char *name;
+    grrServeDir *dir;
+    char *contents;
+    size_t contents_len;
+    unsigned char type;
+} grrServeEntry;
+
+/*
+ * The path is relative to the starting directory and ends with a slash unless it's the starting directory's own
+ * (empty) path.  A wd of -1 means that the directory isn't being watched.
+ */
+struct grrServeDir {
+    char *path;
+    grrServeEntry *entries;
+    size_t num_entries;
+    size_t capacity;
+    int wd;
+};
+
+typedef struct grrServer {
+    const grrOptions *options;
+    grrServeDir *top;
+    grrServeDir **watches;
+    size_t watches_capacity;
+    size_t cached_bytes;
+    int root_fd;
+    int inotify_fd;
+} grrServer;
+
+static volatile sig_atomic_t stopping;
+
+static void
+handleSignal(int signum);
+
+static int
+socketAddress(const char *directory, struct sockaddr_un *address, bool create);
+
+static grrServeDir *
+newDir(const char *parent_path, const char *name);
+
+static void
+freeDir(grrServer *server, grrServeDir *dir);
+
+static void
+clearDir(grrServer *server, grrServeDir *dir);
+
+static int
+scanDirectory(grrServer *server, grrServeDir *dir);
+
+static int
+addEntry(grrServer *server, grrServeDir *dir, const char *name, unsigned char type);
+
+static grrServeEntry *
+findEntry(grrServeDir *dir, const char *name);
+
+static void
+removeEntry(grrServer *server, grrServeDir *dir, const char *name);
+
+static void
+dropContents(grrServer *server, grrServeEntry *entry);
+
+static void
+processEvents(grrServer *server);
+
+static void
+handleEvent(grrServer *server, const struct inotify_event *event);
+
+static void
+answerQuery(grrServer *server, int client_fd);
+
+static int
+readQuery(int fd, grrOptions *query);
+
+static int
+searchSnapshot(grrServer *server, grrServeDir *dir, char *path, size_t offset, long depth, grrSearchState *state,
+               grrResultSet *results, grrOutput *output, const grrOptions *options);
+
+static void
+searchEntry(grrServer *server, grrServeEntry *entry, const char *path, grrSearchState *state,
+            grrResultSet *results, const grrOptions *options);
+
+static void
+loadContents(grrServer *server, grrServeEntry *entry, const char *path);
+
+static int
+readAll(int fd, void *buffer, size_t len);
+
+static int
+writeAll(int fd, const void *buffer, size_t len);
+
+int
+grrServe(const grrOptions *options)
+{
+    int ret = GRR_APP_RET_OK, listen_fd = -1, probe_fd;
+    sigset_t blocked, original;
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    struct sigaction action = {.sa_handler = handleSignal};
+    grrServer server = {.options = options, .root_fd = -1, .inotify_fd = -1};
+
+    if (socketAddress(options->starting_directory, &address, true) != GRR_APP_RET_OK) {
+        fprintf(stderr, "Could not determine the path of the server's socket.\n");
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+
+    // A socket which nobody is listening on was left behind by a server which didn't exit cleanly.
+    probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe_fd != -1) {
+        bool running = connect(probe_fd, (const struct sockaddr *)&address, sizeof(address)) == 0;
+
+        close(probe_fd);
+        if (running) {
+            fprintf(stderr, "A server is already running for %s.\n", options->starting_directory);
+            return GRR_APP_RET_OTHER;
+        }
+    }
+    unlink(address.sun_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 || bind(listen_fd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", address.sun_path, strerror(errno));
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto done;
+    }
+
+    server.root_fd = open(options->starting_directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    server.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (server.root_fd == -1 || server.inotify_fd == -1) {
+        fprintf(stderr, "Could not watch %s: %s\n", options->starting_directory, strerror(errno));
+        ret = GRR_APP_RET_FILE_ACCESS;
+        goto done;
+    }
+
+    server.top = newDir("", NULL);
+    if (!server.top || scanDirectory(&server, server.top) == GRR_APP_RET_OUT_OF_MEMORY) {
+        fprintf(stderr, "Ran out of memory while reading the directory tree.\n");
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    // The signals are only delivered while waiting in ppoll so that a signal can't slip in between checking the
+    // flag and going to sleep.
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &original);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (options->verbose) {
+        fprintf(stderr, "Serving %s on %s.\n", options->starting_directory, address.sun_path);
+    }
+
+    while (!stopping) {
+        struct pollfd fds[2] = {{.fd = listen_fd, .events = POLLIN}, {.fd = server.inotify_fd, .events = POLLIN}};
+
+        if (ppoll(fds, 2, NULL, &original) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Failed to wait for queries: %s\n", strerror(errno));
+            ret = GRR_APP_RET_OTHER;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            processEvents(&server);
+        }
+        if (fds[0].revents & POLLIN) {
+            int client_fd;
+
+            client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client_fd != -1) {
+                struct timeval timeout = {.tv_sec = GRR_SERVE_TIMEOUT};
+
+                setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                answerQuery(&server, client_fd);
+                close(client_fd);
+            }
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &original, NULL);
+    if (options->verbose) {
+        fprintf(stderr, "Shutting down the server.\n");
+    }
+
+done:
+
+    if (listen_fd != -1) {
+        close(listen_fd);
+        unlink(address.sun_path);
+    }
+    if (server.top) {
+        freeDir(&server, server.top);
+    }
+    free(server.watches);
+    if (server.inotify_fd != -1) {
+        close(server.inotify_fd);
+    }
+    if (server.root_fd != -1) {
+        close(server.root_fd);
+    }
+
+    return ret;
+}
+
+int
+grrServeQuery(const grrOptions *options, long *line_no)
+{
+    int ret = GRR_APP_RET_OK, fd;
+    size_t path_offset;
+    char path[PATH_MAX];
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    grrServeRequest request = {.magic = GRR_SERVE_MAGIC, .version = GRR_VERSION};
+    grrResultSet results = {0};
+
+    // These need more than what's in the server's snapshot.
+    if (options->ignore_files || options->exclude_dirs || options->filter_files) {
+        if (options->verbose) {
+            fprintf(stderr, "The server doesn't support -g, --exclude-dir, or the size and time filters.\n");
+        }
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    if (socketAddress(options->starting_directory, &address, false) != GRR_APP_RET_OK) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return GRR_APP_RET_NOT_FOUND;
+    }
+    if (connect(fd, (const struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    request.depth = options->depth;
+    request.num_patterns = options->num_patterns;
+    request.file_regex_len = options->file_regex ? strlen(options->file_regex) : 0;
+    request.flags = (options->names_only ? GRR_SERVE_NAMES_ONLY : 0) |
+                    (options->ignore_hidden ? GRR_SERVE_IGNORE_HIDDEN : 0) |
+                    (options->colorless ? GRR_SERVE_COLORLESS : 0) |
+                    (options->binary_as_text ? GRR_SERVE_BINARY_AS_TEXT : 0) |
+                    (options->fold_case ? GRR_SERVE_FOLD_CASE : 0) |
+                    (options->full_line ? GRR_SERVE_FULL_LINE : 0) |
+                    (options->all_matches ? GRR_SERVE_ALL_MATCHES : 0) |
+                    (options->only_matching ? GRR_SERVE_ONLY_MATCHING : 0) |
+                    (options->count_matches ? GRR_SERVE_COUNT : 0);
+    request.before_context = MIN(options->before_context, UINT32_MAX);
+    request.after_context = MIN(options->after_context, UINT32_MAX);
+
+    ret = writeAll(fd, &request, sizeof(request));
+    for (size_t k = 0; ret == GRR_APP_RET_OK && k < options->num_patterns; k++) {
+        uint32_t len = strlen(options->patterns[k].regex);
+
+        ret = writeAll(fd, &len, sizeof(len));
+    }
+    for (size_t k = 0; ret == GRR_APP_RET_OK && k < options->num_patterns; k++) {
+        ret = writeAll(fd, options->patterns[k].regex, strlen(options->patterns[k].regex));
+    }
+    if (ret == GRR_APP_RET_OK && request.file_regex_len > 0) {
+        ret = writeAll(fd, options->file_regex, request.file_regex_len);
+    }
+    if (ret != GRR_APP_RET_OK) {
+        close(fd);
+        return GRR_APP_RET_NOT_FOUND;
+    }
+
+    path_offset = strlen(options->starting_directory);
+    memcpy(path, options->starting_directory, path_offset);
+
+    for (;;) {
+        grrServeRecord record;
+        size_t results_size;
+
+        if (readAll(fd, &record, sizeof(record)) != GRR_APP_RET_OK) {
+            fprintf(stderr, "Lost the connection to the server.\n");
+            ret = GRR_APP_RET_FILE_ACCESS;
+            break;
+        }
+        if (record.path_len == 0) {
+            // Nothing has been printed if the server refused the query so the search can still be done directly.
+            if (record.status == GRR_SERVE_MISMATCH) {
+                if (options->verbose) {
+                    fprintf(stderr, "The server is running a different version of grr.\n");
+                }
+                ret = GRR_APP_RET_NOT_FOUND;
+                break;
+            }
+            // Otherwise, not finding the server is the only reason to fall back to searching directly.
+            ret = (record.status == GRR_APP_RET_NOT_FOUND) ? GRR_APP_RET_OTHER : (int)record.status;
+            if (ret != GRR_APP_RET_OK) {
+                fprintf(stderr, "The server failed to run the query.\n");
+            }
+            break;
+        }
+
+        if (path_offset + record.path_len >= sizeof(path) ||
+            record.num_results > SIZE_MAX / sizeof(*results.results)) {
+            ret = GRR_APP_RET_BAD_DATA;
+            break;
+        }
+        results_size = record.num_results * sizeof(*results.results);
+
+        if (record.num_results > results.results_capacity) {
+            grrResult *new_results;
+
+            new_results = realloc(results.results, results_size);
+            if (!new_results) {
+                ret = GRR_APP_RET_OUT_OF_MEMORY;
+                break;
+            }
+            results.results = new_results;
+            results.results_capacity = record.num_results;
+        }
+        if (record.text_len > results.text_capacity) {
+            char *new_text;
+
+            new_text = realloc(results.text, record.text_len);
+            if (!new_text) {
+                ret = GRR_APP_RET_OUT_OF_MEMORY;
+                break;
+            }
+            results.text = new_text;
+            results.text_capacity = record.text_len;
+        }
+
+        if (readAll(fd, path + path_offset, record.path_len) != GRR_APP_RET_OK ||
+            readAll(fd, results.results, results_size) != GRR_APP_RET_OK ||
+            readAll(fd, results.text, record.text_len) != GRR_APP_RET_OK) {
+            fprintf(stderr, "Lost the connection to the server.\n");
+            ret = GRR_APP_RET_FILE_ACCESS;
+            break;
+        }
+        path[path_offset + record.path_len] = '\0';
+        results.num_results = record.num_results;
+        results.text_len = record.text_len;
+
+        // The results are about to be printed so they can't point outside of the text.
+        for (size_t k = 0; k < results.num_results; k++) {
+            if (results.results[k].offset > results.text_len ||
+                results.results[k].len > results.text_len - results.results[k].offset) {
+                ret = GRR_APP_RET_BAD_DATA;
+                break;
+            }
+        }
+        if (ret != GRR_APP_RET_OK) {
+            fprintf(stderr, "The server sent a malformed response.\n");
+            break;
+        }
+
+        if (emitResults(path, &results, line_no, options) == GRR_APP_RET_DONE) {
+            break;
+        }
+    }
+
+    freeResultSet(&results);
+    close(fd);
+
+    return ret;
+}
+
+static void
+handleSignal(int signum)
+{
+    (void)signum;
+    stopping = 1;
+}
+
+static int
+socketAddress(const char *directory, struct sockaddr_un *address, bool create)
+{
+    char absolute[PATH_MAX];
+
+    if (!realpath(directory, absolute)) {
+        return GRR_APP_RET_FILE_ACCESS;
+    }
+    return grrCacheSocketPath(absolute, address->sun_path, sizeof(address->sun_path), create);
+}
+
+static grrServeDir *
+newDir(const char *parent_path, const char *name)
+{
+    grrServeDir *dir;
+
+    dir = calloc(1, sizeof(*dir));
+    if (!dir) {
+        return NULL;
+    }
+    dir->wd = -1;
+
+    if (name) {
+        size_t parent_len = strlen(parent_path), name_len = strlen(name);
+
+        dir->path = malloc(parent_len + name_len + 2);
+        if (dir->path) {
+            memcpy(dir->path, parent_path, parent_len);
+            memcpy(dir->path + parent_len, name, name_len);
+            dir->path[parent_len + name_len] = '/';
+            dir->path[parent_len + name_len + 1] = '\0';
+        }
+    }
+    else {
+        dir->path = strdup(parent_path);
+    }
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+
+    return dir;
+}
+
+static void
+freeDir(grrServer *server, grrServeDir *dir)
+{
+    clearDir(server, dir);
+    if (dir->wd != -1) {
+        inotify_rm_watch(server->inotify_fd, dir->wd);
+        server->watches[dir->wd] = NULL;
+    }
+    free(dir->entries);
+    free(dir->path);
+    free(dir);
+}
+
+/*
+ * Frees the directory's entries (and everything below them) but keeps the directory itself.
+ */
+static void
+clearDir(grrServer *server, grrServeDir *dir)
+{
+    for (size_t k = 0; k < dir->num_entries; k++) {
+        grrServeEntry *entry = dir->entries + k;
+
+        dropContents(server, entry);
+        if (entry->dir) {
+            freeDir(server, entry->dir);
+        }
+        free(entry->name);
+    }
+    dir->num_entries = 0;
+}
+
+static int
+scanDirectory(grrServer *server, grrServeDir *dir)
+{
+    int ret = GRR_APP_RET_OK;
+    unsigned char type;
+    const char *name;
+    char path[PATH_MAX];
+    grrDirectory listing;
+
+    // The watch is added before the directory is listed so that nothing which changes in between is missed.
+    if (dir->wd == -1 &&
+        snprintf(path, sizeof(path), "%s%s", server->options->starting_directory, dir->path) < (int)sizeof(path)) {
+        dir->wd = inotify_add_watch(server->inotify_fd, path, GRR_WATCH_MASK);
+        if (dir->wd != -1 && (size_t)dir->wd >= server->watches_capacity) {
+            size_t new_capacity = MAX(2 * server->watches_capacity, (size_t)dir->wd + 1);
+            grrServeDir **new_watches;
+
+            new_watches = realloc(server->watches, new_capacity * sizeof(*new_watches));
+            if (!new_watches) {
+                inotify_rm_watch(server->inotify_fd, dir->wd);
+                dir->wd = -1;
+                return GRR_APP_RET_OUT_OF_MEMORY;
+            }
+            memset(new_watches + server->watches_capacity, 0,
+                   (new_capacity - server->watches_capacity) * sizeof(*new_watches));
+            server->watches = new_watches;
+            server->watches_capacity = new_capacity;
+        }
+        if (dir->wd != -1) {
+            server->watches[dir->wd] = dir;
+        }
+        else if (server->options->verbose) {
+            fprintf(stderr, "Could not watch %s (it will be listed by every query): %s\n", path, strerror(errno));
+        }
+    }
+
+    if (grrDirectoryOpen(&listing, server->root_fd, dir->path[0] ? dir->path : ".", NULL) != GRR_APP_RET_OK) {
+        if (server->options->verbose) {
+            fprintf(stderr, "Could not access directory: %s%s\n", server->options->starting_directory, dir->path);
+        }
+        return GRR_APP_RET_OK;
+    }
+
+    while (grrDirectoryNext(&listing, &name, &type) == GRR_APP_RET_OK) {
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        ret = addEntry(server, dir, name, type);
+        if (ret != GRR_APP_RET_OK) {
+            break;
+        }
+    }
+    grrDirectoryClose(&listing);
+
+    return ret;
+}
+
+/*
+ * Adds a regular file or a subdirectory (which is scanned in turn) to the end of the directory.  Anything else
+ * is ignored.
+ */
+static int
+addEntry(grrServer *server, grrServeDir *dir, const char *name, unsigned char type)
+{
+    size_t path_len = strlen(dir->path), name_len = strlen(name);
+    grrServeEntry entry = {0};
+
+    if (path_len + name_len + 1 >= PATH_MAX) {
+        return GRR_APP_RET_OK;
+    }
+
+    if (type == DT_UNKNOWN) {
+        char path[PATH_MAX];
+        struct stat file_stat;
+
+        memcpy(path, dir->path, path_len);
+        memcpy(path + path_len, name, name_len + 1);
+        if (fstatat(server->root_fd, path, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+            return GRR_APP_RET_OK;
+        }
+        type = S_ISREG(file_stat.st_mode) ? DT_REG : S_ISDIR(file_stat.st_mode) ? DT_DIR : DT_UNKNOWN;
+    }
+    if (type != DT_REG && type != DT_DIR) {
+        return GRR_APP_RET_OK;
+    }
+
+    if (dir->num_entries == dir->capacity) {
+        size_t new_capacity = dir->capacity ? 2 * dir->capacity : 8;
+        grrServeEntry *new_entries;
+
+        new_entries = realloc(dir->entries, new_capacity * sizeof(*new_entries));
+        if (!new_entries) {
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+        dir->entries = new_entries;
+        dir->capacity = new_capacity;
+    }
+
+    entry.type = type;
+    entry.name = strdup(name);
+    if (!entry.name) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    if (type == DT_DIR) {
+        entry.dir = newDir(dir->path, name);
+        if (!entry.dir) {
+            free(entry.name);
+            return GRR_APP_RET_OUT_OF_MEMORY;
+        }
+    }
+    dir->entries[dir->num_entries++] = entry;
+
+    return entry.dir ? scanDirectory(server, entry.dir) : GRR_APP_RET_OK;
+}
+
+static grrServeEntry *
+findEntry(grrServeDir *dir, const char *name)
+{
+    for (size_t k = 0; k < dir->num_entries; k++) {
+        if (strcmp(dir->entries[k].name, name) == 0) {
+            return dir->entries + k;
+        }
+    }
+    return NULL;
+}
+
+static void
+removeEntry(grrServer *server, grrServeDir *dir, const char *name)
+{
+    grrServeEntry *entry;
+    size_t index;
+
+    entry = findEntry(dir, name);
+    if (!entry) {
+        return;
+    }
+
+    dropContents(server, entry);
+    if (entry->dir) {
+        freeDir(server, entry->dir);
+    }
+    free(entry->name);
+
+    index = entry - dir->entries;
+    memmove(entry, entry + 1, (dir->num_entries - index - 1) * sizeof(*entry));
+    dir->num_entries--;
+}
+
+static void
+dropContents(grrServer *server, grrServeEntry *entry)
+{
+    if (entry->contents) {
+        server->cached_bytes -= entry->contents_len;
+        free(entry->contents);
+        entry->contents = NULL;
+        entry->contents_len = 0;
+    }
+}
+
+static void
+processEvents(grrServer *server)
+{
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(server->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (const char *cursor = buffer; cursor < buffer + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+
+            handleEvent(server, event);
+            cursor += sizeof(*event) + event->len;
+        }
+    }
+}
+
+static void
+handleEvent(grrServer *server, const struct inotify_event *event)
+{
+    grrServeDir *dir;
+    grrServeEntry *entry;
+
+    // Events were lost so the whole snapshot has to be rebuilt.
+    if (event->mask & IN_Q_OVERFLOW) {
+        if (server->options->verbose) {
+            fprintf(stderr, "The inotify queue overflowed so the tree is being read again.\n");
+        }
+        clearDir(server, server->top);
+        scanDirectory(server, server->top);
+        return;
+    }
+
+    if (event->wd < 0 || (size_t)event->wd >= server->watches_capacity || !server->watches[event->wd]) {
+        return;
+    }
+    dir = server->watches[event->wd];
+
+    if (event->mask & IN_IGNORED) {
+        server->watches[event->wd] = NULL;
+        dir->wd = -1;
+        return;
+    }
+    if (event->len == 0 || event->name[0] == '\0') {
+        return;
+    }
+
+    if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+        // A file which is renamed over an existing one replaces it.
+        removeEntry(server, dir, event->name);
+        if ((event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+            addEntry(server, dir, event->name, (event->mask & IN_ISDIR) ? DT_DIR : DT_UNKNOWN) !=
+                GRR_APP_RET_OK &&
+            server->options->verbose) {
+            fprintf(stderr, "Ran out of memory while adding %s%s.\n", dir->path, event->name);
+        }
+    }
+    else {
+        entry = findEntry(dir, event->name);
+        if (entry) {
+            dropContents(server, entry);
+        }
+    }
+}
+
+static void
+answerQuery(grrServer *server, int client_fd)
+{
+    int ret;
+    char path[PATH_MAX] = "";
+    grrOptions query = {.starting_directory = server->options->starting_directory,
+                        .line_no = -1,
+                        .num_threads = 1,
+                        .filter = {.max_size = -1},
+                        .verbose = server->options->verbose};
+    grrOutput output;
+    grrSearchState state;
+    grrResultSet results = {0};
+    grrServeRecord end = {0};
+
+    if (grrOutputInit(&output, client_fd) != GRR_APP_RET_OK) {
+        return;
+    }
+
+    // Whatever changed before the query was sent has to be reflected in the results.
+    processEvents(server);
+
+    ret = readQuery(client_fd, &query);
+    if (ret == GRR_APP_RET_OK) {
+        ret = initSearchState(&state, &query, false);
+        if (ret == GRR_APP_RET_OK) {
+            ret = searchSnapshot(server, server->top, path, 0, -1, &state, &results, &output, &query);
+            freeSearchState(&state);
+        }
+    }
+
+    if (ret == GRR_APP_RET_DONE) {
+        ret = GRR_APP_RET_OK;
+    }
+    end.status = ret;
+    grrOutputWrite(&output, (const char *)&end, sizeof(end));
+    grrOutputClose(&output);
+
+    freeResultSet(&results);
+    freePatterns(&query);
+    grrFreeNfa(query.file_pattern);
+}
+
+/*
+ * Reads a query from the client and sets up the options for it, just as parseOptions would.
+ */
+static int
+readQuery(int fd, grrOptions *query)
+{
+    int ret = GRR_APP_RET_OK;
+    size_t total;
+    uint32_t *lengths;
+    char *strings = NULL, *cursor;
+    grrServeRequest request;
+
+    // The magic is checked first since a client which speaks another protocol may send a shorter header.
+    if (readAll(fd, request.magic, sizeof(request.magic)) != GRR_APP_RET_OK) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+    if (memcmp(request.magic, GRR_SERVE_MAGIC, sizeof(request.magic)) != 0) {
+        return GRR_SERVE_MISMATCH;
+    }
+    if (readAll(fd, (char *)&request + sizeof(request.magic), sizeof(request) - sizeof(request.magic)) !=
+        GRR_APP_RET_OK) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+    if (strncmp(request.version, GRR_VERSION, sizeof(request.version)) != 0) {
+        return GRR_SERVE_MISMATCH;
+    }
+    if (request.num_patterns == 0 || request.num_patterns > GRR_SERVE_MAX_PATTERNS) {
+        return GRR_APP_RET_BAD_DATA;
+    }
+
+    lengths = malloc(request.num_patterns * sizeof(*lengths));
+    if (!lengths) {
+        return GRR_APP_RET_OUT_OF_MEMORY;
+    }
+    if (readAll(fd, lengths, request.num_patterns * sizeof(*lengths)) != GRR_APP_RET_OK) {
+        ret = GRR_APP_RET_BAD_DATA;
+        goto done;
+    }
+
+    // Each string is null-terminated once it's been read.
+    total = request.file_regex_len + 1;
+    for (uint32_t k = 0; k < request.num_patterns; k++) {
+        total += (size_t)lengths[k] + 1;
+    }
+    if (total > GRR_SERVE_MAX_REQUEST) {
+        ret = GRR_APP_RET_BAD_DATA;
+        goto done;
+    }
+    strings = malloc(total);
+    if (!strings) {
+        ret = GRR_APP_RET_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    cursor = strings;
+    for (uint32_t k = 0; k < request.num_patterns; k++) {
+        if (readAll(fd, cursor, lengths[k]) != GRR_APP_RET_OK) {
+            ret = GRR_APP_RET_BAD_DATA;
+            goto done;
+        }
+        cursor[lengths[k]] = '\0';
+
+        ret = addPattern(query, cursor);
+        if (ret != GRR_APP_RET_OK) {
+            goto done;
+        }
+        cursor += lengths[k] + 1;
+    }
+
+    if (request.file_regex_len > 0) {
+        if (readAll(fd, cursor, request.file_regex_len) != GRR_APP_RET_OK) {
+            ret = GRR_APP_RET_BAD_DATA;
+            goto done;
+        }
+        cursor[request.file_regex_len] = '\0';
+        if (grrCompile(cursor, request.file_regex_len, &query->file_pattern) != GRR_APP_RET_OK) {
+            query->file_pattern = NULL;
+            ret = GRR_APP_RET_BAD_DATA;
+            goto done;
+        }
+    }
+
+    query->depth = request.depth;
+    query->names_only = !!(request.flags & GRR_SERVE_NAMES_ONLY);
+    query->ignore_hidden = !!(request.flags & GRR_SERVE_IGNORE_HIDDEN);
+    query->colorless = !!(request.flags & GRR_SERVE_COLORLESS);
+    query->binary_as_text = !!(request.flags & GRR_SERVE_BINARY_AS_TEXT);
+    query->fold_case = !!(request.flags & GRR_SERVE_FOLD_CASE);
+    query->full_line = !!(request.flags & GRR_SERVE_FULL_LINE);
+    query->all_matches = !!(request.flags & GRR_SERVE_ALL_MATCHES);
+    query->only_matching = !!(request.flags & GRR_SERVE_ONLY_MATCHING);
+    query->count_matches = !!(request.flags & GRR_SERVE_COUNT);
+    query->before_context = request.before_context;
+    query->after_context = request.after_context;
+
+    ret = analyzePatterns(query);
+
+done:
+
+    free(strings);
+    free(lengths);
+    return ret;
+}
+
+/*
+ * Walks the snapshot just as searchDirectoryTree walks the tree and sends each file's results as soon as
+ * they've been found.  Returns GRR_APP_RET_DONE if the client has gone away.
+ */
+static int
+searchSnapshot(grrServer *server, grrServeDir *dir, char *path, size_t offset, long depth, grrSearchState *state,
+               grrResultSet *results, grrOutput *output, const grrOptions *options)
+{
+    size_t new_len;
+
+    if (dir->wd == -1) {
+        clearDir(server, dir);
+        scanDirectory(server, dir);
+    }
+
+    for (size_t k = 0; k < dir->num_entries; k++) {
+        grrServeEntry *entry = dir->entries + k;
+
+        // The entries' types are already known so examineEntry doesn't need a directory to stat them in.
+        switch (examineEntry(-1, entry->name, entry->type, path, offset, depth, &new_len, NULL, NULL, state,
+                             options)) {
+        case GRR_ENTRY_FILE:
+            searchEntry(server, entry, path, state, results, options);
+            if (results->num_results > 0) {
+                grrServeRecord record = {.path_len = new_len,
+                                         .num_results = results->num_results,
+                                         .text_len = results->text_len};
+
+                grrOutputWrite(output, (const char *)&record, sizeof(record));
+                grrOutputWrite(output, path, new_len);
+                grrOutputWrite(output, (const char *)results->results,
+                               results->num_results * sizeof(*results->results));
+                grrOutputWrite(output, results->text, results->text_len);
+                if (output->failed) {
+                    return GRR_APP_RET_DONE;
+                }
+            }
+            break;
+
+        case GRR_ENTRY_DIRECTORY:
+            if (searchSnapshot(server, entry->dir, path, new_len, depth + 1, state, results, output, options) ==
+                GRR_APP_RET_DONE) {
+                return GRR_APP_RET_DONE;
+            }
+            break;
+
+        default: break;
+        }
+    }
+
+    path[offset] = '\0';
+    return GRR_APP_RET_OK;
+}
+
+static void
+searchEntry(grrServer *server, grrServeEntry *entry, const char *path, grrSearchState *state,
+            grrResultSet *results, const grrOptions *options)
+{
+    grrPrefetchedFile file = {.fd = -1};
+
+    if (!entry->contents) {
+        loadContents(server, entry, path);
+    }
+
+    // The file is searched straight out of the cache if it's there.
+    if (entry->contents) {
+        file.data = entry->contents;
+        file.len = entry->contents_len;
+        state->prefetched = &file;
+    }
+    searchFileForPattern(server->root_fd, path, path, NULL, results, state, options);
+    state->prefetched = NULL;
+}
+
+/*
+ * Reads a file into memory if it's small enough and there's still room for it.
+ */
+static void
+loadContents(grrServer *server, grrServeEntry *entry, const char *path)
+{
+    int fd;
+    size_t len = 0;
+    ssize_t num_read = 0;
+    char *contents;
+    struct stat file_stat;
+
+    fd = openat(server->root_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size > GRR_SERVE_FILE_LIMIT ||
+        server->cached_bytes + file_stat.st_size > GRR_SERVE_CACHE_LIMIT) {
+        goto done;
+    }
+
+    contents = malloc(MAX(file_stat.st_size, 1));
+    if (!contents) {
+        goto done;
+    }
+    while (len < (size_t)file_stat.st_size) {
+        num_read = read(fd, contents + len, file_stat.st_size - len);
+        if (num_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            break;
+        }
+        len += num_read;
+    }
+    if (num_read == -1) {
+        free(contents);
+        goto done;
+    }
+
+    entry->contents = contents;
+    entry->contents_len = len;
+    server->cached_bytes += len;
+
+done:
+
+    close(fd);
+}
+
+static int
+readAll(int fd, void *buffer, size_t len)
+{
+    for (size_t done = 0; done < len;) {
+        ssize_t num_read;
+
+        num_read = read(fd, (char *)buffer + done, len - done);
+        if (num_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return GRR_APP_RET_FILE_ACCESS;
+        }
+        done += num_read;
+    }
+
+    return GRR_APP_RET_OK;
+}
+
+static int
+writeAll(int fd, const void *buffer, size_t len)
+{
+    for (size_t done = 0; done < len;) {
+        ssize_t num_written;
+
+        num_written = send(fd, (const char *)buffer + done, len - done, MSG_NOSIGNAL);
+        if (num_written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_written <= 0) {
+            return GRR_APP_RET_FILE_ACCESS;
+        }
+        done += num_written;
+    }
+
+    return GRR_APP_RET_OK;
+}
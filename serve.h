@@ -0,0 +1,43 @@
+#ifndef GRR_SERVE_H
+#define GRR_SERVE_H
+
+/*
+ * Files no larger than this are kept in the server's memory once they've been searched.
+ */
+#define GRR_SERVE_FILE_LIMIT (1024 * 1024)
+
+/*
+ * The most file contents which the server keeps in memory at once.  Files searched after the limit has been
+ * reached are read from disk every time.
+ */
+#define GRR_SERVE_CACHE_LIMIT (256 * 1024 * 1024)
+
+struct grrOptions;
+
+/*
+ * Serves queries about options->starting_directory until SIGINT or SIGTERM is received.  The server keeps a
+ * snapshot of the tree (every directory's regular files and subdirectories, in getdents64 order) along with
+ * the contents of the files which have been searched, and inotify keeps both current.  A query is therefore
+ * answered without walking the tree and, for the most part, without reading any files.
+ *
+ * Entries created while the server is running are added after their directory's other entries so results can
+ * come in a different order than a direct search's.
+ *
+ * The server listens on a Unix socket in the cache directory (see cache.h) which is named after the tree's
+ * absolute path.  Directories which couldn't be watched (e.g., because the inotify limit was reached) are
+ * listed again by every query.
+ */
+int
+grrServe(const struct grrOptions *options);
+
+/*
+ * Sends the query described by options to the server for options->starting_directory and prints the results
+ * through emitResults, just as a search would.  Only the regexes, -f, -p, -i, -n, -I, -a, -c, -A, -B,
+ * --full-line, --all-matches, --only-matching, and --count are sent.  Returns GRR_APP_RET_NOT_FOUND if no server
+ * is running, if the server is a different version of grr, or if the query uses options which the server doesn't
+ * support, in which case nothing has been printed.
+ */
+int
+grrServeQuery(const struct grrOptions *options, long *line_no);
+
+#endif  // GRR_SERVE_H
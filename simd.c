@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GRR_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef GRR_SIMD_X86
+
+typedef const char *(*grrFindLiteralFunc)(const char *, size_t, const char *, size_t);
+typedef bool (*grrLooksBinaryFunc)(const char *, size_t);
+typedef const char *(*grrFindNonPrintableFunc)(const char *, size_t);
+typedef size_t (*grrCountNewlinesFunc)(const char *, size_t);
+
+static grrFindLiteralFunc find_literal_impl;
+static grrFindLiteralFunc find_literal_fold_impl;
+static grrLooksBinaryFunc looks_binary_impl;
+static grrFindNonPrintableFunc find_non_printable_impl;
+static grrCountNewlinesFunc count_newlines_impl;
+
+#endif  // GRR_SIMD_X86
+
+static bool
+isBinaryByte(unsigned char c)
+{
+    return c < 0x20 && !(c >= '\t' && c <= '\r') && c != 0x1b;
+}
+
+static bool
+looksBinaryScalar(const char *data, size_t len)
+{
+    for (size_t k = 0; k < len; k++) {
+        if (isBinaryByte(data[k])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const char *
+findNonPrintableScalar(const char *data, size_t len)
+{
+    for (size_t k = 0; k < len; k++) {
+        unsigned char c = data[k];
+
+        if ((c < 0x20 || c > 0x7e) && c != '\t' && c != '\n') {
+            return data + k;
+        }
+    }
+
+    return NULL;
+}
+
+static inline unsigned char
+lowerByte(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/*
+ * Compares a region of the haystack against the lowercase needle regardless of case.
+ */
+static bool
+equalsFold(const char *data, const char *needle, size_t len)
+{
+    for (size_t k = 0; k < len; k++) {
+        if (lowerByte(data[k]) != (unsigned char)needle[k]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static const char *
+findLiteralFoldScalar(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    unsigned char first = needle[0];
+
+    for (size_t k = 0; k + needle_len <= haystack_len; k++) {
+        if (lowerByte(haystack[k]) == first && equalsFold(haystack + k + 1, needle + 1, needle_len - 1)) {
+            return haystack + k;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * ORing a letter with 0x20 lowercases it but ORing any other byte with it could produce a false match, so only
+ * the needle's bytes which are letters get folded.
+ */
+static inline unsigned char
+foldMask(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') ? 0x20 : 0;
+}
+
+static size_t
+countNewlinesScalar(const char *data, size_t len)
+{
+    size_t count = 0;
+    const char *end = data + len;
+
+    while ((data = memchr(data, '\n', end - data))) {
+        count++;
+        data++;
+    }
+
+    return count;
+}
+
+#ifdef GRR_SIMD_X86
+
+/*
+ * The needle's first and last bytes are compared against every position of the haystack at once.  Only the
+ * positions where both of them match get a full comparison.
+ */
+static const char *
+findLiteralSse2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    size_t k = 0;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+    for (; k + needle_len - 1 + 16 <= haystack_len; k += 16) {
+        const __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + k));
+        const __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + k + needle_len - 1));
+        unsigned int mask;
+
+        mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            unsigned int bit = __builtin_ctz(mask);
+
+            if (memcmp(haystack + k + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return haystack + k + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return memmem(haystack + k, haystack_len - k, needle, needle_len);
+}
+
+__attribute__((target("avx2"))) static const char *
+findLiteralAvx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    size_t k = 0;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+
+    for (; k + needle_len - 1 + 32 <= haystack_len; k += 32) {
+        const __m256i block_first = _mm256_loadu_si256((const __m256i *)(haystack + k));
+        const __m256i block_last = _mm256_loadu_si256((const __m256i *)(haystack + k + needle_len - 1));
+        uint32_t mask;
+
+        mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            unsigned int bit = __builtin_ctz(mask);
+
+            if (memcmp(haystack + k + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return haystack + k + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return memmem(haystack + k, haystack_len - k, needle, needle_len);
+}
+
+/*
+ * The same as findLiteralSse2 except that the blocks are lowercased (where the needle has letters) before being
+ * compared.
+ */
+static const char *
+findLiteralFoldSse2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    size_t k = 0;
+    const __m128i first = _mm_set1_epi8(needle[0]), first_mask = _mm_set1_epi8(foldMask(needle[0]));
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]),
+                  last_mask = _mm_set1_epi8(foldMask(needle[needle_len - 1]));
+
+    for (; k + needle_len - 1 + 16 <= haystack_len; k += 16) {
+        const __m128i block_first =
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)(haystack + k)), first_mask);
+        const __m128i block_last =
+            _mm_or_si128(_mm_loadu_si128((const __m128i *)(haystack + k + needle_len - 1)), last_mask);
+        unsigned int mask;
+
+        mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            unsigned int bit = __builtin_ctz(mask);
+
+            if (equalsFold(haystack + k + bit, needle, needle_len)) {
+                return haystack + k + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return findLiteralFoldScalar(haystack + k, haystack_len - k, needle, needle_len);
+}
+
+__attribute__((target("avx2"))) static const char *
+findLiteralFoldAvx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    size_t k = 0;
+    const __m256i first = _mm256_set1_epi8(needle[0]), first_mask = _mm256_set1_epi8(foldMask(needle[0]));
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]),
+                  last_mask = _mm256_set1_epi8(foldMask(needle[needle_len - 1]));
+
+    for (; k + needle_len - 1 + 32 <= haystack_len; k += 32) {
+        const __m256i block_first =
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(haystack + k)), first_mask);
+        const __m256i block_last =
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(haystack + k + needle_len - 1)), last_mask);
+        uint32_t mask;
+
+        mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        while (mask) {
+            unsigned int bit = __builtin_ctz(mask);
+
+            if (equalsFold(haystack + k + bit, needle, needle_len)) {
+                return haystack + k + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return findLiteralFoldScalar(haystack + k, haystack_len - k, needle, needle_len);
+}
+
+/*
+ * A byte is flagged if it's at most 0x1f but is neither in the range '\t' through '\r' nor an escape.  Unsigned
+ * comparisons are done by checking whether the minimum of two values equals one of them.
+ */
+static bool
+looksBinarySse2(const char *data, size_t len)
+{
+    size_t k = 0;
+    const __m128i control_max = _mm_set1_epi8(0x1f), space_min = _mm_set1_epi8('\t'),
+                  space_range = _mm_set1_epi8('\r' - '\t'), escape = _mm_set1_epi8(0x1b);
+
+    for (; k + 16 <= len; k += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *)(data + k));
+        const __m128i shifted = _mm_sub_epi8(block, space_min);
+        __m128i control, allowed;
+
+        control = _mm_cmpeq_epi8(_mm_min_epu8(block, control_max), block);
+        allowed = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(shifted, space_range), shifted),
+                               _mm_cmpeq_epi8(block, escape));
+        if (_mm_movemask_epi8(_mm_andnot_si128(allowed, control))) {
+            return true;
+        }
+    }
+
+    return looksBinaryScalar(data + k, len - k);
+}
+
+__attribute__((target("avx2"))) static bool
+looksBinaryAvx2(const char *data, size_t len)
+{
+    size_t k = 0;
+    const __m256i control_max = _mm256_set1_epi8(0x1f), space_min = _mm256_set1_epi8('\t'),
+                  space_range = _mm256_set1_epi8('\r' - '\t'), escape = _mm256_set1_epi8(0x1b);
+
+    for (; k + 32 <= len; k += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *)(data + k));
+        const __m256i shifted = _mm256_sub_epi8(block, space_min);
+        __m256i control, allowed;
+
+        control = _mm256_cmpeq_epi8(_mm256_min_epu8(block, control_max), block);
+        allowed = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(shifted, space_range), shifted),
+                                  _mm256_cmpeq_epi8(block, escape));
+        if (_mm256_movemask_epi8(_mm256_andnot_si256(allowed, control))) {
+            return true;
+        }
+    }
+
+    return looksBinaryScalar(data + k, len - k);
+}
+
+/*
+ * A byte is printable if subtracting 0x20 from it leaves at most 0x7e - 0x20, which is checked the same way as in
+ * looksBinarySse2.
+ */
+static const char *
+findNonPrintableSse2(const char *data, size_t len)
+{
+    size_t k = 0;
+    const __m128i printable_min = _mm_set1_epi8(0x20), printable_range = _mm_set1_epi8(0x7e - 0x20),
+                  tab = _mm_set1_epi8('\t'), newline = _mm_set1_epi8('\n');
+
+    for (; k + 16 <= len; k += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i *)(data + k));
+        const __m128i shifted = _mm_sub_epi8(block, printable_min);
+        __m128i allowed;
+        unsigned int mask;
+
+        allowed = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(shifted, printable_range), shifted),
+                               _mm_or_si128(_mm_cmpeq_epi8(block, tab), _mm_cmpeq_epi8(block, newline)));
+        mask = ~_mm_movemask_epi8(allowed) & 0xffff;
+        if (mask) {
+            return data + k + __builtin_ctz(mask);
+        }
+    }
+
+    return findNonPrintableScalar(data + k, len - k);
+}
+
+__attribute__((target("avx2"))) static const char *
+findNonPrintableAvx2(const char *data, size_t len)
+{
+    size_t k = 0;
+    const __m256i printable_min = _mm256_set1_epi8(0x20), printable_range = _mm256_set1_epi8(0x7e - 0x20),
+                  tab = _mm256_set1_epi8('\t'), newline = _mm256_set1_epi8('\n');
+
+    for (; k + 32 <= len; k += 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i *)(data + k));
+        const __m256i shifted = _mm256_sub_epi8(block, printable_min);
+        __m256i allowed;
+        uint32_t mask;
+
+        allowed = _mm256_or_si256(_mm256_cmpeq_epi8(block, tab), _mm256_cmpeq_epi8(block, newline));
+        allowed = _mm256_or_si256(allowed, _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, printable_range), shifted));
+        mask = ~(uint32_t)_mm256_movemask_epi8(allowed);
+        if (mask) {
+            return data + k + __builtin_ctz(mask);
+        }
+    }
+
+    return findNonPrintableScalar(data + k, len - k);
+}
+
+/*
+ * Every comparison yields -1 in the lanes holding a newline, so subtracting the comparisons from a byte-wide
+ * accumulator counts the newlines per lane.  The accumulator is summed with a SAD before any lane can overflow.
+ */
+static size_t
+countNewlinesSse2(const char *data, size_t len)
+{
+    size_t k = 0, count = 0;
+    const __m128i newline = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+
+    while (k + 16 <= len) {
+        __m128i accumulator = zero, sums;
+
+        for (unsigned int iteration = 0; iteration < 255 && k + 16 <= len; iteration++, k += 16) {
+            const __m128i block = _mm_loadu_si128((const __m128i *)(data + k));
+
+            accumulator = _mm_sub_epi8(accumulator, _mm_cmpeq_epi8(block, newline));
+        }
+
+        // Each of the two sums is at most 8 * 255 and so fits in 16 bits.
+        sums = _mm_sad_epu8(accumulator, zero);
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+
+    return count + countNewlinesScalar(data + k, len - k);
+}
+
+__attribute__((target("avx2"))) static size_t
+countNewlinesAvx2(const char *data, size_t len)
+{
+    size_t k = 0, count = 0;
+    const __m256i newline = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+
+    while (k + 32 <= len) {
+        __m256i accumulator = zero;
+        __m128i sums;
+
+        for (unsigned int iteration = 0; iteration < 255 && k + 32 <= len; iteration++, k += 32) {
+            const __m256i block = _mm256_loadu_si256((const __m256i *)(data + k));
+
+            accumulator = _mm256_sub_epi8(accumulator, _mm256_cmpeq_epi8(block, newline));
+        }
+
+        accumulator = _mm256_sad_epu8(accumulator, zero);
+        sums = _mm_add_epi64(_mm256_castsi256_si128(accumulator), _mm256_extracti128_si256(accumulator, 1));
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+
+    return count + countNewlinesScalar(data + k, len - k);
+}
+
+__attribute__((constructor)) static void
+selectImplementations(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_literal_impl = findLiteralAvx2;
+        find_literal_fold_impl = findLiteralFoldAvx2;
+        looks_binary_impl = looksBinaryAvx2;
+        find_non_printable_impl = findNonPrintableAvx2;
+        count_newlines_impl = countNewlinesAvx2;
+    }
+    else {
+        find_literal_impl = findLiteralSse2;
+        find_literal_fold_impl = findLiteralFoldSse2;
+        looks_binary_impl = looksBinarySse2;
+        find_non_printable_impl = findNonPrintableSse2;
+        count_newlines_impl = countNewlinesSse2;
+    }
+}
+
+#endif  // GRR_SIMD_X86
+
+const char *
+grrFindLiteral(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return NULL;
+    }
+    if (needle_len == 1) {
+        return memchr(haystack, needle[0], haystack_len);
+    }
+
+#ifdef GRR_SIMD_X86
+    return find_literal_impl(haystack, haystack_len, needle, needle_len);
+#else
+    return memmem(haystack, haystack_len, needle, needle_len);
+#endif
+}
+
+const char *
+grrFindLiteralFold(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return NULL;
+    }
+
+#ifdef GRR_SIMD_X86
+    return find_literal_fold_impl(haystack, haystack_len, needle, needle_len);
+#else
+    return findLiteralFoldScalar(haystack, haystack_len, needle, needle_len);
+#endif
+}
+
+bool
+grrLooksBinary(const char *data, size_t len)
+{
+#ifdef GRR_SIMD_X86
+    return looks_binary_impl(data, len);
+#else
+    return looksBinaryScalar(data, len);
+#endif
+}
+
+const char *
+grrFindNonPrintable(const char *data, size_t len)
+{
+#ifdef GRR_SIMD_X86
+    return find_non_printable_impl(data, len);
+#else
+    return findNonPrintableScalar(data, len);
+#endif
+}
+
+size_t
+grrCountNewlines(const char *data, size_t len)
+{
+#ifdef GRR_SIMD_X86
+    return count_newlines_impl(data, len);
+#else
+    return countNewlinesScalar(data, len);
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef GRR_SIMD_H
+#define GRR_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Vectorized scanning primitives.  On x86-64, the AVX2 versions are used when the processor supports them and
+ * the SSE2 versions otherwise.  Other architectures get portable fallbacks.
+ */
+
+/*
+ * Equivalent to memmem(3).
+ */
+const char *
+grrFindLiteral(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len);
+
+/*
+ * Like grrFindLiteral but ASCII letters in the haystack match regardless of their case.  The needle has to be
+ * lowercase.
+ */
+const char *
+grrFindLiteralFold(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len);
+
+/*
+ * Determines whether data looks like it comes from a binary file: i.e., whether it contains a null byte or any
+ * other control character which doesn't show up in text (whitespace and escape sequences are allowed).
+ */
+bool
+grrLooksBinary(const char *data, size_t len);
+
+/*
+ * Returns the first byte in data which the engine could reject as non-printable (anything other than printable
+ * ASCII, tabs, and newlines) or NULL if there isn't one.
+ */
+const char *
+grrFindNonPrintable(const char *data, size_t len);
+
+/*
+ * Counts the newlines in data.
+ */
+size_t
+grrCountNewlines(const char *data, size_t len);
+
+#endif  // GRR_SIMD_H
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const char *const counter_names[GRR_STAT_NUM_COUNTERS] = {
+    [GRR_STAT_DIRECTORIES] = "directories_opened",
+    [GRR_STAT_ENTRIES] = "entries_seen",
+    [GRR_STAT_LSTATS] = "lstat_calls",
+    [GRR_STAT_FILE_PATTERN_SKIPS] = "file_pattern_skips",
+    [GRR_STAT_FILES_OPENED] = "files_opened",
+    [GRR_STAT_CACHE_HITS] = "cache_hits",
+    [GRR_STAT_BYTES_READ] = "bytes_read",
+    [GRR_STAT_LINES_MATCHED] = "lines_matched",
+    [GRR_STAT_BINARY_ABORTS] = "binary_aborts",
+    [GRR_STAT_ARENA_ALLOCATIONS] = "arena_allocations",
+    [GRR_STAT_ARENA_BLOCKS] = "arena_blocks",
+    [GRR_STAT_ARENA_BYTES] = "arena_bytes",
+};
+
+static const char *const counter_descriptions[GRR_STAT_NUM_COUNTERS] = {
+    [GRR_STAT_DIRECTORIES] = "Directories opened",
+    [GRR_STAT_ENTRIES] = "Entries seen",
+    [GRR_STAT_LSTATS] = "lstat calls",
+    [GRR_STAT_FILE_PATTERN_SKIPS] = "Files skipped by -f",
+    [GRR_STAT_FILES_OPENED] = "Files opened",
+    [GRR_STAT_CACHE_HITS] = "Files reused from the cache",
+    [GRR_STAT_BYTES_READ] = "Bytes read",
+    [GRR_STAT_LINES_MATCHED] = "Lines matched",
+    [GRR_STAT_BINARY_ABORTS] = "Binary files skipped",
+    [GRR_STAT_ARENA_ALLOCATIONS] = "Arena allocations",
+    [GRR_STAT_ARENA_BLOCKS] = "Arena blocks malloc'ed",
+    [GRR_STAT_ARENA_BYTES] = "Arena bytes malloc'ed",
+};
+
+static const char *const timer_names[GRR_STAT_NUM_TIMERS] = {
+    [GRR_TIMER_TRAVERSAL] = "traversal",
+    [GRR_TIMER_IO] = "io",
+    [GRR_TIMER_MATCHING] = "matching",
+    [GRR_TIMER_OUTPUT] = "output",
+};
+
+static const char *const timer_descriptions[GRR_STAT_NUM_TIMERS] = {
+    [GRR_TIMER_TRAVERSAL] = "Traversal",
+    [GRR_TIMER_IO] = "I/O",
+    [GRR_TIMER_MATCHING] = "Matching",
+    [GRR_TIMER_OUTPUT] = "Output",
+};
+
+uint64_t
+grrStatsStart(const grrStats *stats)
+{
+    struct timespec now;
+
+    if (!stats) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void
+grrStatsStop(grrStats *stats, int timer, uint64_t start)
+{
+    if (stats) {
+        stats->timers[timer] += grrStatsStart(stats) - start;
+    }
+}
+
+void
+grrStatsMerge(grrStats *total, const grrStats *stats)
+{
+    if (!total || !stats) {
+        return;
+    }
+
+    for (int k = 0; k < GRR_STAT_NUM_COUNTERS; k++) {
+        total->counters[k] += stats->counters[k];
+    }
+    for (int k = 0; k < GRR_STAT_NUM_TIMERS; k++) {
+        total->timers[k] += stats->timers[k];
+    }
+}
+
+void
+grrStatsPrint(const grrStats *stats, uint64_t elapsed, long num_threads, bool json)
+{
+    struct rusage usage = {0};
+
+    // ru_maxrss is in kilobytes on Linux.
+    getrusage(RUSAGE_SELF, &usage);
+
+    if (json) {
+        fprintf(stderr, "{\"threads\": %li, \"elapsed_ms\": %.3f", num_threads, elapsed / 1e6);
+        for (int k = 0; k < GRR_STAT_NUM_COUNTERS; k++) {
+            fprintf(stderr, ", \"%s\": %llu", counter_names[k], (unsigned long long)stats->counters[k]);
+        }
+        fprintf(stderr, ", \"peak_rss_kb\": %li", usage.ru_maxrss);
+        fprintf(stderr, ", \"time_ms\": {");
+        for (int k = 0; k < GRR_STAT_NUM_TIMERS; k++) {
+            fprintf(stderr, "%s\"%s\": %.3f", (k > 0) ? ", " : "", timer_names[k], stats->timers[k] / 1e6);
+        }
+        fprintf(stderr, "}}\n");
+        return;
+    }
+
+    fprintf(stderr, "Statistics:\n");
+    for (int k = 0; k < GRR_STAT_NUM_COUNTERS; k++) {
+        fprintf(stderr, "    %-28s %llu\n", counter_descriptions[k], (unsigned long long)stats->counters[k]);
+    }
+    fprintf(stderr, "    %-28s %li\n", "Peak RSS (KiB)", usage.ru_maxrss);
+    // With more than one thread, the phases overlap so their times add up to more than the elapsed time.
+    fprintf(stderr, "Time (ms)%s:\n", (num_threads > 1) ? ", summed across threads" : "");
+    for (int k = 0; k < GRR_STAT_NUM_TIMERS; k++) {
+        fprintf(stderr, "    %-28s %.3f\n", timer_descriptions[k], stats->timers[k] / 1e6);
+    }
+    fprintf(stderr, "    %-28s %.3f\n", "Elapsed", elapsed / 1e6);
+}
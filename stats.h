@@ -0,0 +1,76 @@
+#ifndef GRR_STATS_H
+#define GRR_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum grrStatCounter {
+    GRR_STAT_DIRECTORIES = 0,
+    GRR_STAT_ENTRIES,
+    GRR_STAT_LSTATS,
+    GRR_STAT_FILE_PATTERN_SKIPS,
+    GRR_STAT_FILES_OPENED,
+    GRR_STAT_CACHE_HITS,
+    GRR_STAT_BYTES_READ,
+    GRR_STAT_LINES_MATCHED,
+    GRR_STAT_BINARY_ABORTS,
+    GRR_STAT_ARENA_ALLOCATIONS,
+    GRR_STAT_ARENA_BLOCKS,
+    GRR_STAT_ARENA_BYTES,
+    GRR_STAT_NUM_COUNTERS,
+};
+
+/*
+ * The phases of a search.  Memory-mapped files are paged in as they're matched so, for them, the matching time
+ * includes part of the I/O.
+ */
+enum grrStatTimer {
+    GRR_TIMER_TRAVERSAL = 0,
+    GRR_TIMER_IO,
+    GRR_TIMER_MATCHING,
+    GRR_TIMER_OUTPUT,
+    GRR_STAT_NUM_TIMERS,
+};
+
+/*
+ * Counters and timers (in nanoseconds) collected when --stats is used.  Each search state has its own copy
+ * so that threads never share one.  The copies are merged once the search is over.
+ */
+typedef struct grrStats {
+    uint64_t counters[GRR_STAT_NUM_COUNTERS];
+    uint64_t timers[GRR_STAT_NUM_TIMERS];
+} grrStats;
+
+/*
+ * The stats pointer is NULL when --stats isn't used so that the only cost on the hot path is a branch.
+ */
+#define GRR_STAT_ADD(stats, counter, amount)        \
+    do {                                            \
+        if (stats) {                                \
+            (stats)->counters[counter] += (amount); \
+        }                                           \
+    } while (0)
+
+/*
+ * Returns the current time in nanoseconds or 0 if stats is NULL.
+ */
+uint64_t
+grrStatsStart(const grrStats *stats);
+
+/*
+ * Adds the time since start, as returned by grrStatsStart, to the timer.
+ */
+void
+grrStatsStop(grrStats *stats, int timer, uint64_t start);
+
+void
+grrStatsMerge(grrStats *total, const grrStats *stats);
+
+/*
+ * Prints the report to stderr, along with the process's peak resident set size.  The elapsed time is the
+ * wall-clock time of the whole search.
+ */
+void
+grrStatsPrint(const grrStats *stats, uint64_t elapsed, long num_threads, bool json);
+
+#endif  // GRR_STATS_H
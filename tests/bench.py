@@ -0,0 +1,258 @@
+#!/usr/bin/python3
+
+"""
+Benchmarks grr over a set of synthetic corpora.
+
+The corpora are generated from a fixed seed so that every run (and every machine) searches the same data.  They
+are cached in tests/.bench and only regenerated when CORPUS_VERSION or --scale changes.
+
+For every corpus and pattern, grr is run --runs times and the median wall-clock time is used to compute the
+throughput.  One further run with -v measures the per-file latency: grr announces each file on stderr as it
+opens it, so the time between consecutive announcements is the time spent on a file.
+
+With --save-baseline, the results are written to tests/bench_baseline.json.  Otherwise, they're compared against
+that file if it exists.
+"""
+
+import argparse
+import json
+import os
+import random
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+
+CORPUS_VERSION = 1
+SEED = 0x677272
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+CORPUS_DIR = os.path.join(TESTS_DIR, ".bench")
+BASELINE = os.path.join(TESTS_DIR, "bench_baseline.json")
+GRR = os.path.join(TESTS_DIR, "..", "grr")
+
+PATTERNS = {
+    "literal": "connect_timeout",
+    "alternation": "error|warning|fatal",
+    "star": "a.*b.*c.*d",
+    "class": "[a-z]+_[0-9]+",
+    "anchored": "^#include",
+}
+
+WORDS = (
+    "the of and to in is for on with as at by from this that return if else while static int char const "
+    "struct void size_t error warning fatal connect timeout buffer length offset result value pointer "
+    "#include #define abc bcd cde def"
+).split()
+
+
+def make_line(rng, num_words):
+    words = rng.choices(WORDS, k=num_words)
+    if rng.random() < 0.01:
+        words.insert(rng.randrange(len(words) + 1), "connect_timeout")
+    if rng.random() < 0.05:
+        words.insert(rng.randrange(len(words) + 1), f"{rng.choice(WORDS).strip('#')}_{rng.randrange(1000)}")
+    return " ".join(words)
+
+
+def make_text(rng, size, words_per_line=(3, 15)):
+    lines = []
+    total = 0
+    while total < size:
+        line = make_line(rng, rng.randint(*words_per_line))
+        lines.append(line)
+        total += len(line) + 1
+    return "\n".join(lines) + "\n"
+
+
+def write_file(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    mode = "wb" if isinstance(data, bytes) else "w"
+    with open(path, mode) as f:
+        f.write(data)
+
+
+def generate_small(root, rng, scale):
+    for k in range(int(5000 * scale)):
+        write_file(os.path.join(root, f"d{k % 50}", f"f{k}.c"), make_text(rng, rng.randint(200, 4000)))
+
+
+def generate_huge(root, rng, scale):
+    for k in range(3):
+        write_file(os.path.join(root, f"huge{k}.txt"), make_text(rng, int(32 * 1024 * 1024 * scale)))
+
+
+def generate_long_lines(root, rng, scale):
+    for k in range(int(20 * scale) or 1):
+        write_file(os.path.join(root, f"long{k}.txt"), make_text(rng, 1024 * 1024, (10000, 40000)))
+
+
+def generate_binaries(root, rng, scale):
+    for k in range(int(200 * scale) or 1):
+        header = b"\x7fELF\x02\x01\x01\x00" + bytes(8)
+        body = rng.randbytes(rng.randint(16 * 1024, 256 * 1024))
+        write_file(os.path.join(root, f"bin{k}.o"), header + body)
+
+
+def generate_deep(root, rng, scale):
+    for branch in range(int(20 * scale) or 1):
+        path = os.path.join(root, f"b{branch}")
+        for depth in range(40):
+            path = os.path.join(path, f"level{depth}")
+            write_file(os.path.join(path, "file.h"), make_text(rng, rng.randint(100, 1000)))
+
+
+CORPORA = {
+    "small": generate_small,
+    "huge": generate_huge,
+    "long_lines": generate_long_lines,
+    "binaries": generate_binaries,
+    "deep": generate_deep,
+}
+
+
+def generate_corpora(scale):
+    stamp = os.path.join(CORPUS_DIR, "version")
+    expected = f"{CORPUS_VERSION} {scale}\n"
+
+    try:
+        with open(stamp, "r") as f:
+            if f.read() == expected:
+                return
+    except FileNotFoundError:
+        pass
+
+    print(f"Generating corpora in {CORPUS_DIR}...", file=sys.stderr)
+    shutil.rmtree(CORPUS_DIR, ignore_errors=True)
+    for name, generator in CORPORA.items():
+        generator(os.path.join(CORPUS_DIR, name), random.Random(f"{SEED}-{name}"), scale)
+    write_file(stamp, expected)
+
+
+def corpus_size(root):
+    num_files = 0
+    num_bytes = 0
+    for dirpath, _, filenames in os.walk(root):
+        for filename in filenames:
+            num_files += 1
+            num_bytes += os.path.getsize(os.path.join(dirpath, filename))
+    return num_files, num_bytes
+
+
+def run_grr(root, pattern, extra=()):
+    # -y keeps the history file out of the measurements.
+    return [GRR, "-r", pattern, "-d", root, "-y", "-c", *extra]
+
+
+def time_run(args):
+    start = time.perf_counter()
+    subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def file_latencies(args):
+    latencies = []
+    process = subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    last = time.perf_counter()
+    opened = False
+    for line in process.stderr:
+        now = time.perf_counter()
+        if line.startswith(b"Opening "):
+            if opened:
+                latencies.append(now - last)
+            last = now
+            opened = True
+    if opened:
+        latencies.append(time.perf_counter() - last)
+    process.wait()
+    return latencies
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def benchmark(corpus, pattern, runs, extra):
+    root = os.path.join(CORPUS_DIR, corpus)
+    num_files, num_bytes = corpus_size(root)
+    times = [time_run(run_grr(root, pattern, extra)) for _ in range(runs)]
+    latencies = file_latencies(run_grr(root, pattern, ("-v", *extra)))
+    wall = statistics.median(times)
+
+    return {
+        "wall": wall,
+        "stdev": statistics.stdev(times) if len(times) > 1 else 0.0,
+        "mb_per_s": num_bytes / (1024 * 1024) / wall,
+        "files_per_s": num_files / wall,
+        "p50_ms": percentile(latencies, 0.50) * 1000,
+        "p99_ms": percentile(latencies, 0.99) * 1000,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmarks grr over synthetic corpora.")
+    parser.add_argument("--runs", type=int, default=5, help="Number of timed runs per case.")
+    parser.add_argument("--scale", type=float, default=1.0, help="Multiplier for the corpus sizes.")
+    parser.add_argument("--threads", type=int, default=1, help="Value passed to -j.")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="Slowdown (in percent) beyond which a case is reported as a regression.")
+    parser.add_argument("--save-baseline", action="store_true", help="Store the results as the baseline.")
+    args = parser.parse_args()
+
+    if not os.access(GRR, os.X_OK):
+        print("grr hasn't been built.", file=sys.stderr)
+        return 1
+
+    generate_corpora(args.scale)
+    extra = ("-j", str(args.threads)) if args.threads > 1 else ()
+
+    baseline = None
+    if not args.save_baseline and os.path.exists(BASELINE):
+        with open(BASELINE, "r") as f:
+            baseline = json.load(f)
+        if baseline.get("scale") != args.scale or baseline.get("threads") != args.threads:
+            print("Ignoring the baseline since it was recorded with different settings.", file=sys.stderr)
+            baseline = None
+
+    results = {}
+    regressions = 0
+    header = f"{'corpus':<12}{'pattern':<13}{'wall (s)':>10}{'stdev':>9}{'MB/s':>10}{'files/s':>11}"
+    header += f"{'p50 (ms)':>10}{'p99 (ms)':>10}"
+    if baseline:
+        header += f"{'change':>9}"
+    print(header)
+
+    for corpus in CORPORA:
+        for name, pattern in PATTERNS.items():
+            key = f"{corpus}/{name}"
+            result = benchmark(corpus, pattern, args.runs, extra)
+            results[key] = result
+
+            line = f"{corpus:<12}{name:<13}{result['wall']:>10.3f}{result['stdev']:>9.3f}"
+            line += f"{result['mb_per_s']:>10.1f}{result['files_per_s']:>11.0f}"
+            line += f"{result['p50_ms']:>10.3f}{result['p99_ms']:>10.3f}"
+            if baseline and key in baseline["results"]:
+                change = (result["wall"] / baseline["results"][key]["wall"] - 1) * 100
+                line += f"{change:>+8.1f}%"
+                if change > args.threshold:
+                    line += "  REGRESSION"
+                    regressions += 1
+            print(line, flush=True)
+
+    if args.save_baseline:
+        with open(BASELINE, "w") as f:
+            json.dump({"scale": args.scale, "threads": args.threads, "results": results}, f, indent=4)
+            f.write("\n")
+        print(f"Saved the baseline to {BASELINE}.")
+    elif baseline:
+        print(f"{regressions} case(s) regressed by more than {args.threshold}%.")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
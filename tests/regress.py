@@ -0,0 +1,80 @@
+#!/usr/bin/python3
+
+"""
+Regression checks for bugs which the synthetic benchmarks wouldn't notice.
+
+Each check builds a small tree in a temporary directory, runs grr over it with HOME pointing at that directory
+(so that the history file and the caches start out empty), and compares the output against what it should be.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+GRR = os.path.join(TESTS_DIR, "..", "grr")
+
+
+def write_file(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(data)
+
+
+def run_grr(home, *args):
+    env = dict(os.environ, HOME=home)
+    return subprocess.run([GRR, "-c", *args], env=env, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                          text=True).stdout
+
+
+def check_fold_case_cache(root):
+    """Regexes which only differ in case share a folded form but have to tag their results differently."""
+    write_file(os.path.join(root, "tree", "a.txt"), "hello world\nfoo bar\n")
+    tree = os.path.join(root, "tree")
+
+    expected = run_grr(root, "-y", "-I", "-r", "world", "-r", "bar", "-d", tree)
+    run_grr(root, "-y", "-I", "-r", "World", "-r", "bar", "-d", tree, "--cache-results")
+    actual = run_grr(root, "-y", "-I", "-r", "world", "-r", "bar", "-d", tree, "--cache-results")
+    return expected, actual
+
+
+def check_context_all_matches(root):
+    """A regex which looks before its match can't be resumed in the rest of a line so --all-matches refuses it
+    rather than reporting a wrong count, while a regex anchored in every alternative matches once per line."""
+    write_file(os.path.join(root, "tree", "a.txt"), "foo xfoo foo\nxfoo\n")
+    tree = os.path.join(root, "tree")
+
+    expected = ["", "", "(0) {}: 2\n".format(os.path.join(tree, "a.txt"))]
+    actual = [run_grr(root, "-y", "-r", regex, "-d", tree, "--all-matches", "--count")
+              for regex in ("(^| )foo", "\\bfoo", "^foo|^x")]
+    return expected, actual
+
+
+CHECKS = [
+    check_fold_case_cache,
+    check_context_all_matches,
+]
+
+
+def main():
+    if not os.access(GRR, os.X_OK):
+        print("grr hasn't been built.", file=sys.stderr)
+        return 1
+
+    failures = 0
+    for check in CHECKS:
+        with tempfile.TemporaryDirectory() as root:
+            expected, actual = check(root)
+        if expected == actual:
+            print(f"{check.__name__}: ok")
+        else:
+            print(f"{check.__name__}: FAILED\n--- expected\n{expected}--- actual\n{actual}", end="")
+            failures += 1
+
+    print(f"{failures} of {len(CHECKS)} check(s) failed.")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())